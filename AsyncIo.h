@@ -0,0 +1,376 @@
+#ifndef ASYNC_IO_H
+#define ASYNC_IO_H
+
+#include<algorithm>
+#include<cerrno>
+#include<condition_variable>
+#include<cstddef>
+#include<cstdint>
+#include<cstring>
+#include<deque>
+#include<mutex>
+#include<system_error>
+#include<thread>
+#include<utility>
+#include<vector>
+#include<sys/types.h>
+#include<unistd.h>
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include<linux/io_uring.h>
+#include<sys/mman.h>
+#include<sys/syscall.h>
+#define BPTREE_IO_URING 1
+#endif
+
+//Asynchronous file reads and writes whose completions are handled on the caller's thread. read() and
+//write() queue a request, submit() hands the queue over, and the callbacks run inside poll() and wait()
+//on the thread calling them, so callers need no locking of their own.
+//Requests go through io_uring when the kernel offers it and a probe of the ring reports IORING_OP_READ and
+//IORING_OP_WRITE (5.6 or later); otherwise a pool of threads issues them with pread and pwrite.
+//At most depth requests are outstanding; queuing one more first waits for a completion. A failed wait on
+//the ring throws std::system_error; failed requests are reported to their callbacks.
+class AsyncIo{
+	public:
+		typedef void (*Callback)(void* context, ssize_t result); //result is the bytes transferred or -errno
+		static constexpr unsigned defaultDepth = 256;
+		static constexpr unsigned defaultThreads = 4;
+
+		explicit AsyncIo(unsigned depth = defaultDepth, unsigned fallbackThreads = defaultThreads, bool useIoUring = true);
+		AsyncIo(const AsyncIo&) = delete;
+		AsyncIo& operator=(const AsyncIo&) = delete;
+		~AsyncIo(); //Finishes every outstanding request, running its callback
+
+		void read(int fd, void* buf, size_t bytes, uint64_t offset, Callback, void* context);
+		void write(int fd, const void* buf, size_t bytes, uint64_t offset, Callback, void* context);
+		void submit();
+		size_t poll(); //Run the callbacks of finished requests without blocking; returns how many ran
+		size_t wait(); //Submit, block until a request finishes, then poll. Returns 0 at once if none is outstanding.
+		void drain(); //Wait until nothing is outstanding
+		size_t outstanding() const noexcept{ //Queued or in flight
+			return depth - freeSlots.size();
+		}
+		bool usingIoUring() const noexcept{
+			return ringFd >= 0;
+		}
+	private:
+		struct Request{
+			int fd;
+			bool write;
+			void* buf;
+			size_t bytes;
+			uint64_t offset;
+			Callback callback;
+			void* context;
+			ssize_t result;
+		};
+		void enqueue(const Request&);
+		size_t complete(const std::vector<uint32_t>&);
+		void reap(std::vector<uint32_t>&, bool block);
+		bool setUpRing();
+		static bool ringSupportsReadWrite(int ringFd);
+		void tearDownRing() noexcept;
+		void worker();
+
+		const unsigned depth;
+		std::vector<Request> slots;
+		std::vector<uint32_t> freeSlots;
+		std::vector<uint32_t> queued; //Slots not yet submitted
+
+		//io_uring: submission and completion rings shared with the kernel
+		int ringFd;
+		void* sqMap;
+		size_t sqMapBytes;
+		void* cqMap;
+		size_t cqMapBytes;
+		void* sqesMap;
+		size_t sqesMapBytes;
+		unsigned* sqTail;
+		unsigned* sqMask;
+		unsigned* sqArray;
+		unsigned* cqHead;
+		unsigned* cqTail;
+		unsigned* cqMask;
+		void* cqes;
+
+		//Fallback: worker threads take slots from pending and put them on done. With io_uring, done holds
+		//requests the kernel refused to take.
+		std::mutex mutex;
+		std::condition_variable work;
+		std::condition_variable doneSignal;
+		std::deque<uint32_t> pending;
+		std::vector<uint32_t> done;
+		std::vector<std::thread> workers;
+		bool stopping;
+};
+
+/*==================== AsyncIo implementation ==========================*/
+inline AsyncIo::AsyncIo(unsigned d, unsigned fallbackThreads, bool useIoUring)
+	: depth(d), slots(d), ringFd(-1), sqMap(nullptr), sqMapBytes(0), cqMap(nullptr), cqMapBytes(0), sqesMap(nullptr),
+	sqesMapBytes(0), stopping(false){
+	for(unsigned i = 0; i < depth; ++i)
+		freeSlots.push_back(depth - 1 - i);
+	if(useIoUring && setUpRing())
+		return;
+	for(unsigned i = 0; i < (fallbackThreads ? fallbackThreads : 1); ++i)
+		workers.emplace_back(&AsyncIo::worker, this);
+}
+
+inline AsyncIo::~AsyncIo(){
+	drain();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	work.notify_all();
+	for(auto& thread : workers)
+		thread.join();
+	tearDownRing();
+}
+
+inline bool AsyncIo::setUpRing(){
+#ifdef BPTREE_IO_URING
+	io_uring_params params;
+	std::memset(&params, 0, sizeof(params));
+	int fd = syscall(__NR_io_uring_setup, depth, &params);
+	if(fd < 0)
+		return false;
+	ringFd = fd;
+	if(!ringSupportsReadWrite(fd)){
+		tearDownRing();
+		return false;
+	}
+	sqMapBytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	cqMapBytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	if(params.features & IORING_FEAT_SINGLE_MMAP)
+		sqMapBytes = cqMapBytes = std::max(sqMapBytes, cqMapBytes);
+	sqMap = mmap(nullptr, sqMapBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if(sqMap == MAP_FAILED){
+		sqMap = nullptr;
+		tearDownRing();
+		return false;
+	}
+	if(params.features & IORING_FEAT_SINGLE_MMAP){
+		cqMap = sqMap;
+	}else{
+		cqMap = mmap(nullptr, cqMapBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if(cqMap == MAP_FAILED){
+			cqMap = nullptr;
+			tearDownRing();
+			return false;
+		}
+	}
+	sqesMapBytes = params.sq_entries * sizeof(io_uring_sqe);
+	sqesMap = mmap(nullptr, sqesMapBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if(sqesMap == MAP_FAILED){
+		sqesMap = nullptr;
+		tearDownRing();
+		return false;
+	}
+	char* sq = static_cast<char*>(sqMap);
+	char* cq = static_cast<char*>(cqMap);
+	sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+	sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+	sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+	cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+	cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+	cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+	cqes = cq + params.cq_off.cqes;
+	return true;
+#else
+	return false;
+#endif
+}
+
+//A ring can be set up on 5.1 to 5.5, where every IORING_OP_READ and IORING_OP_WRITE fails with EINVAL.
+//IORING_REGISTER_PROBE arrived with them in 5.6, so a kernel that rejects the probe lacks them too.
+inline bool AsyncIo::ringSupportsReadWrite(int fd){
+#ifdef BPTREE_IO_URING
+	const unsigned maxOps = 256;
+	std::vector<char> buffer(sizeof(io_uring_probe) + maxOps * sizeof(io_uring_probe_op), 0);
+	io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+	if(syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, maxOps) < 0)
+		return false;
+	auto supported = [probe](unsigned op){
+		return op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+	};
+	return supported(IORING_OP_READ) && supported(IORING_OP_WRITE);
+#else
+	return false;
+#endif
+}
+
+inline void AsyncIo::tearDownRing() noexcept{
+#ifdef BPTREE_IO_URING
+	if(sqesMap)
+		munmap(sqesMap, sqesMapBytes);
+	if(cqMap && cqMap != sqMap)
+		munmap(cqMap, cqMapBytes);
+	if(sqMap)
+		munmap(sqMap, sqMapBytes);
+	sqMap = cqMap = sqesMap = nullptr;
+	if(ringFd >= 0)
+		::close(ringFd);
+	ringFd = -1;
+#endif
+}
+
+inline void AsyncIo::read(int fd, void* buf, size_t bytes, uint64_t offset, Callback callback, void* context){
+	enqueue(Request{fd, false, buf, bytes, offset, callback, context, 0});
+}
+
+inline void AsyncIo::write(int fd, const void* buf, size_t bytes, uint64_t offset, Callback callback, void* context){
+	enqueue(Request{fd, true, const_cast<void*>(buf), bytes, offset, callback, context, 0});
+}
+
+inline void AsyncIo::enqueue(const Request& request){
+	while(freeSlots.empty())
+		wait();
+	uint32_t slot = freeSlots.back();
+	freeSlots.pop_back();
+	slots[slot] = request;
+	queued.push_back(slot);
+}
+
+inline void AsyncIo::submit(){
+	if(queued.empty())
+		return;
+	if(ringFd < 0){
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			pending.insert(pending.end(), queued.begin(), queued.end());
+		}
+		queued.clear();
+		work.notify_all();
+		return;
+	}
+#ifdef BPTREE_IO_URING
+	//Depth bounds the outstanding requests, so the submission ring always has room
+	unsigned tail = *sqTail;
+	for(uint32_t slot : queued){
+		const Request& request = slots[slot];
+		unsigned index = tail & *sqMask;
+		io_uring_sqe* sqe = static_cast<io_uring_sqe*>(sqesMap) + index;
+		std::memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = request.write ? IORING_OP_WRITE : IORING_OP_READ;
+		sqe->fd = request.fd;
+		sqe->addr = reinterpret_cast<uint64_t>(request.buf);
+		sqe->len = request.bytes;
+		sqe->off = request.offset;
+		sqe->user_data = slot;
+		sqArray[index] = index;
+		++tail;
+	}
+	__atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+	unsigned toSubmit = queued.size();
+	queued.clear();
+	while(toSubmit > 0){
+		int n = syscall(__NR_io_uring_enter, ringFd, toSubmit, 0, 0, nullptr, 0);
+		if(n < 0){
+			if(errno == EINTR || errno == EAGAIN || errno == EBUSY)
+				continue;
+			//The kernel refused the rest; fail them through the completion path like any other error
+			int error = errno;
+			unsigned head = tail - toSubmit;
+			__atomic_store_n(sqTail, head, __ATOMIC_RELEASE);
+			std::lock_guard<std::mutex> lock(mutex);
+			for(; head != tail; ++head){
+				uint32_t slot = static_cast<io_uring_sqe*>(sqesMap)[head & *sqMask].user_data;
+				slots[slot].result = -error;
+				done.push_back(slot);
+			}
+			break;
+		}
+		toSubmit -= n;
+	}
+#endif
+}
+
+//Collect finished slots, blocking for at least one if asked to
+inline void AsyncIo::reap(std::vector<uint32_t>& out, bool block){
+	if(ringFd < 0){
+		std::unique_lock<std::mutex> lock(mutex);
+		if(block)
+			doneSignal.wait(lock, [this]{ return !done.empty(); });
+		out.insert(out.end(), done.begin(), done.end());
+		done.clear();
+		return;
+	}
+#ifdef BPTREE_IO_URING
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		out.insert(out.end(), done.begin(), done.end());
+		done.clear();
+	}
+	for(;;){
+		unsigned head = *cqHead;
+		unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+		for(; head != tail; ++head){
+			const io_uring_cqe& cqe = static_cast<const io_uring_cqe*>(cqes)[head & *cqMask];
+			slots[cqe.user_data].result = cqe.res;
+			out.push_back(cqe.user_data);
+		}
+		__atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+		if(!out.empty() || !block)
+			break;
+		int n = syscall(__NR_io_uring_enter, ringFd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+		if(n < 0 && errno != EINTR)
+			throw std::system_error(errno, std::generic_category(), "AsyncIo: io_uring_enter");
+	}
+#endif
+}
+
+//Free the slots first, so callbacks can queue new requests
+inline size_t AsyncIo::complete(const std::vector<uint32_t>& finishedSlots){
+	std::vector<Request> requests;
+	requests.reserve(finishedSlots.size());
+	for(uint32_t slot : finishedSlots){
+		requests.push_back(slots[slot]);
+		freeSlots.push_back(slot);
+	}
+	for(const Request& request : requests)
+		request.callback(request.context, request.result);
+	return requests.size();
+}
+
+inline size_t AsyncIo::poll(){
+	submit();
+	std::vector<uint32_t> ready;
+	reap(ready, false);
+	return complete(ready);
+}
+
+inline size_t AsyncIo::wait(){
+	submit();
+	if(outstanding() == 0)
+		return 0;
+	std::vector<uint32_t> ready;
+	reap(ready, true);
+	return complete(ready);
+}
+
+inline void AsyncIo::drain(){
+	while(outstanding() > 0)
+		wait();
+}
+
+inline void AsyncIo::worker(){
+	std::unique_lock<std::mutex> lock(mutex);
+	for(;;){
+		work.wait(lock, [this]{ return stopping || !pending.empty(); });
+		if(pending.empty())
+			return;
+		uint32_t slot = pending.front();
+		pending.pop_front();
+		Request request = slots[slot];
+		lock.unlock();
+		ssize_t n = request.write ? pwrite(request.fd, request.buf, request.bytes, request.offset)
+				: pread(request.fd, request.buf, request.bytes, request.offset);
+		lock.lock();
+		slots[slot].result = n < 0 ? -errno : n;
+		done.push_back(slot);
+		doneSignal.notify_one();
+	}
+}
+/*===================== End of AsyncIo =========================================*/
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef BLOB_BPTREE_H
+#define BLOB_BPTREE_H
+
+#include "BpTree.h"
+#include "ValueStore.h"
+#include <string_view>
+
+//BpTree for large byte-string values. Leaves hold 16-byte ValueHandles (see ValueStore.h): short values
+//inline, longer ones in a slab region owned by the tree. Structural changes only move handles, and reads
+//return a view of the stored bytes instead of a copy.
+template<typename Key, typename Compare = std::less<Key>, int KeysLimit = 3,
+		typename Allocator = NewDeleteNodeAllocator>
+class BlobBpTree{
+	public:
+		typedef BpTree<Key, ValueHandle, Compare, KeysLimit, Allocator> Tree;
+
+		explicit BlobBpTree(bool hugePages = false) noexcept : values(hugePages){
+		}
+		BlobBpTree(const BlobBpTree&) = delete;
+		BlobBpTree& operator=(const BlobBpTree&) = delete;
+
+		bool insert(const Key& k, std::string_view value);
+		bool remove(const Key&) noexcept;
+		//Set value to a view of the stored bytes and return true, or return false if k is absent.
+		//The view is valid until the tree is next modified.
+		bool find(const Key& k, std::string_view& value) const noexcept;
+		//Call fn(key, std::string_view) for keys in [lo, hi) in ascending order. If fn returns bool,
+		//false stops the scan.
+		template<typename Fn>
+		void scan(const Key& lo, const Key& hi, Fn&& fn) const;
+		void clear() noexcept;
+		size_t valueBytesReserved() const noexcept{ //Slab memory held for out-of-line values
+			return values.bytesReserved();
+		}
+		const Tree& tree() const noexcept{
+			return entries;
+		}
+	private:
+		Tree entries;
+		ValueStore values;
+};
+
+/*==================== BlobBpTree implementation ==========================*/
+template<typename Key, typename Compare, int KeysLimit, typename Allocator>
+bool BlobBpTree<Key, Compare, KeysLimit, Allocator>::insert(const Key& k, std::string_view value){
+	if(entries.findPtr(k))
+		return false;
+	return entries.insert(k, values.store(value));
+}
+
+template<typename Key, typename Compare, int KeysLimit, typename Allocator>
+bool BlobBpTree<Key, Compare, KeysLimit, Allocator>::remove(const Key& k) noexcept{
+	const ValueHandle* handle = entries.findPtr(k);
+	if(!handle)
+		return false;
+	ValueHandle removed = *handle;
+	entries.remove(k);
+	values.release(removed);
+	return true;
+}
+
+template<typename Key, typename Compare, int KeysLimit, typename Allocator>
+bool BlobBpTree<Key, Compare, KeysLimit, Allocator>::find(const Key& k, std::string_view& value) const noexcept{
+	const ValueHandle* handle = entries.findPtr(k);
+	if(!handle)
+		return false;
+	value = handle->view();
+	return true;
+}
+
+template<typename Key, typename Compare, int KeysLimit, typename Allocator>
+template<typename Fn>
+void BlobBpTree<Key, Compare, KeysLimit, Allocator>::scan(const Key& lo, const Key& hi, Fn&& fn) const{
+	entries.scan(lo, hi, [&](const Key& k, const ValueHandle& handle){
+		return fn(k, handle.view());
+	});
+}
+
+template<typename Key, typename Compare, int KeysLimit, typename Allocator>
+void BlobBpTree<Key, Compare, KeysLimit, Allocator>::clear() noexcept{
+	entries.clear();
+	values.clear();
+}
+/*===================== End of BlobBpTree =========================================*/
+
+#endif
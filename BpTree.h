@@ -2,30 +2,1688 @@
 #define BPTREE_H
 
 #include "Node.h"
+#include "NodeAllocator.h"
+#include "BpTreeIterator.h"
+#include "BpTreeVersion.h"
+#include "Snapshot.h"
+#include "TreeStats.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <unistd.h>
+
+//B+ tree mapping Key to Value under Compare. KeysLimit is the maximum number of keys per node
+//and is fixed at compile time so node arrays and split points are constants.
+//Nodes are created and freed through Allocator (see NodeAllocator.h). Policy sets a separate leaf
+//capacity and the fill, split and merge thresholds (see NodePolicy in Node.h).
+template<typename Key, typename Value, typename Compare = std::less<Key>, int KeysLimit = 3,
+		typename Allocator = NewDeleteNodeAllocator, typename Policy = NodePolicy<>>
 class BpTree{
 	public:
+		typedef NodeTraits<Key, Value, Compare, KeysLimit, Policy> Traits;
+		typedef ::Node<Traits> Node;
+		typedef ::InteriorNode<Traits> InteriorNode;
+		typedef ::LeafNode<Traits> LeafNode;
+		typedef ::NodePath<Traits> NodePath;
+		typedef BpTreeIterator<Traits, false> iterator;
+		typedef BpTreeIterator<Traits, true> const_iterator;
+		typedef std::reverse_iterator<iterator> reverse_iterator;
+		typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+		typedef BpTreeVersion<Traits> Version;
+		static constexpr int keysLimit = KeysLimit;
+		static constexpr int leafKeysLimit = Traits::leafKeysLimit;
+		static constexpr int interiorKeysLimit = Traits::interiorKeysLimit;
+
 		BpTree();
-		BpTree(int);
+		explicit BpTree(const Allocator&);
 		BpTree(const BpTree&);
-		bool insert(int, const std::string&) noexcept;
-		bool remove(int) noexcept;
-		std::string find(int) const noexcept;
+		//Moving hands over the nodes, the allocator and any open versions without touching a node.
+		//The source is left without nodes: it can only be assigned to, cleared or destroyed.
+		BpTree(BpTree&&) noexcept;
+		bool insert(const Key&, const Value&) noexcept;
+		bool insert(Key&&, Value&&) noexcept;
+		//Insert a value built from args unless the key is present, in which case args are left untouched.
+		//Keys and values passed as rvalues are moved into the leaf. Returns whether the key was added.
+		template<typename... Args>
+		bool emplace(const Key&, Args&&...);
+		template<typename... Args>
+		bool emplace(Key&&, Args&&...);
+		//Insert the key with the value, or assign the value to the key if it is present, in one descent.
+		//Returns whether the key was added.
+		template<typename V>
+		bool upsert(const Key&, V&&);
+		template<typename V>
+		bool upsert(Key&&, V&&);
+		bool remove(const Key&) noexcept;
+		Value find(const Key&) const noexcept;
+		//The stored value of a key, or nullptr if it is absent, without copying it. The pointer is
+		//valid until the tree is next modified. A leaf shared with a version is copied first.
+		Value* findPtr(const Key&) noexcept;
+		const Value* findPtr(const Key&) const noexcept;
+		//Lookups by any type Compare orders against Key, when Compare is transparent (std::less<> for
+		//instance), so std::string keys can be probed with a std::string_view without building a string
+		template<typename K, typename C = Compare, typename = typename C::is_transparent>
+		Value find(const K&) const noexcept;
+		template<typename K, typename C = Compare, typename = typename C::is_transparent>
+		Value* findPtr(const K&) noexcept;
+		template<typename K, typename C = Compare, typename = typename C::is_transparent>
+		const Value* findPtr(const K&) const noexcept;
+		//Look up a batch of keys, setting results[i] to the value of keys[i] or nullptr if it is absent.
+		//Probes are sorted and descend a level at a time in groups, prefetching every child before it
+		//is searched, so the cache misses of a group overlap. Returns the number of keys found.
+		size_t findBatch(Span<const Key> keys, Span<Value*> results) noexcept;
+		size_t findBatch(Span<const Key> keys, Span<const Value*> results) const noexcept;
+		void clear() noexcept;
+		//Insert (key, value) pairs given in any order. The batch is sorted and each run of keys that
+		//lands in the same leaf is merged into it in one pass. A leaf that overflows is split into as
+		//many leaves as it needs at once, and its parent takes all of them together.
+		//Existing keys keep their value unless overwrite is set; within the batch the first value of a
+		//key wins. Returns the number of keys added. Pass move iterators to move the pairs in.
+		template<typename InputIt>
+		size_t insertBatch(InputIt, InputIt, bool overwrite = false);
+		//Remove keys given in any order, compacting each affected leaf once and rebalancing it once.
+		//Returns the number of keys removed.
+		template<typename InputIt>
+		size_t removeBatch(InputIt, InputIt);
+
+		//Ordered traversal over the leaf chain. Values can be written through iterators, so while a version is
+		//open the non-const overloads first copy every node the tree still shares with it.
+		iterator begin() noexcept;
+		iterator end() noexcept;
+		const_iterator begin() const noexcept;
+		const_iterator end() const noexcept;
+		reverse_iterator rbegin() noexcept{
+			return reverse_iterator(end());
+		}
+		reverse_iterator rend() noexcept{
+			return reverse_iterator(begin());
+		}
+		iterator lowerBound(const Key&) noexcept; //First key not less than the given key
+		iterator upperBound(const Key&) noexcept; //First key greater than the given key
+		std::pair<iterator, iterator> equalRange(const Key&) noexcept;
+		const_iterator lowerBound(const Key&) const noexcept;
+		const_iterator upperBound(const Key&) const noexcept;
+		std::pair<const_iterator, const_iterator> equalRange(const Key&) const noexcept;
+		//Call fn(key, value) for keys in [lo, hi) in ascending order. If fn returns bool, false stops the scan.
+		template<typename Fn>
+		void scan(const Key& lo, const Key& hi, Fn&& fn) const;
+		//Same as scan in descending order, following prevLeaf
+		template<typename Fn>
+		void reverseScan(const Key& lo, const Key& hi, Fn&& fn) const;
+		//Call fn(Span<const Key>, Span<const Value>) once per leaf for the keys in [lo, hi), so callers
+		//can process a leaf at a time. If fn returns bool, false stops the scan.
+		template<typename Fn>
+		void scanLeaves(const Key& lo, const Key& hi, Fn&& fn) const;
+		//Replace the contents with sorted (key, value) pairs, building full leaves left to right and
+		//the interior levels bottom-up in O(n). fillFactor is the share of each node to fill, so
+		//later inserts can land without splitting. Duplicate keys keep their first value.
+		//Returns false, leaving the tree empty, if the input is not sorted.
+		template<typename InputIt>
+		bool bulkLoad(InputIt, InputIt, double fillFactor = 1.0);
+		//Same as bulkLoad for random access input with strictly increasing keys. Leaves are
+		//filled and chained in runs on several threads, then the runs are stitched together.
+		template<typename RandomIt>
+		bool bulkLoadParallel(RandomIt, RandomIt, double fillFactor = 1.0, unsigned numThreads = std::thread::hardware_concurrency());
+		//Write the entries to path as a pointer-free snapshot (see Snapshot.h) that MappedBpTree serves in
+		//place. The file is written beside path and renamed over it, so a reader never maps a partial one.
+		//compressKeys stores integer keys frame-of-reference (see Snapshot.h); it is ignored for other keys.
+		//Returns false if the file cannot be written.
+		bool saveSnapshot(const char* path, bool compressKeys = false) const;
+		//Read-only view of the current contents in O(1) (see BpTreeVersion.h). The tree and the version share
+		//every node until the tree changes one, which it then copies along with its path from the root.
+		//Versions must be dropped before the tree is destroyed.
+		Version snapshot();
 		void printKeys() const noexcept;
 		void printValues() const noexcept;
-		std::unique_ptr<Node> deepCopy(Node*, Node*) noexcept;	
-		BpTree& operator=(const BpTree&) noexcept;	
-		LeafNode* findNodeOfKey(int) const noexcept; //Find the leaf node that contains the given key
-		~BpTree(){}
+		Node* deepCopy(Node*) noexcept;
+		BpTree& operator=(const BpTree&) noexcept;
+		BpTree& operator=(BpTree&&) noexcept; //Versions of the tree assigned to must be dropped first
+		template<typename K>
+		LeafNode* findNodeOfKey(const K&) const noexcept; //Find the leaf node that contains the given key
+		//Height, node count and fill distribution per level, plus split/redistribute/coalesce counts, descent
+		//depth and latency percentiles of find/insert/remove when built with BPTREE_STATS (see TreeStats.h).
+		//Walks every node.
+		TreeStats stats() const;
+		//Check the structural invariants: keys strictly ascending in every node and within the range its
+		//parent's separators route to it, node fill within [minimum, capacity] below the root, every
+		//leaf at the same depth, and the nextLeaf/prevLeaf chain visiting the leaves in key order.
+		//The rightmost node of each level, which appends split at its end, only needs one key.
+		//Each node is referenced once, or at least once while versions may share it.
+		//Returns false on the first violation and describes it in error if given.
+		//Walks every node.
+		bool validate(std::string* error = nullptr) const;
+		~BpTree();
 	private:
-		void insertLeafNode(LeafNode*, int, const std::string&); //Insert key and value into leaf node
-		void insertInteriorNode(InteriorNode*, int, std::unique_ptr<Node> ); //Insert key and pointer of next node into a interior node
+		template<typename K, typename MakeValue>
+		bool insertValue(K&&, MakeValue&&, bool);
+		template<typename K, typename V>
+		void insertLeafNode(LeafNode*, int, K&&, V&&, NodePath&); //Insert key and value into leaf node at the given position
+		void insertInteriorNode(NodePath&, Key&&, Node*, bool = false); //Insert key and pointer of next node into the interior node at the end of the path
+		template<typename K, typename V>
+		void appendToLeaf(LeafNode*, K&&, V&&);
+		LeafNode* lastLeaf() noexcept;
+		size_t mergeIntoLeaf(LeafNode*, std::pair<Key, Value>*, std::pair<Key, Value>*, bool, std::vector<std::pair<Key, Value>>&, NodePath&);
+		void insertChildren(std::vector<std::pair<Key, Node*>>&, NodePath&); //Add new right siblings of the node the path leads to, to its parent
+		template<typename K>
+		const Value* findValue(const K&) const noexcept;
+		template<typename K>
+		Value* findValueToWrite(const K&) noexcept;
+		template<typename K>
+		LeafNode* findLeaf(const K&, NodePath&) const noexcept;
+		LeafNode* findLeafAndFence(const Key&, const Key*&, NodePath&) const noexcept;
+		LeafNode* findRightmostLeaf(NodePath&) const noexcept;
+		void collapseRoot() noexcept;
 		void getAllLeafNodes(Node*, std::vector<LeafNode*>&) const noexcept;
+		bool validateSubtree(const Node*, bool, bool, const Key*, const Key*, int, int&, std::vector<const LeafNode*>&, std::string&) const;
 		void connectAllLeafs() noexcept;
-		int keysLimit;
-		std::unique_ptr<Node> root;
+		void destroySubtree(Node*) noexcept;
+		void releaseSubtree(Node*) noexcept;
+		void freeRetiredNodes(NodePath&) noexcept;
+		void reclaimVersions() noexcept;
+		Node* copyNode(Node*);
+		Node* unshareChild(InteriorNode*, int);
+		LeafNode* unsharePath(NodePath&, LeafNode*);
+		void unshareSiblings(const NodePath&, int);
+		void unshareAll();
+		void unshareSubtree(InteriorNode*);
+		void buildInteriorLevels(std::vector<Node*>&, std::vector<Key>&, double);
+		static int fillCount(double, int, int) noexcept;
+		static size_t planNodeCount(size_t, size_t, size_t, size_t) noexcept;
+		LeafNode* leftmostLeaf() const noexcept;
+		LeafNode* rightmostLeaf() const noexcept;
+		iterator makeIterator(LeafNode*, int) const noexcept;
+		template<typename Fn, typename... Args>
+		static bool invokeScanCallback(Fn&, Args&&...);
+		template<typename ValuePtr>
+		size_t findBatchInto(Span<const Key>, Span<ValuePtr>) const noexcept;
+		static void prefetchNode(const Node*) noexcept;
+		static constexpr int batchGroup = 16; //Probes descending together in findBatch
+		static constexpr size_t prefetchBytes = 1024; //Most of a node findBatch prefetches
+		static constexpr int sequentialRun = 4; //Appends in a row after which the rightmost nodes split at their end
+		Allocator alloc;
+		Node* root;
+		LeafNode* tail; //Rightmost leaf as last seen by an append, or nullptr; later splits may have put leaves after it
+		int appendRun; //Inserts in a row that were appends
+		std::shared_ptr<VersionQueue<Traits>> versions; //Created by the first snapshot()
+		bool mayShare; //Some node may still be shared with a version
+#ifdef BPTREE_STATS
+		mutable treestats::Counters counters;
+#endif
 
 };
 
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::BpTree() : BpTree(Allocator()){
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::BpTree(const Allocator& allocator) : alloc(allocator), tail(nullptr), appendRun(0), mayShare(false){
+	root = alloc.template create<LeafNode>();
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::~BpTree(){
+	reclaimVersions();
+	assert(!versions || versions->numOpen.load() == 0);
+	//An arena that frees all of its memory at once makes walking the nodes unnecessary,
+	//unless keys or values own resources of their own
+	if(Allocator::releasesAll && std::is_trivially_destructible<Key>::value && std::is_trivially_destructible<Value>::value)
+		return;
+	destroySubtree(root);
+}
+
+//Drop the tree's nodes from node down, before the tree is emptied or replaced
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+void BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::destroySubtree(Node* node) noexcept{
+	tail = nullptr;
+	mayShare = false;
+	releaseSubtree(node);
+}
+
+//Drop a reference to node. Unless a version still points at it, free it and release every node below it.
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+void BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::releaseSubtree(Node* node) noexcept{
+	if(!node || --node->refs > 0)
+		return;
+	if(node->isLeafNode()){
+		alloc.destroy(static_cast<LeafNode*>(node));
+		return;
+	}
+	auto interior = static_cast<InteriorNode*>(node);
+	for(int i = 0; i <= interior->numKeys; ++i)
+		releaseSubtree(interior->next[i]);
+	alloc.destroy(interior);
+}
+
+//Hand the nodes emptied by coalescing, collected on the path, back to the allocator
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+void BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::freeRetiredNodes(NodePath& path) noexcept{
+	for(int i = 0; i < path.numRetired; ++i){
+		Node* retired = path.retired[i];
+		if(retired == tail)
+			tail = nullptr;
+		if(retired->isLeafNode())
+			alloc.destroy(static_cast<LeafNode*>(retired));
+		else
+			alloc.destroy(static_cast<InteriorNode*>(retired));
+	}
+	path.numRetired = 0;
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+typename BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::Version BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::snapshot(){
+	if(!versions)
+		versions = std::make_shared<VersionQueue<Traits>>();
+	reclaimVersions();
+	++root->refs;
+	mayShare = true;
+	tail = nullptr; //The cached rightmost leaf is shared now and must be copied before the next append
+	return Version(root, versions);
+}
+
+//Release the roots of the versions dropped since the last call. Once no version is open, every node is
+//the tree's alone again. Called at the start of every modification.
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+void BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::reclaimVersions() noexcept{
+	if(!versions)
+		return;
+	bool anyOpen = versions->numOpen.load(std::memory_order_acquire) > 0;
+	if(versions->numDropped.load(std::memory_order_acquire) > 0){
+		std::vector<Node*> dropped;
+		{
+			std::lock_guard<std::mutex> lock(versions->mutex);
+			dropped.swap(versions->dropped);
+			versions->numDropped.store(0, std::memory_order_relaxed);
+		}
+		for(Node* node : dropped)
+			releaseSubtree(node);
+	}
+	if(!anyOpen)
+		mayShare = false;
+}
+
+//Copy of a node shared with a version, for the tree to change in its place. The copy takes over the
+//tree's reference to node and adds one to each of its children; a leaf copy also replaces node in the
+//leaf chain, which only ever links the tree's own leaves.
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+typename BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::Node* BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::copyNode(Node* node){
+	--node->refs;
+	if(node->isLeafNode()){
+		auto leaf = static_cast<LeafNode*>(node);
+		LeafNode* copy = alloc.template create<LeafNode>();
+		std::copy(leaf->keys.begin(), leaf->keys.begin() + leaf->numKeys, copy->keys.begin());
+		std::copy(leaf->vals.begin(), leaf->vals.begin() + leaf->numKeys, copy->vals.begin());
+		copy->numKeys = leaf->numKeys;
+		copy->prevLeaf = leaf->prevLeaf;
+		copy->nextLeaf = leaf->nextLeaf;
+		if(copy->prevLeaf)
+			copy->prevLeaf->nextLeaf = copy;
+		if(copy->nextLeaf)
+			copy->nextLeaf->prevLeaf = copy;
+		if(tail == leaf)
+			tail = copy;
+		return copy;
+	}
+	auto interior = static_cast<InteriorNode*>(node);
+	InteriorNode* copy = alloc.template create<InteriorNode>();
+	std::copy(interior->keys.begin(), interior->keys.begin() + interior->numKeys, copy->keys.begin());
+	std::copy(interior->next.begin(), interior->next.begin() + interior->numKeys + 1, copy->next.begin());
+	for(int i = 0; i <= interior->numKeys; ++i)
+		++copy->next[i]->refs;
+	copy->numKeys = interior->numKeys;
+	return copy;
+}
+
+//par->next[slot], replaced by a copy first if it is shared with a version
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+typename BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::Node* BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::unshareChild(InteriorNode* par, int slot){
+	if(par->next[slot]->refs > 1)
+		par->next[slot] = copyNode(par->next[slot]);
+	return par->next[slot];
+}
+
+//Make the nodes on path and leaf, where it leads, the tree's own before they are changed. Shared ones are
+//replaced by copies from the root down, since copying a node shares its children. Returns the leaf to change.
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+typename BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::LeafNode* BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::unsharePath(NodePath& path, LeafNode* leaf){
+	if(!mayShare)
+		return leaf;
+	if(root->refs > 1)
+		root = copyNode(root);
+	Node* cur = root;
+	for(int i = 0; i < path.depth; ++i){
+		path.steps[i].node = static_cast<InteriorNode*>(cur);
+		cur = unshareChild(path.steps[i].node, path.steps[i].slot);
+	}
+	return static_cast<LeafNode*>(cur);
+}
+
+//Make the siblings the rebalancing of a leaf left with numKeys keys may borrow from or merge with the
+//tree's own, at every level it can climb to. The path must already be unshared.
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+void BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::unshareSiblings(const NodePath& path, int numKeys){
+	bool underfull = numKeys < Traits::leafMergeKeys;
+	for(int i = path.depth - 1; mayShare && underfull && i >= 0; --i){
+		InteriorNode* par = path.steps[i].node;
+		const int slot = path.steps[i].slot;
+		if(slot > 0)
+			unshareChild(par, slot - 1);
+		if(slot < par->numKeys)
+			unshareChild(par, slot + 1);
+		underfull = par->numKeys < Traits::interiorMergeNext; //Short of its minimum if two children merge
+	}
+}
+
+//Copy every node still shared with a version
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+void BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::unshareAll(){
+	reclaimVersions();
+	if(!mayShare)
+		return;
+	if(root->refs > 1)
+		root = copyNode(root);
+	if(!root->isLeafNode())
+		unshareSubtree(static_cast<InteriorNode*>(root));
+	mayShare = false;
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+void BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::unshareSubtree(InteriorNode* node){
+	for(int i = 0; i <= node->numKeys; ++i){
+		Node* child = unshareChild(node, i);
+		if(!child->isLeafNode())
+			unshareSubtree(static_cast<InteriorNode*>(child));
+	}
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::BpTree(const BpTree& tree) : alloc(tree.alloc), tail(nullptr), appendRun(0), mayShare(false){
+
+	root = deepCopy(tree.root);
+	connectAllLeafs();
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::BpTree(BpTree&& tree) noexcept : alloc(std::move(tree.alloc)), root(tree.root), tail(tree.tail), appendRun(tree.appendRun),
+		versions(std::move(tree.versions)), mayShare(tree.mayShare){
+	tree.root = nullptr;
+	tree.tail = nullptr;
+	tree.mayShare = false;
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>& BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::operator= (const BpTree& tree) noexcept{
+	Node* copy = deepCopy(tree.root);
+	destroySubtree(root);
+	root = copy;
+	connectAllLeafs();
+	return *this;
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>& BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::operator= (BpTree&& tree) noexcept{
+	if(this == &tree)
+		return *this;
+	reclaimVersions();
+	assert(!versions || versions->numOpen.load() == 0);
+	//Drop the nodes before the allocator that holds them is replaced; as in the destructor, an arena
+	//frees them all at once
+	if(Allocator::releasesAll && std::is_trivially_destructible<Key>::value && std::is_trivially_destructible<Value>::value)
+		tail = nullptr;
+	else
+		destroySubtree(root);
+	alloc = std::move(tree.alloc);
+	root = tree.root;
+	tail = tree.tail;
+	appendRun = tree.appendRun;
+	versions = std::move(tree.versions);
+	mayShare = tree.mayShare;
+	tree.root = nullptr;
+	tree.tail = nullptr;
+	tree.mayShare = false;
+	return *this;
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+typename BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::Node* BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::deepCopy(Node* node) noexcept{
+	Node* copy;
+	if(node->isLeafNode()){
+		copy = alloc.template create<LeafNode>();
+		static_cast<LeafNode*>(copy)->keys = static_cast<LeafNode*>(node)->keys;
+		static_cast<LeafNode*>(copy)->vals = static_cast<LeafNode*>(node)->vals;
+	}else{
+		copy = alloc.template create<InteriorNode>();
+		InteriorNode* castedCopy = static_cast<InteriorNode*>(copy);
+		InteriorNode* castedNode = static_cast<InteriorNode*>(node);
+		castedCopy->keys = castedNode->keys;
+		for(int i = 0; i <= castedNode->numKeys; ++i){
+			castedCopy->next[i] = deepCopy(castedNode->next[i]);
+		}
+	}
+	copy->numKeys = node->numKeys;
+	return copy;
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+void BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::getAllLeafNodes(Node* cur, std::vector<LeafNode*>& leafNodes) const noexcept{
+	if(cur->isLeafNode())
+		leafNodes.push_back(static_cast<LeafNode*>(cur));
+	else{
+		InteriorNode* tmp = static_cast<InteriorNode*>(cur);
+		for(int i = 0; i <= tmp->numKeys; ++i){
+			getAllLeafNodes(tmp->next[i], leafNodes);
+		}
+	}
+
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+void BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::connectAllLeafs() noexcept{
+	std::vector<LeafNode*> leafNodes;
+	getAllLeafNodes(root, leafNodes);
+	if(leafNodes.size() > 0){
+		leafNodes.push_back(nullptr);
+		leafNodes.insert(leafNodes.begin(), nullptr);
+		for(size_t i = 1; i < leafNodes.size() - 1; ++i){
+			leafNodes[i]->nextLeaf = leafNodes[i+1];
+			leafNodes[i]->prevLeaf = leafNodes[i-1];
+		}
+	}
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+TreeStats BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::stats() const{
+	TreeStats result;
+	result.keysLimit = interiorKeysLimit;
+	result.leafKeysLimit = leafKeysLimit;
+	//Walk a level at a time from the root, then flip so levels[0] is the leaf level
+	std::vector<const Node*> level{root}, below;
+	while(!level.empty()){
+		TreeStats::Level counts;
+		below.clear();
+		for(const Node* node : level){
+			++counts.nodes;
+			counts.keys += node->numKeys;
+			++counts.fill[std::min(node->numKeys * treestats::fillBuckets / node->capacity(), treestats::fillBuckets - 1)];
+			if(!node->isLeafNode()){
+				auto interior = static_cast<const InteriorNode*>(node);
+				below.insert(below.end(), interior->next.begin(), interior->next.begin() + interior->numKeys + 1);
+			}
+		}
+		if(level.front()->isLeafNode()){
+			result.leafNodes = counts.nodes;
+			result.entries = counts.keys;
+		}else{
+			result.interiorNodes += counts.nodes;
+		}
+		result.levels.push_back(counts);
+		level.swap(below);
+	}
+	std::reverse(result.levels.begin(), result.levels.end());
+	result.height = result.levels.size();
+#ifdef BPTREE_STATS
+	result.addCounters(counters);
+#endif
+	return result;
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+bool BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::validate(std::string* error) const{
+	std::string message;
+	std::vector<const LeafNode*> leaves;
+	int leafDepth = -1;
+	bool valid = validateSubtree(root, true, true, nullptr, nullptr, 0, leafDepth, leaves, message);
+	for(size_t i = 0; valid && i < leaves.size(); ++i){
+		const LeafNode* prev = i > 0 ? leaves[i - 1] : nullptr;
+		const LeafNode* next = i + 1 < leaves.size() ? leaves[i + 1] : nullptr;
+		if(leaves[i]->prevLeaf != prev || leaves[i]->nextLeaf != next){
+			message = "leaf " + leaves[i]->keysToString() + " is linked out of key order";
+			valid = false;
+		}
+	}
+	if(!valid && error)
+		*error = message;
+	return valid;
+}
+
+//Check node and its subtree, whose keys must lie in [lo, hi) (an absent bound is open), collecting
+//the leaves in key order. rightmost is set for the last node of its level.
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+bool BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::validateSubtree(const Node* node, bool isRoot, bool rightmost, const Key* lo, const Key* hi,
+		int depth, int& leafDepth, std::vector<const LeafNode*>& leaves, std::string& error) const{
+	Compare less;
+	auto fail = [&](const char* what){
+		error = std::string(node->isLeafNode() ? "leaf " : "interior node ") + node->keysToString() + " at depth " + std::to_string(depth) + ": " + what;
+		return false;
+	};
+	if(node->numKeys < 0 || node->numKeys > node->capacity())
+		return fail("key count outside [0, capacity]");
+	if(node->refs < 1 || (!mayShare && node->refs != 1))
+		return fail("reference count does not match the tree and its versions");
+	const Key* keys = node->keyData();
+	for(int i = 1; i < node->numKeys; ++i){
+		if(!less(keys[i - 1], keys[i]))
+			return fail("keys are not strictly ascending");
+	}
+	if(node->numKeys > 0 && ((lo && less(keys[0], *lo)) || (hi && !less(keys[node->numKeys - 1], *hi))))
+		return fail("keys fall outside the range its parent's separators route to it");
+
+	if(node->isLeafNode()){
+		if(!isRoot && node->numKeys < (rightmost ? 1 : Traits::leafMergeKeys))
+			return fail("fewer keys than a non-root leaf may hold");
+		if(leafDepth == -1)
+			leafDepth = depth;
+		else if(depth != leafDepth)
+			return fail("leaves are not all at the same depth");
+		leaves.push_back(static_cast<const LeafNode*>(node));
+		return true;
+	}
+	if(node->numKeys == 0 || (!isRoot && !rightmost && node->numKeys + 1 < Traits::interiorMergeNext))
+		return fail("fewer children than an interior node may hold");
+	auto interior = static_cast<const InteriorNode*>(node);
+	for(int i = 0; i <= interior->numKeys; ++i){
+		const Node* child = interior->next[i];
+		if(!child)
+			return fail("missing child pointer");
+		if(!validateSubtree(child, false, rightmost && i == interior->numKeys, i > 0 ? &interior->keys[i - 1] : lo, i < interior->numKeys ? &interior->keys[i] : hi,
+				depth + 1, leafDepth, leaves, error))
+			return false;
+	}
+	return true;
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+template<typename K>
+typename BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::LeafNode* BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::findNodeOfKey(const K& k) const noexcept{
+	Node* cur = root;
+	int depth = 1;
+	while(cur != nullptr){
+		if(cur->isLeafNode()){
+			BPTREE_STATS_DEPTH(depth);
+			return static_cast<LeafNode*>(cur);
+		}
+		cur = static_cast<InteriorNode*>(cur)->getNextNode(k);
+		++depth;
+	}
+	return nullptr;
+
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+Value BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::find(const Key& k) const noexcept{
+	const Value* v = findValue(k);
+	return v ? *v : Value();
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+Value* BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::findPtr(const Key& k) noexcept{
+	return findValueToWrite(k);
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+const Value* BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::findPtr(const Key& k) const noexcept{
+	return findValue(k);
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+template<typename K, typename C, typename>
+Value BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::find(const K& k) const noexcept{
+	const Value* v = findValue(k);
+	return v ? *v : Value();
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+template<typename K, typename C, typename>
+Value* BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::findPtr(const K& k) noexcept{
+	return findValueToWrite(k);
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+template<typename K, typename C, typename>
+const Value* BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::findPtr(const K& k) const noexcept{
+	return findValue(k);
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+template<typename K>
+const Value* BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::findValue(const K& k) const noexcept{
+	BPTREE_STATS_SCOPE(treestats::findOp);
+	LeafNode* foundNode = findNodeOfKey(k);
+	if(!foundNode)
+		return nullptr;
+	int keyPos = foundNode->lowerBound(k);
+	if(!foundNode->keyAt(keyPos, k))
+		return nullptr;
+	return &foundNode->vals[keyPos];
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+template<typename K>
+Value* BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::findValueToWrite(const K& k) noexcept{
+	reclaimVersions();
+	if(!mayShare)
+		return const_cast<Value*>(findValue(k));
+	//The value may be written through the pointer, so its leaf must be the tree's own
+	BPTREE_STATS_SCOPE(treestats::findOp);
+	NodePath path;
+	LeafNode* leaf = findLeaf(k, path);
+	int keyPos = leaf->lowerBound(k);
+	if(!leaf->keyAt(keyPos, k))
+		return nullptr;
+	return &unsharePath(path, leaf)->vals[keyPos];
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+size_t BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::findBatch(Span<const Key> keys, Span<Value*> results) noexcept{
+	reclaimVersions();
+	if(mayShare){ //Every result may be written through, so each leaf found must be the tree's own
+		size_t n = std::min(keys.size(), results.size()), found = 0;
+		for(size_t i = 0; i < n; ++i)
+			found += (results[i] = findPtr(keys[i])) != nullptr;
+		return found;
+	}
+	return findBatchInto(keys, results);
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+size_t BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::findBatch(Span<const Key> keys, Span<const Value*> results) const noexcept{
+	return findBatchInto(keys, results);
+}
+
+//Fetch the header and keys of a node, which are all a search reads
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+void BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::prefetchNode(const Node* node) noexcept{
+	const char* begin = reinterpret_cast<const char*>(node);
+	const char* end = reinterpret_cast<const char*>(node->keyData() + node->capacity() + 1);
+	if(end > begin + prefetchBytes)
+		end = begin + prefetchBytes;
+	for(const char* p = begin; p < end; p += Traits::cacheLineSize)
+		__builtin_prefetch(p);
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+template<typename ValuePtr>
+size_t BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::findBatchInto(Span<const Key> keys, Span<ValuePtr> results) const noexcept{
+	size_t n = std::min(keys.size(), results.size());
+	//Sorted probes walk the tree left to right, so neighbours share the upper levels in cache
+	std::vector<uint32_t> order(n);
+	for(size_t i = 0; i < n; ++i)
+		order[i] = i;
+	std::sort(order.begin(), order.end(), [&keys](uint32_t a, uint32_t b){
+		return Node::keyLess(keys[a], keys[b]);
+	});
+
+	size_t found = 0;
+	const Node* cur[batchGroup];
+	for(size_t first = 0; first < n; first += batchGroup){
+		int count = std::min<size_t>(batchGroup, n - first);
+		const uint32_t* probes = order.data() + first;
+		for(int i = 0; i < count; ++i)
+			cur[i] = root;
+		//Every leaf is at the same depth, so the whole group reaches the leaves together
+		while(!cur[0]->isLeafNode()){
+			for(int i = 0; i < count; ++i){
+				cur[i] = static_cast<const InteriorNode*>(cur[i])->getNextNode(keys[probes[i]]);
+				prefetchNode(cur[i]);
+			}
+		}
+		for(int i = 0; i < count; ++i){
+			const LeafNode* leaf = static_cast<const LeafNode*>(cur[i]);
+			const Key& k = keys[probes[i]];
+			int pos = leaf->lowerBound(k);
+			if(leaf->keyAt(pos, k)){
+				results[probes[i]] = const_cast<Value*>(&leaf->vals[pos]);
+				++found;
+			}else{
+				results[probes[i]] = nullptr;
+			}
+		}
+	}
+	return found;
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+void BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::clear() noexcept{
+	destroySubtree(root);
+	root = alloc.template create<LeafNode>();
+}
+
+//Entries per node for a fill factor, kept between the node's minimum and maximum
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+int BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::fillCount(double fillFactor, int maxCount, int minCount) noexcept{
+	int count = (int)(fillFactor * maxCount + 0.5);
+	return std::min(std::max(count, minCount), maxCount);
+}
+
+//Number of nodes to spread n entries over evenly so that each gets about perNode entries and
+//none falls outside [minCount, maxCount]
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+size_t BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::planNodeCount(size_t n, size_t perNode, size_t minCount, size_t maxCount) noexcept{
+	size_t count = (n + perNode - 1) / perNode;
+	size_t fewest = (n + maxCount - 1) / maxCount;
+	size_t most = std::max<size_t>(1, n / minCount);
+	return std::max(std::min(std::max(count, fewest), most), fewest);
+}
+
+//Build the interior levels on top of a level of nodes whose smallest keys are in lows, then set root
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+void BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::buildInteriorLevels(std::vector<Node*>& level, std::vector<Key>& lows, double fillFactor){
+	const int perNode = fillCount(fillFactor, interiorKeysLimit + 1, Traits::interiorMinNext);
+	while(level.size() > 1){
+		size_t numChildren = level.size();
+		size_t numNodes = planNodeCount(numChildren, perNode, Traits::interiorMinNext, interiorKeysLimit + 1);
+		std::vector<Node*> upperLevel;
+		std::vector<Key> upperLows;
+		upperLevel.reserve(numNodes);
+		upperLows.reserve(numNodes);
+		size_t pos = 0;
+		for(size_t i = 0; i < numNodes; ++i){
+			int count = numChildren / numNodes + (i < numChildren % numNodes);
+			InteriorNode* node = alloc.template create<InteriorNode>();
+			for(int j = 0; j < count; ++j){
+				Node* child = level[pos + j];
+				node->next[j] = child;
+				if(j > 0)
+					node->keys[j - 1] = std::move(lows[pos + j]);
+			}
+			node->numKeys = count - 1;
+			upperLevel.push_back(node);
+			upperLows.push_back(std::move(lows[pos]));
+			pos += count;
+		}
+		level.swap(upperLevel);
+		lows.swap(upperLows);
+	}
+	root = level.front();
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+template<typename InputIt>
+bool BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::bulkLoad(InputIt first, InputIt last, double fillFactor){
+	destroySubtree(root);
+	const int perLeaf = fillCount(fillFactor, leafKeysLimit, Traits::leafMinKeys);
+	std::vector<Node*> level;
+	std::vector<Key> lows;
+	LeafNode* leaf = nullptr;
+	for(; first != last; ++first){
+		const Key& k = first->first;
+		if(leaf){
+			const Key& lastKey = leaf->keys[leaf->numKeys - 1];
+			if(Node::keyLess(k, lastKey)){ //Unsorted input
+				for(auto node : level)
+					alloc.destroy(static_cast<LeafNode*>(node));
+				root = alloc.template create<LeafNode>();
+				return false;
+			}
+			if(!Node::keyLess(lastKey, k)) //Duplicated key
+				continue;
+		}
+		if(!leaf || leaf->numKeys == perLeaf){
+			LeafNode* newLeaf = alloc.template create<LeafNode>();
+			newLeaf->prevLeaf = leaf;
+			if(leaf)
+				leaf->nextLeaf = newLeaf;
+			lows.push_back(leaf ? Traits::separator(leaf->keys[leaf->numKeys - 1], k) : k);
+			leaf = newLeaf;
+			level.push_back(leaf);
+		}
+		leaf->keys[leaf->numKeys] = k;
+		leaf->vals[leaf->numKeys] = first->second;
+		++leaf->numKeys;
+	}
+	if(level.empty()){
+		root = alloc.template create<LeafNode>();
+		return true;
+	}
+
+	//The last leaf may be underfull: merge it into its left neighbour or even the two out
+	if(level.size() > 1 && leaf->numKeys < Traits::leafMinKeys){
+		LeafNode* prev = leaf->prevLeaf;
+		int total = prev->numKeys + leaf->numKeys;
+		if(total <= leafKeysLimit){
+			std::move(leaf->keys.begin(), leaf->keys.begin() + leaf->numKeys, prev->keys.begin() + prev->numKeys);
+			std::move(leaf->vals.begin(), leaf->vals.begin() + leaf->numKeys, prev->vals.begin() + prev->numKeys);
+			prev->numKeys = total;
+			prev->nextLeaf = nullptr;
+			alloc.destroy(leaf);
+			level.pop_back();
+			lows.pop_back();
+		}else{
+			int moved = prev->numKeys - (total - total / 2);
+			std::move_backward(leaf->keys.begin(), leaf->keys.begin() + leaf->numKeys, leaf->keys.begin() + leaf->numKeys + moved);
+			std::move_backward(leaf->vals.begin(), leaf->vals.begin() + leaf->numKeys, leaf->vals.begin() + leaf->numKeys + moved);
+			std::move(prev->keys.begin() + prev->numKeys - moved, prev->keys.begin() + prev->numKeys, leaf->keys.begin());
+			std::move(prev->vals.begin() + prev->numKeys - moved, prev->vals.begin() + prev->numKeys, leaf->vals.begin());
+			prev->numKeys -= moved;
+			leaf->numKeys += moved;
+			lows.back() = Traits::separator(prev->keys[prev->numKeys - 1], leaf->keys[0]);
+		}
+	}
+	buildInteriorLevels(level, lows, fillFactor);
+	return true;
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+template<typename RandomIt>
+bool BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::bulkLoadParallel(RandomIt first, RandomIt last, double fillFactor, unsigned numThreads){
+	destroySubtree(root);
+	const size_t n = last - first;
+	if(n == 0){
+		root = alloc.template create<LeafNode>();
+		return true;
+	}
+	const size_t numLeaves = planNodeCount(n, fillCount(fillFactor, leafKeysLimit, Traits::leafMinKeys), Traits::leafMinKeys, leafKeysLimit);
+	std::vector<Node*> level(numLeaves);
+	std::vector<Key> lows(numLeaves);
+	//The allocator is not thread safe, so leaves are allocated up front and only filled in parallel
+	for(auto& leaf : level)
+		leaf = alloc.template create<LeafNode>();
+
+	std::atomic<bool> sorted(true);
+	auto fillRun = [&](size_t beginLeaf, size_t endLeaf){
+		for(size_t i = beginLeaf; i < endLeaf; ++i){
+			LeafNode* leaf = static_cast<LeafNode*>(level[i]);
+			size_t begin = i * (n / numLeaves) + std::min(i, n % numLeaves);
+			int count = n / numLeaves + (i < n % numLeaves);
+			for(int j = 0; j < count; ++j){
+				auto& entry = first[begin + j];
+				if(begin + j > 0 && !Node::keyLess(first[begin + j - 1].first, entry.first))
+					sorted.store(false, std::memory_order_relaxed);
+				leaf->keys[j] = entry.first;
+				leaf->vals[j] = entry.second;
+			}
+			leaf->numKeys = count;
+			lows[i] = begin > 0 ? Traits::separator(first[begin - 1].first, leaf->keys[0]) : leaf->keys[0];
+			if(i > beginLeaf){
+				leaf->prevLeaf = static_cast<LeafNode*>(level[i - 1]);
+				leaf->prevLeaf->nextLeaf = leaf;
+			}
+		}
+	};
+
+	numThreads = std::max(1u, std::min<unsigned>(numThreads, numLeaves));
+	std::vector<std::thread> workers;
+	std::vector<size_t> runBegins;
+	for(unsigned t = 0; t < numThreads; ++t){
+		size_t beginLeaf = numLeaves * t / numThreads;
+		size_t endLeaf = numLeaves * (t + 1) / numThreads;
+		runBegins.push_back(beginLeaf);
+		if(t + 1 == numThreads)
+			fillRun(beginLeaf, endLeaf);
+		else
+			workers.emplace_back(fillRun, beginLeaf, endLeaf);
+	}
+	for(auto& worker : workers)
+		worker.join();
+
+	if(!sorted){
+		for(auto node : level)
+			alloc.destroy(static_cast<LeafNode*>(node));
+		root = alloc.template create<LeafNode>();
+		return false;
+	}
+	//Stitch the runs into one leaf chain
+	for(size_t i = 1; i < runBegins.size(); ++i){
+		LeafNode* runHead = static_cast<LeafNode*>(level[runBegins[i]]);
+		runHead->prevLeaf = static_cast<LeafNode*>(level[runBegins[i] - 1]);
+		runHead->prevLeaf->nextLeaf = runHead;
+	}
+	buildInteriorLevels(level, lows, fillFactor);
+	return true;
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+typename BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::LeafNode* BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::leftmostLeaf() const noexcept{
+	Node* cur = root;
+	while(!cur->isLeafNode())
+		cur = static_cast<InteriorNode*>(cur)->next[0];
+	return static_cast<LeafNode*>(cur);
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+typename BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::LeafNode* BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::rightmostLeaf() const noexcept{
+	Node* cur = root;
+	while(!cur->isLeafNode())
+		cur = static_cast<InteriorNode*>(cur)->next[cur->numKeys];
+	return static_cast<LeafNode*>(cur);
+}
+
+//Iterator for position pos of leaf, moving to the next leaf when pos is past its last key
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+typename BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::iterator BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::makeIterator(LeafNode* leaf, int pos) const noexcept{
+	if(pos == leaf->numKeys && leaf->nextLeaf)
+		return iterator(leaf->nextLeaf, 0);
+	return iterator(leaf, pos);
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+typename BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::iterator BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::begin() noexcept{
+	unshareAll();
+	return iterator(leftmostLeaf(), 0);
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+typename BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::iterator BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::end() noexcept{
+	unshareAll();
+	LeafNode* last = rightmostLeaf();
+	return iterator(last, last->numKeys);
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+typename BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::const_iterator BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::begin() const noexcept{
+	return const_iterator(leftmostLeaf(), 0);
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+typename BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::const_iterator BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::end() const noexcept{
+	LeafNode* last = rightmostLeaf();
+	return const_iterator(last, last->numKeys);
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+typename BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::iterator BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::lowerBound(const Key& k) noexcept{
+	unshareAll();
+	LeafNode* leaf = findNodeOfKey(k);
+	return makeIterator(leaf, leaf->lowerBound(k));
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+typename BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::iterator BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::upperBound(const Key& k) noexcept{
+	unshareAll();
+	LeafNode* leaf = findNodeOfKey(k);
+	return makeIterator(leaf, leaf->upperBound(k));
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+std::pair<typename BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::iterator, typename BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::iterator> BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::equalRange(const Key& k) noexcept{
+	unshareAll();
+	LeafNode* leaf = findNodeOfKey(k);
+	int pos = leaf->lowerBound(k);
+	return std::make_pair(makeIterator(leaf, pos), makeIterator(leaf, leaf->keyAt(pos, k) ? pos + 1 : pos));
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+typename BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::const_iterator BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::lowerBound(const Key& k) const noexcept{
+	LeafNode* leaf = findNodeOfKey(k);
+	return makeIterator(leaf, leaf->lowerBound(k));
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+typename BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::const_iterator BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::upperBound(const Key& k) const noexcept{
+	LeafNode* leaf = findNodeOfKey(k);
+	return makeIterator(leaf, leaf->upperBound(k));
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+std::pair<typename BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::const_iterator, typename BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::const_iterator> BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::equalRange(const Key& k) const noexcept{
+	LeafNode* leaf = findNodeOfKey(k);
+	int pos = leaf->lowerBound(k);
+	return std::make_pair(const_iterator(makeIterator(leaf, pos)), const_iterator(makeIterator(leaf, leaf->keyAt(pos, k) ? pos + 1 : pos)));
+}
+
+//Run a scan callback, treating callbacks that return nothing as "keep going"
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+template<typename Fn, typename... Args>
+bool BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::invokeScanCallback(Fn& fn, Args&&... args){
+	if constexpr(std::is_void<decltype(fn(std::forward<Args>(args)...))>::value){
+		fn(std::forward<Args>(args)...);
+		return true;
+	}else{
+		return static_cast<bool>(fn(std::forward<Args>(args)...));
+	}
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+template<typename Fn>
+void BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::scan(const Key& lo, const Key& hi, Fn&& fn) const{
+	LeafNode* leaf = findNodeOfKey(lo);
+	int pos = leaf->lowerBound(lo);
+	while(leaf){
+		for(; pos < leaf->numKeys; ++pos){
+			if(!Node::keyLess(leaf->keys[pos], hi))
+				return;
+			if(!invokeScanCallback(fn, static_cast<const Key&>(leaf->keys[pos]), static_cast<const Value&>(leaf->vals[pos])))
+				return;
+		}
+		leaf = leaf->nextLeaf;
+		pos = 0;
+	}
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+template<typename Fn>
+void BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::reverseScan(const Key& lo, const Key& hi, Fn&& fn) const{
+	LeafNode* leaf = findNodeOfKey(hi);
+	int pos = leaf->lowerBound(hi) - 1;
+	while(leaf){
+		for(; pos >= 0; --pos){
+			if(Node::keyLess(leaf->keys[pos], lo))
+				return;
+			if(!invokeScanCallback(fn, static_cast<const Key&>(leaf->keys[pos]), static_cast<const Value&>(leaf->vals[pos])))
+				return;
+		}
+		leaf = leaf->prevLeaf;
+		if(leaf)
+			pos = leaf->numKeys - 1;
+	}
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+template<typename Fn>
+void BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::scanLeaves(const Key& lo, const Key& hi, Fn&& fn) const{
+	LeafNode* leaf = findNodeOfKey(lo);
+	int begin = leaf->lowerBound(lo);
+	while(leaf){
+		//Only the last leaf of the range needs a search for hi
+		int end = leaf->numKeys;
+		bool last = end > 0 && !Node::keyLess(leaf->keys[end - 1], hi);
+		if(last)
+			end = leaf->lowerBound(hi);
+		if(end > begin){
+			Span<const Key> keys = {leaf->keys.data() + begin, (size_t)(end - begin)};
+			Span<const Value> vals = {leaf->vals.data() + begin, (size_t)(end - begin)};
+			if(!invokeScanCallback(fn, keys, vals))
+				return;
+		}
+		if(last)
+			return;
+		leaf = leaf->nextLeaf;
+		begin = 0;
+	}
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+void BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::printKeys() const noexcept{
+	std::vector<Node*> nodeList;
+	nodeList.push_back(root);
+	while(!nodeList.empty()){
+		std::vector<Node*> tmp;
+		//Loop through each node
+		for(auto& node : nodeList){
+			std::string out = node->keysToString();
+			std::cout << out << " ";
+			if(node->isLeafNode()) continue;
+			auto castedNode = static_cast<InteriorNode*>(node);
+			//Push all the next node into the list to process in next loop
+			for(int i = 0; i <= castedNode->numKeys; ++i){
+				if(castedNode->next[i] != nullptr)
+					tmp.push_back(castedNode->next[i]);
+			}
+
+		}
+		std::cout << "\n";
+		//Update the node list for next loop
+		nodeList = std::move(tmp);
+	}
+
+
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+void BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::printValues() const noexcept{
+	Node* currentNode = root;
+
+	//while leaftMostLeafNode is still interiornode
+	while(currentNode && !currentNode->isLeafNode()){
+		currentNode = static_cast<InteriorNode*>(currentNode)->next[0];
+	}
+
+	std::ostringstream out;
+	LeafNode* leftMostLeafNode = static_cast<LeafNode*>(currentNode);
+	//Loop through all leaf nodes by following the nextLeaf pointer of each leaf node
+	while(leftMostLeafNode){
+		for(int i = 0; i < leftMostLeafNode->numKeys; ++i){
+			out << leftMostLeafNode->vals[i] << "\n";
+		}
+		leftMostLeafNode = leftMostLeafNode->nextLeaf;
+	}
+	std::cout << out.str();
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+bool BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::saveSnapshot(const char* path, bool compressKeys) const{
+	static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+			"Snapshots store keys and values as raw bytes");
+	const uint32_t blockKeys = snapshot::blockKeys<Key>();
+
+	//Index level 0 takes every blockKeys-th key of the leaf chain, each level above every blockKeys-th of the one below
+	size_t numEntries = 0;
+	std::vector<std::vector<Key>> levels(1);
+	for(LeafNode* leaf = leftmostLeaf(); leaf; leaf = leaf->nextLeaf){
+		for(int i = 0; i < leaf->numKeys; ++i, ++numEntries){
+			if(numEntries % blockKeys == 0)
+				levels[0].push_back(leaf->keys[i]);
+		}
+	}
+	//Frame-of-reference keys: a descriptor per block, then each block's differences from its first key
+	std::vector<char> packedKeys;
+	if constexpr(snapshot::isCompressible<Key, Compare>()){
+		typedef typename std::make_unsigned<Key>::type Delta;
+		if(compressKeys && numEntries > 0){
+			const size_t numBlocks = levels[0].size();
+			std::vector<uint64_t> descriptors(numBlocks);
+			uint64_t offset = numBlocks * sizeof(uint64_t);
+			size_t pos = 0;
+			for(LeafNode* leaf = leftmostLeaf(); leaf; leaf = leaf->nextLeaf){
+				for(int i = 0; i < leaf->numKeys; ++i, ++pos){
+					size_t block = pos / blockKeys;
+					bool lastInBlock = pos % blockKeys == blockKeys - 1 || pos == numEntries - 1;
+					if(!lastInBlock)
+						continue;
+					//Keys are sorted, so the block's last key has its largest difference
+					uint32_t widthLog2 = snapshot::deltaWidthLog2((Delta)leaf->keys[i] - (Delta)levels[0][block]);
+					offset = (offset + (1u << widthLog2) - 1) >> widthLog2 << widthLog2;
+					descriptors[block] = offset << 2 | widthLog2;
+					offset += (pos % blockKeys + 1) << widthLog2;
+				}
+			}
+			packedKeys.resize(offset);
+			std::memcpy(packedKeys.data(), descriptors.data(), numBlocks * sizeof(uint64_t));
+			pos = 0;
+			for(LeafNode* leaf = leftmostLeaf(); leaf; leaf = leaf->nextLeaf){
+				for(int i = 0; i < leaf->numKeys; ++i, ++pos){
+					size_t block = pos / blockKeys;
+					uint32_t widthLog2 = descriptors[block] & 3;
+					uint64_t delta = (Delta)leaf->keys[i] - (Delta)levels[0][block];
+					char* at = packedKeys.data() + (descriptors[block] >> 2) + ((pos % blockKeys) << widthLog2);
+					switch(widthLog2){
+						case 0: *reinterpret_cast<uint8_t*>(at) = delta; break;
+						case 1: *reinterpret_cast<uint16_t*>(at) = delta; break;
+						case 2: *reinterpret_cast<uint32_t*>(at) = delta; break;
+						default: *reinterpret_cast<uint64_t*>(at) = delta; break;
+					}
+				}
+			}
+		}
+	}
+	if(numEntries == 0)
+		levels.clear();
+	while(!levels.empty() && levels.back().size() > blockKeys){
+		std::vector<Key> upper;
+		for(size_t i = 0; i < levels.back().size(); i += blockKeys)
+			upper.push_back(levels.back()[i]);
+		levels.push_back(std::move(upper));
+	}
+	if(levels.size() > (size_t)snapshot::maxLevels)
+		return false;
+
+	snapshot::Header header = {};
+	header.magic = snapshot::magic;
+	header.formatVersion = snapshot::formatVersion;
+	header.keyBytes = sizeof(Key);
+	header.valueBytes = sizeof(Value);
+	header.blockKeys = blockKeys;
+	header.numLevels = levels.size();
+	header.numEntries = numEntries;
+	header.flags = packedKeys.empty() ? 0 : snapshot::compressedKeys;
+	uint64_t offset = snapshot::alignSection(sizeof(header));
+	header.keysOffset = offset;
+	offset = snapshot::alignSection(offset + (packedKeys.empty() ? numEntries * sizeof(Key) : packedKeys.size()));
+	header.valsOffset = offset;
+	offset = snapshot::alignSection(offset + numEntries * sizeof(Value));
+	for(size_t l = 0; l < levels.size(); ++l){
+		header.levelOffsets[l] = offset;
+		header.levelCounts[l] = levels[l].size();
+		offset = snapshot::alignSection(offset + levels[l].size() * sizeof(Key));
+	}
+	header.fileBytes = offset;
+
+	std::string tmpPath = std::string(path) + ".tmp";
+	FILE* out = fopen(tmpPath.c_str(), "wb");
+	if(!out)
+		return false;
+	uint64_t written = 0;
+	auto write = [&](const void* data, size_t bytes){
+		written += fwrite(data, 1, bytes, out);
+	};
+	auto padTo = [&](uint64_t target){
+		static const char zeros[snapshot::sectionAlignment] = {};
+		while(written < target && !ferror(out))
+			write(zeros, std::min<uint64_t>(target - written, sizeof(zeros)));
+	};
+	write(&header, sizeof(header));
+	padTo(header.keysOffset);
+	if(!packedKeys.empty())
+		write(packedKeys.data(), packedKeys.size());
+	else{
+		for(LeafNode* leaf = leftmostLeaf(); leaf; leaf = leaf->nextLeaf)
+			write(leaf->keys.data(), leaf->numKeys * sizeof(Key));
+	}
+	padTo(header.valsOffset);
+	for(LeafNode* leaf = leftmostLeaf(); leaf; leaf = leaf->nextLeaf)
+		write(leaf->vals.data(), leaf->numKeys * sizeof(Value));
+	for(size_t l = 0; l < levels.size(); ++l){
+		padTo(header.levelOffsets[l]);
+		write(levels[l].data(), levels[l].size() * sizeof(Key));
+	}
+	padTo(header.fileBytes);
+
+	bool ok = written == header.fileBytes && fflush(out) == 0 && fsync(fileno(out)) == 0;
+	ok = fclose(out) == 0 && ok;
+	if(!ok || rename(tmpPath.c_str(), path) != 0){
+		std::remove(tmpPath.c_str()); //Not BpTree::remove
+		return false;
+	}
+	return true;
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+bool BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::insert(const Key& k, const Value& v) noexcept{
+	return insertValue(k, [&v]() -> const Value&{ return v; }, false);
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+bool BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::insert(Key&& k, Value&& v) noexcept{
+	return insertValue(std::move(k), [&v]() -> Value&&{ return std::move(v); }, false);
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+template<typename... Args>
+bool BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::emplace(const Key& k, Args&&... args){
+	return insertValue(k, [&args...]{ return Value(std::forward<Args>(args)...); }, false);
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+template<typename... Args>
+bool BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::emplace(Key&& k, Args&&... args){
+	return insertValue(std::move(k), [&args...]{ return Value(std::forward<Args>(args)...); }, false);
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+template<typename V>
+bool BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::upsert(const Key& k, V&& v){
+	return insertValue(k, [&v]() -> V&&{ return std::forward<V>(v); }, true);
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+template<typename V>
+bool BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::upsert(Key&& k, V&& v){
+	return insertValue(std::move(k), [&v]() -> V&&{ return std::forward<V>(v); }, true);
+}
+
+//Shared by the inserts: add k with the value makeValue() returns, or if k is present and assign is set,
+//assign that value to it. makeValue is only called once the slot is known, and its result is forwarded
+//into the leaf, so rvalues are moved and nothing is built for a key that is kept.
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+template<typename K, typename MakeValue>
+bool BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::insertValue(K&& k, MakeValue&& makeValue, bool assign){
+	BPTREE_STATS_SCOPE(treestats::insertOp);
+	reclaimVersions();
+	//A key above every stored key belongs to the rightmost leaf, so it is appended without a descent
+	LeafNode* last = lastLeaf();
+	if(last->numKeys > 0 && Node::keyLess(last->keys[last->numKeys - 1], k)){
+		++appendRun;
+		appendToLeaf(last, std::forward<K>(k), makeValue());
+		return true;
+	}
+	appendRun = 0;
+	NodePath path;
+	LeafNode* node = findLeaf(k, path);
+	int keyPos = node->lowerBound(k);
+	if(node->keyAt(keyPos, k)){ //Duplicated key
+		if(assign)
+			unsharePath(path, node)->vals[keyPos] = makeValue();
+		return false;
+	}
+	node = unsharePath(path, node);
+	insertLeafNode(node, keyPos, std::forward<K>(k), makeValue(), path);
+	return true;
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+template<typename K, typename V>
+void BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::insertLeafNode(LeafNode* node, int keyPos, K&& k, V&& v, NodePath& path){
+
+	node->insertKey(keyPos, std::forward<K>(k), std::forward<V>(v));
+
+  // Limit is not exceeded, so no more work to do
+	if(!node->isLimitExceeded()){
+		return;
+	}
+
+  // Need to do some split work
+	LeafNode* rightNode = alloc.template create<LeafNode>();
+
+	Key newKeyInsertedKeyInParent = node->split(rightNode);
+
+	insertInteriorNode(path, std::move(newKeyInsertedKeyInParent), rightNode);
+
+}
+
+//Rightmost leaf, following the leaf chain from the cached one past any leaves split off since.
+//The path to a newly cached leaf is unshared, so appends can change it and its parents in place.
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+typename BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::LeafNode* BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::lastLeaf() noexcept{
+	if(!tail){
+		NodePath path;
+		tail = unsharePath(path, findRightmostLeaf(path));
+	}
+	while(tail->nextLeaf)
+		tail = tail->nextLeaf;
+	return tail;
+}
+
+//Append to the rightmost leaf. Only an overflow needs the rightmost path, which is rebuilt from the root.
+//During a run of appends the leaf splits at its end, leaving it full and starting the new leaf with one
+//key, and so do the interior nodes above it; keys arriving in order then fill every node.
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+template<typename K, typename V>
+void BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::appendToLeaf(LeafNode* leaf, K&& k, V&& v){
+	leaf->insertKey(leaf->numKeys, std::forward<K>(k), std::forward<V>(v));
+	if(!leaf->isLimitExceeded())
+		return;
+	NodePath path;
+	findRightmostLeaf(path);
+	const bool sequential = appendRun >= sequentialRun;
+	LeafNode* rightNode = alloc.template create<LeafNode>();
+	Key separator = leaf->split(rightNode, sequential ? leafKeysLimit : Traits::leafRemainingKeys);
+	tail = rightNode;
+	insertInteriorNode(path, std::move(separator), rightNode, sequential);
+}
+
+//The path ends at the parent of the node that was split, or is empty if that node was the root.
+//sequential splits an overflowing node at its end (see appendToLeaf).
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+void BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::insertInteriorNode(NodePath& path, Key&& k, Node* newNode, bool sequential){
+
+	if(path.empty()){ //Split node is root
+		InteriorNode* newRoot = alloc.template create<InteriorNode>(root);
+		newRoot->insertKey(0, std::move(k), newNode);
+		root = newRoot;
+		return;
+	}
+
+	auto step = path.pop();
+	InteriorNode* node = step.node;
+	node->insertKey(step.slot, std::move(k), newNode);
+
+
+	if(!node->isLimitExceeded()){
+		return ;
+	}
+
+
+	InteriorNode* splitNode = alloc.template create<InteriorNode>();
+
+
+	Key removedKey = node->split(splitNode, sequential ? interiorKeysLimit - 1 : Traits::interiorRemainingKeys);
+
+	insertInteriorNode(path, std::move(removedKey), splitNode, sequential);
+
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+bool BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::remove(const Key& k) noexcept{
+	BPTREE_STATS_SCOPE(treestats::removeOp);
+	reclaimVersions();
+	NodePath path;
+	LeafNode* node = findLeaf(k, path);
+	int keyPos = node->lowerBound(k);
+	if(!node->keyAt(keyPos, k))
+		return false;
+	node = unsharePath(path, node);
+	unshareSiblings(path, node->numKeys - 1);
+	node->removeKey(keyPos, path);
+	freeRetiredNodes(path);
+	collapseRoot();
+	return true;
+}
+
+//Coalescing may leave the root with a single next node, which becomes the new root
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+void BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::collapseRoot() noexcept{
+	while(!root->isLeafNode() && root->numKeys == 0){
+		InteriorNode* oldRoot = static_cast<InteriorNode*>(root);
+		root = oldRoot->next[0];
+		oldRoot->cleanNode();
+		alloc.destroy(oldRoot);
+	}
+}
+
+//Descend to the leaf for k, recording each interior node and the slot taken in path
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+template<typename K>
+typename BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::LeafNode* BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::findLeaf(const K& k, NodePath& path) const noexcept{
+	Node* cur = root;
+	while(!cur->isLeafNode()){
+		InteriorNode* interior = static_cast<InteriorNode*>(cur);
+		int slot = interior->upperBound(k);
+		path.push(interior, slot);
+		cur = interior->next[slot];
+	}
+	BPTREE_STATS_DEPTH(path.depth + 1);
+	return static_cast<LeafNode*>(cur);
+}
+
+//Same as findLeaf, also setting fence to the smallest separator above k on the path, so every key
+//less than it belongs to the same leaf, or to nullptr if the leaf is the rightmost one
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+typename BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::LeafNode* BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::findLeafAndFence(const Key& k, const Key*& fence, NodePath& path) const noexcept{
+	fence = nullptr;
+	Node* cur = root;
+	while(!cur->isLeafNode()){
+		InteriorNode* interior = static_cast<InteriorNode*>(cur);
+		int slot = interior->upperBound(k);
+		if(slot < interior->numKeys)
+			fence = &interior->keys[slot];
+		path.push(interior, slot);
+		cur = interior->next[slot];
+	}
+	return static_cast<LeafNode*>(cur);
+}
+
+//Descend along the last next pointers to the rightmost leaf, recording the path
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+typename BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::LeafNode* BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::findRightmostLeaf(NodePath& path) const noexcept{
+	Node* cur = root;
+	while(!cur->isLeafNode()){
+		InteriorNode* interior = static_cast<InteriorNode*>(cur);
+		path.push(interior, interior->numKeys);
+		cur = interior->next[interior->numKeys];
+	}
+	return static_cast<LeafNode*>(cur);
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+template<typename InputIt>
+size_t BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::insertBatch(InputIt first, InputIt last, bool overwrite){
+	BPTREE_STATS_SCOPE(-1);
+	reclaimVersions();
+	std::vector<std::pair<Key, Value>> entries(first, last);
+	auto keyLess = [](const std::pair<Key, Value>& a, const std::pair<Key, Value>& b){
+		return Node::keyLess(a.first, b.first);
+	};
+	std::stable_sort(entries.begin(), entries.end(), keyLess);
+	entries.erase(std::unique(entries.begin(), entries.end(), [](const std::pair<Key, Value>& a, const std::pair<Key, Value>& b){
+		return !Node::keyLess(a.first, b.first);
+	}), entries.end());
+
+	std::vector<std::pair<Key, Value>> merged;
+	size_t added = 0;
+	auto run = entries.data(), end = entries.data() + entries.size();
+	while(run != end){
+		const Key* fence;
+		NodePath path;
+		LeafNode* leaf = findLeafAndFence(run->first, fence, path);
+		auto runEnd = fence ? std::partition_point(run, end, [fence](const std::pair<Key, Value>& e){
+			return Node::keyLess(e.first, *fence);
+		}) : end;
+		leaf = unsharePath(path, leaf);
+		added += mergeIntoLeaf(leaf, run, runEnd, overwrite, merged, path);
+		run = runEnd;
+	}
+	return added;
+}
+
+//Merge the sorted entries [run, runEnd), which all belong to leaf, into it, moving them out. If the result
+//does not fit, it is spread evenly over the leaf and as many new leaves as needed. path is the descent to
+//leaf. Returns the keys added.
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+size_t BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::mergeIntoLeaf(LeafNode* leaf, std::pair<Key, Value>* run, std::pair<Key, Value>* runEnd, bool overwrite, std::vector<std::pair<Key, Value>>& merged, NodePath& path){
+	merged.clear();
+	size_t added = 0;
+	int i = 0;
+	while(i < leaf->numKeys || run != runEnd){
+		if(run == runEnd || (i < leaf->numKeys && Node::keyLess(leaf->keys[i], run->first))){
+			merged.emplace_back(std::move(leaf->keys[i]), std::move(leaf->vals[i]));
+			++i;
+		}else if(i == leaf->numKeys || Node::keyLess(run->first, leaf->keys[i])){
+			merged.push_back(std::move(*run++));
+			++added;
+		}else{ //Existing key
+			merged.emplace_back(std::move(leaf->keys[i]), overwrite ? std::move(run->second) : std::move(leaf->vals[i]));
+			++i;
+			++run;
+		}
+	}
+
+	const size_t total = merged.size();
+	const size_t numLeaves = total <= (size_t)leafKeysLimit ? 1 : planNodeCount(total, leafKeysLimit, Traits::leafMinKeys, leafKeysLimit);
+	BPTREE_STATS_EVENT(treestats::leafSplit, numLeaves - 1);
+	std::vector<std::pair<Key, Node*>> newLeaves;
+	LeafNode* cur = leaf;
+	size_t pos = 0;
+	for(size_t l = 0; l < numLeaves; ++l){
+		int count = total / numLeaves + (l < total % numLeaves);
+		if(l > 0){
+			LeafNode* newLeaf = alloc.template create<LeafNode>();
+			newLeaf->prevLeaf = cur;
+			newLeaf->nextLeaf = cur->nextLeaf;
+			if(cur->nextLeaf)
+				cur->nextLeaf->prevLeaf = newLeaf;
+			cur->nextLeaf = newLeaf;
+			newLeaves.emplace_back(Traits::separator(cur->keys[cur->numKeys - 1], merged[pos].first), newLeaf);
+			cur = newLeaf;
+		}
+		for(int j = 0; j < count; ++j){
+			cur->keys[j] = std::move(merged[pos + j].first);
+			cur->vals[j] = std::move(merged[pos + j].second);
+		}
+		cur->numKeys = count;
+		pos += count;
+	}
+	if(!newLeaves.empty())
+		insertChildren(newLeaves, path);
+	return added;
+}
+
+//Insert (separator, node) pairs, all belonging right after the node the path leads to, into that
+//node's parent in one pass. An overflowing parent is spread over as many interior nodes as needed,
+//whose own new siblings are then passed up the same way.
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+void BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::insertChildren(std::vector<std::pair<Key, Node*>>& entries, NodePath& path){
+	if(path.empty()){ //The node is root
+		root = alloc.template create<InteriorNode>(root);
+		path.push(static_cast<InteriorNode*>(root), 0);
+	}
+	const auto step = path.pop();
+	InteriorNode* par = step.node;
+	const int slot = step.slot;
+	const int m = entries.size();
+
+	if(par->numKeys + m <= interiorKeysLimit){
+		std::move_backward(par->keys.begin() + slot, par->keys.begin() + par->numKeys, par->keys.begin() + par->numKeys + m);
+		std::move_backward(par->next.begin() + slot + 1, par->next.begin() + par->numKeys + 1, par->next.begin() + par->numKeys + m + 1);
+		for(int j = 0; j < m; ++j){
+			par->keys[slot + j] = std::move(entries[j].first);
+			par->next[slot + 1 + j] = entries[j].second;
+		}
+		par->numKeys += m;
+		return;
+	}
+
+	//keys[t] separates children[t] and children[t + 1]
+	std::vector<Key> keys;
+	std::vector<Node*> children;
+	keys.reserve(par->numKeys + m);
+	children.reserve(par->numKeys + m + 1);
+	std::move(par->keys.begin(), par->keys.begin() + slot, std::back_inserter(keys));
+	std::copy(par->next.begin(), par->next.begin() + slot + 1, std::back_inserter(children));
+	for(auto& entry : entries){
+		keys.push_back(std::move(entry.first));
+		children.push_back(entry.second);
+	}
+	std::move(par->keys.begin() + slot, par->keys.begin() + par->numKeys, std::back_inserter(keys));
+	std::copy(par->next.begin() + slot + 1, par->next.begin() + par->numKeys + 1, std::back_inserter(children));
+
+	const size_t numChildren = children.size();
+	const size_t numNodes = planNodeCount(numChildren, interiorKeysLimit + 1, Traits::interiorMinNext, interiorKeysLimit + 1);
+	BPTREE_STATS_EVENT(treestats::interiorSplit, numNodes - 1);
+	std::vector<std::pair<Key, Node*>> newNodes;
+	par->next.fill(nullptr);
+	size_t pos = 0;
+	for(size_t i = 0; i < numNodes; ++i){
+		int count = numChildren / numNodes + (i < numChildren % numNodes);
+		InteriorNode* node = i == 0 ? par : alloc.template create<InteriorNode>();
+		for(int j = 0; j < count; ++j){
+			node->next[j] = children[pos + j];
+			if(j > 0)
+				node->keys[j - 1] = std::move(keys[pos + j - 1]);
+		}
+		node->numKeys = count - 1;
+		if(i > 0)
+			newNodes.emplace_back(std::move(keys[pos - 1]), node);
+		pos += count;
+	}
+	insertChildren(newNodes, path);
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Policy>
+template<typename InputIt>
+size_t BpTree<Key, Value, Compare, KeysLimit, Allocator, Policy>::removeBatch(InputIt first, InputIt last){
+	BPTREE_STATS_SCOPE(-1);
+	reclaimVersions();
+	std::vector<Key> keys(first, last);
+	std::sort(keys.begin(), keys.end(), Node::keyLess);
+	keys.erase(std::unique(keys.begin(), keys.end(), [](const Key& a, const Key& b){
+		return !Node::keyLess(a, b);
+	}), keys.end());
+
+	size_t removed = 0;
+	auto run = keys.begin();
+	while(run != keys.end()){
+		const Key* fence;
+		NodePath path;
+		LeafNode* leaf = findLeafAndFence(*run, fence, path);
+		auto runEnd = fence ? std::partition_point(run, keys.end(), [fence](const Key& k){
+			return Node::keyLess(k, *fence);
+		}) : keys.end();
+		leaf = unsharePath(path, leaf);
+
+		//Compact the leaf, dropping every key of the run it holds
+		int kept = 0;
+		for(int i = 0; i < leaf->numKeys; ++i){
+			while(run != runEnd && Node::keyLess(*run, leaf->keys[i]))
+				++run;
+			if(run != runEnd && !Node::keyLess(leaf->keys[i], *run)){
+				++run;
+				continue;
+			}
+			if(kept != i){
+				leaf->keys[kept] = std::move(leaf->keys[i]);
+				leaf->vals[kept] = std::move(leaf->vals[i]);
+			}
+			++kept;
+		}
+		run = runEnd;
+		if(kept == leaf->numKeys)
+			continue;
+		removed += leaf->numKeys - kept;
+		leaf->numKeys = kept;
+		unshareSiblings(path, kept);
+		leaf->rebalance(path);
+		freeRetiredNodes(path);
+	}
+	collapseRoot();
+	return removed;
+}
+
 
 #endif
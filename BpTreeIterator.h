@@ -0,0 +1,110 @@
+#ifndef BPTREE_ITERATOR_H
+#define BPTREE_ITERATOR_H
+
+#include "Node.h"
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+//Contiguous run of elements inside one leaf, handed out by BpTree::scanLeaves
+template<typename T>
+struct Span{
+	T* ptr;
+	size_t len;
+
+	T* begin() const noexcept{
+		return ptr;
+	}
+	T* end() const noexcept{
+		return ptr + len;
+	}
+	size_t size() const noexcept{
+		return len;
+	}
+	bool empty() const noexcept{
+		return len == 0;
+	}
+	T& operator[](size_t i) const noexcept{
+		return ptr[i];
+	}
+};
+
+//Bidirectional iterator over the leaf chain. It is a (leaf, position) pair: incrementing past the
+//last key of a leaf follows nextLeaf, decrementing before the first key follows prevLeaf.
+//end() is one past the last key of the rightmost leaf, so --end() is valid.
+//Any insert or remove invalidates every iterator.
+template<typename Traits, bool IsConst>
+class BpTreeIterator{
+	public:
+		typedef typename Traits::KeyType Key;
+		typedef typename Traits::ValueType Value;
+		typedef typename std::conditional<IsConst, const Value, Value>::type MappedType;
+		typedef typename std::conditional<IsConst, const LeafNode<Traits>, LeafNode<Traits>>::type Leaf;
+
+		typedef std::bidirectional_iterator_tag iterator_category;
+		typedef std::pair<const Key&, MappedType&> value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef value_type reference;
+		typedef void pointer;
+
+		BpTreeIterator() noexcept : leaf(nullptr), pos(0){
+		}
+		BpTreeIterator(Leaf* l, int p) noexcept : leaf(l), pos(p){
+		}
+		//Iterators convert to const iterators
+		template<bool OtherConst, typename = typename std::enable_if<IsConst && !OtherConst>::type>
+		BpTreeIterator(const BpTreeIterator<Traits, OtherConst>& other) noexcept : leaf(other.leaf), pos(other.pos){
+		}
+
+		const Key& key() const noexcept{
+			return leaf->keys[pos];
+		}
+		MappedType& value() const noexcept{
+			return leaf->vals[pos];
+		}
+		reference operator*() const noexcept{
+			return reference(leaf->keys[pos], leaf->vals[pos]);
+		}
+
+		BpTreeIterator& operator++() noexcept{
+			if(++pos == leaf->numKeys && leaf->nextLeaf){
+				leaf = leaf->nextLeaf;
+				pos = 0;
+			}
+			return *this;
+		}
+		BpTreeIterator operator++(int) noexcept{
+			BpTreeIterator tmp = *this;
+			++*this;
+			return tmp;
+		}
+		BpTreeIterator& operator--() noexcept{
+			if(pos == 0 && leaf->prevLeaf){
+				leaf = leaf->prevLeaf;
+				pos = leaf->numKeys;
+			}
+			--pos;
+			return *this;
+		}
+		BpTreeIterator operator--(int) noexcept{
+			BpTreeIterator tmp = *this;
+			--*this;
+			return tmp;
+		}
+
+		bool operator==(const BpTreeIterator& other) const noexcept{
+			return leaf == other.leaf && pos == other.pos;
+		}
+		bool operator!=(const BpTreeIterator& other) const noexcept{
+			return !(*this == other);
+		}
+
+		template<typename, bool> friend class BpTreeIterator;
+		template<typename, typename, typename, int, typename, typename> friend class BpTree;
+	private:
+		Leaf* leaf;
+		int pos;
+};
+
+#endif
@@ -0,0 +1,195 @@
+#ifndef BPTREE_VERSION_H
+#define BPTREE_VERSION_H
+
+#include "Node.h"
+#include "BpTreeIterator.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+//Multiversioning by path copying. BpTree::snapshot() hands out the current root as a read-only version
+//in O(1), and from then on the tree and the version share every node. Each node counts the parents and
+//versions pointing at it in refs; before the tree changes a node whose count is above one it copies it,
+//and the copy's parent, up to the root, so nothing a version can reach is ever written.
+//Only the tree's thread touches refs: a dropped version queues its root here and the tree releases it,
+//freeing the nodes no one else points at, on its next modification.
+template<typename Traits>
+struct VersionQueue{
+	std::mutex mutex;
+	std::vector<Node<Traits>*> dropped; //Roots of versions no longer referenced
+	std::atomic<size_t> numDropped{0};
+	std::atomic<size_t> numOpen{0}; //Versions handed out and not yet dropped
+};
+
+//Read-only view of a BpTree as it was when BpTree::snapshot() returned it. Copies are cheap and share the
+//view, which is released when the last copy is destroyed. Versions can be read and destroyed on any thread
+//while the tree keeps changing, without locks, but must not outlive the tree.
+//The leaf chain only links the tree's current leaves, so scans descend from the root instead of following it.
+template<typename Traits>
+class BpTreeVersion{
+	public:
+		typedef typename Traits::KeyType Key;
+		typedef typename Traits::ValueType Value;
+
+		Value find(const Key&) const noexcept;
+		//The stored value of a key, or nullptr if it is absent. Valid as long as the version is.
+		const Value* findPtr(const Key&) const noexcept;
+		bool empty() const noexcept;
+		//Call fn(key, value) for keys in [lo, hi) in ascending order. If fn returns bool, false stops the scan.
+		template<typename Fn>
+		void scan(const Key& lo, const Key& hi, Fn&& fn) const;
+		//Call fn(Span<const Key>, Span<const Value>) once per leaf for the keys in [lo, hi)
+		template<typename Fn>
+		void scanLeaves(const Key& lo, const Key& hi, Fn&& fn) const;
+		//Same as scan over every key
+		template<typename Fn>
+		void forEach(Fn&& fn) const;
+
+		template<typename, typename, typename, int, typename, typename> friend class BpTree;
+	private:
+		typedef ::Node<Traits> Node;
+		typedef ::InteriorNode<Traits> InteriorNode;
+		typedef ::LeafNode<Traits> LeafNode;
+
+		//Shared by all copies of a version; queues the root for the tree once the last one is gone
+		struct Root{
+			Node* node;
+			std::shared_ptr<VersionQueue<Traits>> queue;
+
+			Root(Node* n, std::shared_ptr<VersionQueue<Traits>> q) noexcept : node(n), queue(std::move(q)){
+			}
+			~Root();
+		};
+
+		BpTreeVersion(Node*, const std::shared_ptr<VersionQueue<Traits>>&);
+		const LeafNode* findLeaf(const Key&) const noexcept;
+		template<typename Fn>
+		bool scanSubtree(const Node*, const Key*, const Key*, Fn&) const;
+		template<typename Fn>
+		void scanEntries(const Key*, const Key*, Fn&) const;
+		template<typename Fn, typename... Args>
+		static bool invokeScanCallback(Fn&, Args&&...);
+
+		std::shared_ptr<const Root> root;
+};
+
+/*==================== BpTreeVersion implementation ==========================*/
+template<typename Traits>
+BpTreeVersion<Traits>::Root::~Root(){
+	{
+		std::lock_guard<std::mutex> lock(queue->mutex);
+		queue->dropped.push_back(node);
+		queue->numDropped.fetch_add(1, std::memory_order_release);
+	}
+	queue->numOpen.fetch_sub(1, std::memory_order_release);
+}
+
+template<typename Traits>
+BpTreeVersion<Traits>::BpTreeVersion(Node* node, const std::shared_ptr<VersionQueue<Traits>>& queue)
+	: root(std::make_shared<const Root>(node, queue)){
+	queue->numOpen.fetch_add(1, std::memory_order_relaxed);
+}
+
+template<typename Traits>
+const typename BpTreeVersion<Traits>::LeafNode* BpTreeVersion<Traits>::findLeaf(const Key& k) const noexcept{
+	const Node* cur = root->node;
+	while(!cur->isLeafNode())
+		cur = static_cast<const InteriorNode*>(cur)->getNextNode(k);
+	return static_cast<const LeafNode*>(cur);
+}
+
+template<typename Traits>
+typename BpTreeVersion<Traits>::Value BpTreeVersion<Traits>::find(const Key& k) const noexcept{
+	const Value* v = findPtr(k);
+	return v ? *v : Value();
+}
+
+template<typename Traits>
+const typename BpTreeVersion<Traits>::Value* BpTreeVersion<Traits>::findPtr(const Key& k) const noexcept{
+	const LeafNode* leaf = findLeaf(k);
+	int pos = leaf->lowerBound(k);
+	return leaf->keyAt(pos, k) ? &leaf->vals[pos] : nullptr;
+}
+
+template<typename Traits>
+bool BpTreeVersion<Traits>::empty() const noexcept{
+	return root->node->isLeafNode() && root->node->numKeys == 0;
+}
+
+//Run a scan callback, treating callbacks that return nothing as "keep going"
+template<typename Traits>
+template<typename Fn, typename... Args>
+bool BpTreeVersion<Traits>::invokeScanCallback(Fn& fn, Args&&... args){
+	if constexpr(std::is_void<decltype(fn(std::forward<Args>(args)...))>::value){
+		fn(std::forward<Args>(args)...);
+		return true;
+	}else{
+		return static_cast<bool>(fn(std::forward<Args>(args)...));
+	}
+}
+
+//Pass the leaves of node's subtree holding keys in [lo, hi) to fn (see scanLeaves); an absent bound is open.
+//Returns false once fn asked to stop or the range is exhausted.
+template<typename Traits>
+template<typename Fn>
+bool BpTreeVersion<Traits>::scanSubtree(const Node* node, const Key* lo, const Key* hi, Fn& fn) const{
+	if(!node->isLeafNode()){
+		auto interior = static_cast<const InteriorNode*>(node);
+		for(int i = lo ? interior->upperBound(*lo) : 0; i <= interior->numKeys; ++i){
+			//Keys under next[i] are not less than keys[i - 1]
+			if(i > 0 && hi && !Node::keyLess(interior->keys[i - 1], *hi))
+				return false;
+			if(!scanSubtree(interior->next[i], lo, hi, fn))
+				return false;
+		}
+		return true;
+	}
+	auto leaf = static_cast<const LeafNode*>(node);
+	int begin = lo ? leaf->lowerBound(*lo) : 0;
+	int end = hi ? leaf->lowerBound(*hi) : leaf->numKeys;
+	if(end > begin){
+		Span<const Key> keys = {leaf->keys.data() + begin, (size_t)(end - begin)};
+		Span<const Value> vals = {leaf->vals.data() + begin, (size_t)(end - begin)};
+		if(!invokeScanCallback(fn, keys, vals))
+			return false;
+	}
+	return end == leaf->numKeys;
+}
+
+template<typename Traits>
+template<typename Fn>
+void BpTreeVersion<Traits>::scanLeaves(const Key& lo, const Key& hi, Fn&& fn) const{
+	scanSubtree(root->node, &lo, &hi, fn);
+}
+
+//Call fn(key, value) for the keys in [lo, hi), a leaf at a time
+template<typename Traits>
+template<typename Fn>
+void BpTreeVersion<Traits>::scanEntries(const Key* lo, const Key* hi, Fn& fn) const{
+	auto perLeaf = [&fn](Span<const Key> keys, Span<const Value> vals){
+		for(size_t i = 0; i < keys.size(); ++i){
+			if(!invokeScanCallback(fn, keys[i], vals[i]))
+				return false;
+		}
+		return true;
+	};
+	scanSubtree(root->node, lo, hi, perLeaf);
+}
+
+template<typename Traits>
+template<typename Fn>
+void BpTreeVersion<Traits>::scan(const Key& lo, const Key& hi, Fn&& fn) const{
+	scanEntries(&lo, &hi, fn);
+}
+
+template<typename Traits>
+template<typename Fn>
+void BpTreeVersion<Traits>::forEach(Fn&& fn) const{
+	scanEntries(nullptr, nullptr, fn);
+}
+/*===================== End of BpTreeVersion =========================================*/
+
+#endif
@@ -0,0 +1,432 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include "AsyncIo.h"
+#include<algorithm>
+#include<cassert>
+#include<cerrno>
+#include<cstddef>
+#include<cstdint>
+#include<cstdlib>
+#include<cstring>
+#include<stdexcept>
+#include<system_error>
+#include<unordered_map>
+#include<utility>
+#include<vector>
+#include<fcntl.h>
+#include<sys/stat.h>
+#include<unistd.h>
+
+//Fixed-size page cache over one file. Pages are read with pread into a fixed set of frames and
+//written back with pwrite when a dirty frame is evicted or on flush(). Victims are chosen with the
+//CLOCK algorithm: every access sets a frame's reference bit and the hand clears bits until it finds
+//an unreferenced, unpinned frame. Pinned frames are never evicted, so a pointer returned by pin()
+//stays valid until the matching unpin().
+//With an AsyncIo attached, pinAsync() and prefetch() read pages without blocking, and dirty frames are
+//written back in batches: flush() submits them all at once and evicting a dirty frame also cleans the
+//next writeBackBatch - 1 dirty, unpinned frames the hand will reach.
+//I/O failures throw std::system_error; running out of unpinned frames throws std::runtime_error.
+class BufferPool{
+	public:
+		typedef uint64_t PageId;
+		static constexpr size_t pageSize = 4096;
+		static constexpr size_t defaultFrames = 1024;
+		static constexpr size_t writeBackBatch = 32;
+
+		//Waits for a page read by pinAsync. resume gets the page pinned for the waiter, or nullptr if the
+		//read failed or the pool was closed first.
+		struct PageWaiter{
+			void (*resume)(PageWaiter*, char* page);
+			PageWaiter* next;
+		};
+
+		explicit BufferPool(size_t numFrames = defaultFrames);
+		BufferPool(const BufferPool&) = delete;
+		BufferPool& operator=(const BufferPool&) = delete;
+		~BufferPool(); //Writes back dirty pages and closes the file
+
+		//Opens or creates path; false if it cannot be opened. directIo bypasses the kernel's page cache
+		//(O_DIRECT), which tmpfs and some other file systems refuse.
+		bool open(const char* path, bool directIo = false);
+		void close();
+		bool isOpen() const noexcept{
+			return fd >= 0;
+		}
+		PageId pageCount() const noexcept{
+			return numPages;
+		}
+
+		char* pin(PageId); //Page contents, valid until unpin
+		void unpin(PageId, bool dirty) noexcept;
+		char* allocatePage(PageId&); //Append a zeroed page to the file and pin it
+		void flush(); //Write back every dirty page and sync the file
+
+		//Attach the AsyncIo used by pinAsync, prefetch and batched write-back while no read is in flight.
+		//nullptr goes back to pread and pwrite only.
+		void setAsyncIo(AsyncIo*) noexcept;
+		//A resident page pinned, as pin() returns it. Otherwise starts reading the page, or joins a read
+		//already under way, and returns nullptr; waiter is resumed from poll() or wait(), never from
+		//inside the pool, so resume may pin pages itself.
+		char* pinAsync(PageId, PageWaiter*);
+		void prefetch(PageId); //Start reading a page that is not resident, without pinning it
+		size_t poll(); //Resume the waiters whose pages arrived; returns how many were resumed
+		size_t wait(); //Block until a page read finishes unless none is in flight, then poll()
+		size_t readsInFlight() const noexcept{
+			return numLoading;
+		}
+
+		size_t hits() const noexcept{
+			return numHits;
+		}
+		size_t misses() const noexcept{
+			return numMisses;
+		}
+	private:
+		struct Frame{
+			PageId page;
+			int pinCount;
+			bool dirty;
+			bool referenced;
+			bool used;
+			bool loading = false; //Being read by pinAsync or prefetch, which hold one pin
+			PageWaiter* waiters = nullptr;
+		};
+		struct Load{ //Context of a frame's read callback
+			BufferPool* pool;
+			size_t frame;
+		};
+		struct WriteBatch{
+			size_t pending;
+			int error;
+		};
+		size_t findVictim();
+		char* frameData(size_t frame) noexcept{
+			return data + frame * pageSize;
+		}
+		void writeFrame(size_t);
+		void writeFrames(const std::vector<size_t>&);
+		void writeBack(size_t victim);
+		size_t startLoad(PageId);
+		void finishLoad(size_t, bool ok);
+		static void pageRead(void*, ssize_t);
+		static void pageWritten(void*, ssize_t);
+
+		int fd;
+		PageId numPages;
+		char* data; //numFrames pages, page aligned
+		std::vector<Frame> frames;
+		std::unordered_map<PageId, size_t> pageTable; //Resident page -> frame
+		size_t clockHand;
+		size_t numHits;
+		size_t numMisses;
+		AsyncIo* io;
+		std::vector<Load> loads;
+		std::vector<std::pair<PageWaiter*, char*>> ready; //Waiters to resume, with their pinned pages
+		size_t numLoading;
+};
+
+//Pins a page for the lifetime of the object
+class PageRef{
+	public:
+		PageRef(BufferPool& p, BufferPool::PageId id) : pool(&p), page(id), bytes(p.pin(id)), dirty(false){
+		}
+		//Adopts a pin already taken, e.g. by allocatePage
+		PageRef(BufferPool& p, BufferPool::PageId id, char* pinned) noexcept : pool(&p), page(id), bytes(pinned), dirty(false){
+		}
+		PageRef(const PageRef&) = delete;
+		PageRef& operator=(const PageRef&) = delete;
+		PageRef(PageRef&& other) noexcept : pool(other.pool), page(other.page), bytes(other.bytes), dirty(other.dirty){
+			other.pool = nullptr;
+		}
+		~PageRef(){
+			if(pool)
+				pool->unpin(page, dirty);
+		}
+		char* data() const noexcept{
+			return bytes;
+		}
+		BufferPool::PageId id() const noexcept{
+			return page;
+		}
+		void markDirty() noexcept{
+			dirty = true;
+		}
+	private:
+		BufferPool* pool;
+		BufferPool::PageId page;
+		char* bytes;
+		bool dirty;
+};
+
+/*==================== BufferPool implementation ==========================*/
+inline BufferPool::BufferPool(size_t numFrames)
+	: fd(-1), numPages(0), frames(numFrames, Frame{0, 0, false, false, false}), clockHand(0), numHits(0), numMisses(0),
+	io(nullptr), numLoading(0){
+	data = static_cast<char*>(std::aligned_alloc(pageSize, numFrames * pageSize));
+	if(!data)
+		throw std::bad_alloc();
+	for(size_t i = 0; i < numFrames; ++i)
+		loads.push_back(Load{this, i});
+}
+
+inline BufferPool::~BufferPool(){
+	try{
+		close();
+	}catch(...){
+		//Nothing can be reported from a destructor; call close() first to see write-back errors
+	}
+	std::free(data);
+}
+
+inline bool BufferPool::open(const char* path, bool directIo){
+	close();
+	fd = ::open(path, O_RDWR | O_CREAT | (directIo ? O_DIRECT : 0), 0644);
+	if(fd < 0)
+		return false;
+	struct stat st;
+	if(fstat(fd, &st) != 0){
+		::close(fd);
+		fd = -1;
+		return false;
+	}
+	numPages = st.st_size / pageSize;
+	return true;
+}
+
+inline void BufferPool::close(){
+	if(fd < 0)
+		return;
+	//Finish the reads still using the file and let their waiters know the pages are gone
+	if(io)
+		io->drain();
+	for(auto& waiting : ready)
+		waiting.first->resume(waiting.first, nullptr);
+	ready.clear();
+	flush();
+	::close(fd);
+	fd = -1;
+	numPages = 0;
+	pageTable.clear();
+	for(auto& frame : frames)
+		frame = Frame{0, 0, false, false, false};
+}
+
+inline void BufferPool::writeFrame(size_t i){
+	if(pwrite(fd, frameData(i), pageSize, frames[i].page * pageSize) != (ssize_t)pageSize)
+		throw std::system_error(errno, std::generic_category(), "BufferPool: pwrite");
+	frames[i].dirty = false;
+}
+
+inline void BufferPool::pageWritten(void* context, ssize_t result){
+	WriteBatch* batch = static_cast<WriteBatch*>(context);
+	if(result != (ssize_t)pageSize && !batch->error)
+		batch->error = result < 0 ? -result : EIO;
+	--batch->pending;
+}
+
+//Write the given frames through io and wait for all of them. On failure they all stay dirty.
+inline void BufferPool::writeFrames(const std::vector<size_t>& batchFrames){
+	WriteBatch batch{0, 0};
+	for(size_t i : batchFrames){
+		++batch.pending;
+		io->write(fd, frameData(i), pageSize, frames[i].page * pageSize, &BufferPool::pageWritten, &batch);
+	}
+	while(batch.pending > 0)
+		io->wait();
+	if(batch.error)
+		throw std::system_error(batch.error, std::generic_category(), "BufferPool: write-back");
+	for(size_t i : batchFrames)
+		frames[i].dirty = false;
+}
+
+//Clean the victim together with the dirty, unpinned frames the hand reaches next, so later evictions
+//find clean frames and the writes go out in one submission
+inline void BufferPool::writeBack(size_t victim){
+	std::vector<size_t> batchFrames{victim};
+	for(size_t step = 1; step < frames.size() && batchFrames.size() < writeBackBatch; ++step){
+		size_t i = (victim + step) % frames.size();
+		const Frame& frame = frames[i];
+		if(frame.used && frame.dirty && frame.pinCount == 0)
+			batchFrames.push_back(i);
+	}
+	writeFrames(batchFrames);
+}
+
+//Sweep the clock hand until an unpinned frame without its reference bit comes up. Two full turns
+//clear every bit, so finding nothing by then means every frame is pinned.
+inline size_t BufferPool::findVictim(){
+	for(size_t step = 0; step < 2 * frames.size(); ++step){
+		size_t i = clockHand;
+		clockHand = (clockHand + 1) % frames.size();
+		Frame& frame = frames[i];
+		if(!frame.used)
+			return i;
+		if(frame.pinCount > 0)
+			continue;
+		if(frame.referenced){
+			frame.referenced = false;
+			continue;
+		}
+		if(frame.dirty){
+			if(io)
+				writeBack(i);
+			else
+				writeFrame(i);
+		}
+		pageTable.erase(frame.page);
+		frame.used = false;
+		return i;
+	}
+	throw std::runtime_error("BufferPool: every frame is pinned");
+}
+
+inline char* BufferPool::pin(PageId page){
+	for(auto found = pageTable.find(page); found != pageTable.end(); found = pageTable.find(page)){
+		Frame& frame = frames[found->second];
+		if(frame.loading){ //Wait for the read under way; if it fails the page is read again below
+			io->wait();
+			continue;
+		}
+		++frame.pinCount;
+		frame.referenced = true;
+		++numHits;
+		return frameData(found->second);
+	}
+	++numMisses;
+	size_t i = findVictim();
+	if(pread(fd, frameData(i), pageSize, page * pageSize) != (ssize_t)pageSize)
+		throw std::system_error(errno ? errno : EIO, std::generic_category(), "BufferPool: pread");
+	frames[i] = Frame{page, 1, false, true, true};
+	pageTable.emplace(page, i);
+	return frameData(i);
+}
+
+inline void BufferPool::unpin(PageId page, bool dirty) noexcept{
+	Frame& frame = frames[pageTable.find(page)->second];
+	--frame.pinCount;
+	frame.dirty = frame.dirty || dirty;
+}
+
+inline char* BufferPool::allocatePage(PageId& page){
+	size_t i = findVictim();
+	page = numPages++;
+	std::memset(frameData(i), 0, pageSize);
+	//Dirty from the start, so the file is extended when the page is first written back
+	frames[i] = Frame{page, 1, true, true, true};
+	pageTable.emplace(page, i);
+	return frameData(i);
+}
+
+inline void BufferPool::flush(){
+	if(fd < 0)
+		return;
+	if(io){
+		std::vector<size_t> dirtyFrames;
+		for(size_t i = 0; i < frames.size(); ++i){
+			if(frames[i].used && frames[i].dirty)
+				dirtyFrames.push_back(i);
+		}
+		std::sort(dirtyFrames.begin(), dirtyFrames.end(), [this](size_t a, size_t b){
+			return frames[a].page < frames[b].page;
+		});
+		writeFrames(dirtyFrames);
+	}else{
+		for(size_t i = 0; i < frames.size(); ++i){
+			if(frames[i].used && frames[i].dirty)
+				writeFrame(i);
+		}
+	}
+	if(fdatasync(fd) != 0)
+		throw std::system_error(errno, std::generic_category(), "BufferPool: fdatasync");
+}
+inline void BufferPool::setAsyncIo(AsyncIo* asyncIo) noexcept{
+	io = asyncIo;
+}
+
+//Claim a frame for page and queue its read; the read holds a pin until finishLoad
+inline size_t BufferPool::startLoad(PageId page){
+	assert(io && "pinAsync and prefetch need setAsyncIo");
+	++numMisses;
+	size_t i = findVictim();
+	frames[i] = Frame{page, 1, false, true, true, true, nullptr};
+	pageTable.emplace(page, i);
+	++numLoading;
+	io->read(fd, frameData(i), pageSize, page * pageSize, &BufferPool::pageRead, &loads[i]);
+	return i;
+}
+
+inline void BufferPool::pageRead(void* context, ssize_t result){
+	Load* load = static_cast<Load*>(context);
+	load->pool->finishLoad(load->frame, result == (ssize_t)pageSize);
+}
+
+//Hand the page to its waiters, pinning it once for each so it stays put until they are resumed.
+//A failed read frees the frame, and a later pin reads the page again.
+inline void BufferPool::finishLoad(size_t i, bool ok){
+	Frame& frame = frames[i];
+	--numLoading;
+	frame.loading = false;
+	--frame.pinCount;
+	if(!ok){
+		pageTable.erase(frame.page);
+		frame.used = false;
+	}
+	for(PageWaiter* waiter = frame.waiters; waiter; waiter = waiter->next){
+		if(ok)
+			++frame.pinCount;
+		ready.emplace_back(waiter, ok ? frameData(i) : nullptr);
+	}
+	frame.waiters = nullptr;
+}
+
+inline char* BufferPool::pinAsync(PageId page, PageWaiter* waiter){
+	auto found = pageTable.find(page);
+	size_t i;
+	if(found != pageTable.end()){
+		i = found->second;
+		Frame& frame = frames[i];
+		frame.referenced = true;
+		++numHits;
+		if(!frame.loading){
+			++frame.pinCount;
+			return frameData(i);
+		}
+	}else{
+		i = startLoad(page);
+	}
+	waiter->next = frames[i].waiters;
+	frames[i].waiters = waiter;
+	return nullptr;
+}
+
+inline void BufferPool::prefetch(PageId page){
+	auto found = pageTable.find(page);
+	if(found != pageTable.end())
+		frames[found->second].referenced = true;
+	else
+		startLoad(page);
+}
+
+inline size_t BufferPool::poll(){
+	if(io)
+		io->poll();
+	size_t resumed = 0;
+	while(!ready.empty()){ //Resumed waiters may queue reads that finish while they run
+		std::vector<std::pair<PageWaiter*, char*>> batch;
+		batch.swap(ready);
+		for(auto& waiting : batch)
+			waiting.first->resume(waiting.first, waiting.second);
+		resumed += batch.size();
+	}
+	return resumed;
+}
+
+inline size_t BufferPool::wait(){
+	while(ready.empty() && numLoading > 0)
+		io->wait();
+	return poll();
+}
+/*===================== End of BufferPool =========================================*/
+
+#endif
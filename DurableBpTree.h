@@ -0,0 +1,175 @@
+#ifndef DURABLE_BPTREE_H
+#define DURABLE_BPTREE_H
+
+#include "BpTree.h"
+#include "MappedBpTree.h"
+#include "WriteAheadLog.h"
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+//BpTree whose mutations survive a crash. Every successful insert and remove is appended to a
+//write-ahead log (see WriteAheadLog.h) and made durable as its sync policy asks before the call returns.
+//checkpoint() saves the tree as a snapshot (see Snapshot.h) and truncates the log, and open() recovers by
+//loading the last checkpoint and replaying the log on top of it.
+//Operations are serialized by a mutex, but a thread waits for its log record to reach the disk
+//outside it, so concurrent writers share fsyncs. A change is visible to find() slightly before it is durable.
+//A change is appended to the log before it is applied to the tree, so when append throws (the log has
+//failed, see WriteAheadLog.h) the tree is left as it was. When the wait for the disk throws, the change is
+//logged and applied but not known to be durable. After a failed write its record stays queued and becomes
+//durable with the next sync that succeeds. After a failed fdatasync it may or may not survive a restart,
+//and every later change throws until open() is called again, which reloads what actually reached the disk.
+template<typename Key, typename Value, typename Compare = std::less<Key>, int KeysLimit = 3,
+		typename Allocator = NewDeleteNodeAllocator>
+class DurableBpTree{
+	static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+			"Log records and checkpoints store keys and values as raw bytes");
+	public:
+		typedef BpTree<Key, Value, Compare, KeysLimit, Allocator> Tree;
+
+		explicit DurableBpTree(WriteAheadLog::Options = WriteAheadLog::Options());
+		DurableBpTree(const DurableBpTree&) = delete;
+		DurableBpTree& operator=(const DurableBpTree&) = delete;
+		//Recover from the checkpoint at checkpointPath, if there is one, and the log at logPath, then log
+		//further changes there. Returns false if the log cannot be opened or the checkpoint is unreadable.
+		bool open(const char* logPath, const char* checkpointPath);
+		void close(); //Syncs the log
+		bool insert(const Key&, const Value&);
+		bool remove(const Key&);
+		Value find(const Key&) const;
+		//Save the tree to the checkpoint path and drop the log records it covers. Returns false, keeping
+		//the log, if the snapshot cannot be written.
+		bool checkpoint();
+		void sync(); //Make every change durable now, whatever the sync policy
+		size_t recoveredRecords() const noexcept{ //Log records replayed by the last open()
+			return numRecovered;
+		}
+		//The tree itself, for scans. Not synchronized with writers.
+		const Tree& tree() const noexcept{
+			return entries;
+		}
+	private:
+		enum RecordType : uint8_t{
+			insertRecord = 1,
+			removeRecord = 2
+		};
+		void replayRecord(uint8_t type, const void* payload, uint32_t length) noexcept;
+
+		Tree entries;
+		WriteAheadLog log;
+		mutable std::mutex mutex;
+		std::string checkpointFile;
+		size_t numRecovered;
+};
+
+/*==================== DurableBpTree implementation ==========================*/
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator>
+DurableBpTree<Key, Value, Compare, KeysLimit, Allocator>::DurableBpTree(WriteAheadLog::Options options)
+	: log(options), numRecovered(0){
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator>
+bool DurableBpTree<Key, Value, Compare, KeysLimit, Allocator>::open(const char* logPath, const char* checkpointPath){
+	std::lock_guard<std::mutex> guard(mutex);
+	log.close();
+	entries.clear();
+	numRecovered = 0;
+	checkpointFile = checkpointPath;
+	if(access(checkpointPath, F_OK) == 0){
+		MappedBpTree<Key, Value, Compare> saved;
+		if(!saved.open(checkpointPath))
+			return false;
+		std::vector<std::pair<Key, Value>> pairs;
+		pairs.reserve(saved.size());
+		saved.forEach([&](const Key& k, const Value& v){
+			pairs.emplace_back(k, v);
+		});
+		entries.bulkLoad(pairs.begin(), pairs.end());
+	}
+	if(!log.open(logPath))
+		return false;
+	numRecovered = log.replay([this](uint8_t type, const void* payload, uint32_t length){
+		replayRecord(type, payload, length);
+	});
+	return true;
+}
+
+//A crash between writing a checkpoint and truncating the log replays records the checkpoint already
+//holds. That is harmless: only inserts of absent keys and removes of present ones are logged, so
+//replaying a key's records in order ends in the same state whatever it started from.
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator>
+void DurableBpTree<Key, Value, Compare, KeysLimit, Allocator>::replayRecord(uint8_t type, const void* payload, uint32_t length) noexcept{
+	Key k;
+	if(type == insertRecord && length == sizeof(Key) + sizeof(Value)){
+		Value v;
+		std::memcpy(&k, payload, sizeof(Key));
+		std::memcpy(&v, static_cast<const char*>(payload) + sizeof(Key), sizeof(Value));
+		entries.insert(k, v);
+	}else if(type == removeRecord && length == sizeof(Key)){
+		std::memcpy(&k, payload, sizeof(Key));
+		entries.remove(k);
+	}
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator>
+void DurableBpTree<Key, Value, Compare, KeysLimit, Allocator>::close(){
+	std::lock_guard<std::mutex> guard(mutex);
+	log.close();
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator>
+bool DurableBpTree<Key, Value, Compare, KeysLimit, Allocator>::insert(const Key& k, const Value& v){
+	uint64_t lsn;
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+		if(entries.findPtr(k))
+			return false;
+		char record[sizeof(Key) + sizeof(Value)];
+		std::memcpy(record, &k, sizeof(Key));
+		std::memcpy(record + sizeof(Key), &v, sizeof(Value));
+		lsn = log.append(insertRecord, record, sizeof(record));
+		entries.insert(k, v);
+	}
+	log.commit(lsn);
+	return true;
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator>
+bool DurableBpTree<Key, Value, Compare, KeysLimit, Allocator>::remove(const Key& k){
+	uint64_t lsn;
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+		if(!entries.findPtr(k))
+			return false;
+		lsn = log.append(removeRecord, &k, sizeof(Key));
+		entries.remove(k);
+	}
+	log.commit(lsn);
+	return true;
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator>
+Value DurableBpTree<Key, Value, Compare, KeysLimit, Allocator>::find(const Key& k) const{
+	std::lock_guard<std::mutex> guard(mutex);
+	return entries.find(k);
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator>
+bool DurableBpTree<Key, Value, Compare, KeysLimit, Allocator>::checkpoint(){
+	std::lock_guard<std::mutex> guard(mutex);
+	if(!entries.saveSnapshot(checkpointFile.c_str()))
+		return false;
+	log.truncate();
+	return true;
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator>
+void DurableBpTree<Key, Value, Compare, KeysLimit, Allocator>::sync(){
+	log.sync();
+}
+/*===================== End of DurableBpTree =========================================*/
+
+#endif
@@ -0,0 +1,289 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//Epoch-based memory reclamation for latch-free readers.
+//Threads wrap every access to shared nodes in an EpochManager::Guard, which publishes the global epoch
+//the thread entered in. A writer that unlinks a node retires it instead of freeing it, tagged with the
+//epoch at that moment. The global epoch only advances once every thread inside a guard has caught up
+//with it, so after two advances no reader that could still hold the node is left and it is freed.
+
+namespace epoch{
+
+constexpr int maxThreads = 256; //Live threads that get a slot of their own in every EpochManager
+constexpr int overflowId = maxThreads; //Id of every thread started while maxThreads others hold ids
+
+//Small process-wide thread ids, so each manager can give every thread its own slot.
+//Ids are recycled when a thread exits. Threads beyond maxThreads all get overflowId and share a
+//locked slot instead.
+class ThreadRegistry{
+	public:
+		static int id() noexcept{
+			thread_local Entry entry;
+			return entry.id;
+		}
+		//One past the highest id handed out so far
+		static int limit() noexcept{
+			return nextId.load(std::memory_order_acquire);
+		}
+	private:
+		struct Entry{
+			int id;
+			Entry() noexcept : id(acquire()){
+			}
+			~Entry(){
+				release(id);
+			}
+		};
+		static int acquire() noexcept{
+			std::lock_guard<std::mutex> guard(mutex);
+			if(numFree > 0)
+				return freeIds[--numFree];
+			int id = nextId.load(std::memory_order_relaxed);
+			if(id >= maxThreads)
+				return overflowId;
+			nextId.store(id + 1, std::memory_order_release);
+			return id;
+		}
+		static void release(int id) noexcept{
+			if(id == overflowId)
+				return;
+			std::lock_guard<std::mutex> guard(mutex);
+			freeIds[numFree++] = id;
+		}
+
+		static inline std::mutex mutex;
+		static inline std::atomic<int> nextId{0};
+		static inline int freeIds[maxThreads];
+		static inline int numFree = 0;
+};
+
+}
+
+class EpochManager{
+	public:
+		typedef void (*Deleter)(void*);
+		static constexpr uint64_t quiescent = 0; //Slot epoch of a thread outside any guard
+		static constexpr unsigned collectInterval = 64; //Retires between attempts to advance the epoch
+
+		//Keeps every node reachable when it was constructed alive until it is destroyed. Guards nest.
+		class Guard{
+			public:
+				explicit Guard(EpochManager& m) noexcept : manager(m){
+					manager.enter();
+				}
+				Guard(const Guard&) = delete;
+				Guard& operator=(const Guard&) = delete;
+				~Guard(){
+					manager.exit();
+				}
+			private:
+				EpochManager& manager;
+		};
+
+		EpochManager() noexcept : globalEpoch(1){
+		}
+		EpochManager(const EpochManager&) = delete;
+		EpochManager& operator=(const EpochManager&) = delete;
+		~EpochManager(); //Frees everything still retired; no thread may be inside a guard
+
+		void enter() noexcept;
+		void exit() noexcept;
+		//Hand p to deleter once no reader can reach it. Must be called after p is unlinked.
+		void retire(void* p, Deleter deleter) noexcept;
+		//Try to advance the global epoch and free the calling thread's retired nodes that are old enough
+		void collect() noexcept;
+		size_t pendingCount() const noexcept; //Retired but not yet freed; only exact while no thread is active
+	private:
+		struct Retired{
+			void* ptr;
+			Deleter deleter;
+			uint64_t epoch;
+		};
+		//Written by its owning thread only, apart from the epoch read by collect()
+		struct alignas(64) Slot{
+			std::atomic<uint64_t> epoch{quiescent};
+			int depth = 0;
+			unsigned retiresSinceCollect = 0;
+			std::vector<Retired> limbo;
+		};
+		//A thread with epoch::overflowId inside a guard, kept in the overflow list
+		struct OverflowGuard{
+			std::thread::id thread;
+			int depth;
+			uint64_t epoch;
+		};
+		bool tryAdvance() noexcept;
+		void enterOverflow() noexcept;
+		void exitOverflow() noexcept;
+		void retireOverflow(const Retired&) noexcept;
+		void collectOverflow() noexcept;
+
+		std::atomic<uint64_t> globalEpoch;
+		std::array<Slot, epoch::maxThreads> slots;
+		//Slot shared by threads past epoch::maxThreads: their guards and retired nodes, under overflowMutex
+		std::mutex overflowMutex;
+		std::atomic<size_t> numOverflowGuards{0};
+		std::vector<OverflowGuard> overflowGuards;
+		std::vector<Retired> overflowLimbo;
+};
+
+/*==================== EpochManager implementation ==========================*/
+inline EpochManager::~EpochManager(){
+	for(auto& slot : slots){
+		for(auto& retired : slot.limbo)
+			retired.deleter(retired.ptr);
+	}
+	for(auto& retired : overflowLimbo)
+		retired.deleter(retired.ptr);
+}
+
+inline void EpochManager::enter() noexcept{
+	int id = epoch::ThreadRegistry::id();
+	if(id == epoch::overflowId)
+		return enterOverflow();
+	Slot& slot = slots[id];
+	if(slot.depth++ > 0)
+		return;
+	//The store must be visible before any node is read, or a concurrent collect() could miss it
+	slot.epoch.store(globalEpoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+inline void EpochManager::exit() noexcept{
+	int id = epoch::ThreadRegistry::id();
+	if(id == epoch::overflowId)
+		return exitOverflow();
+	Slot& slot = slots[id];
+	if(--slot.depth == 0)
+		slot.epoch.store(quiescent, std::memory_order_release);
+}
+
+inline void EpochManager::retire(void* p, Deleter deleter) noexcept{
+	int id = epoch::ThreadRegistry::id();
+	Retired retired = {p, deleter, globalEpoch.load(std::memory_order_acquire)};
+	if(id == epoch::overflowId)
+		return retireOverflow(retired);
+	Slot& slot = slots[id];
+	slot.limbo.push_back(retired);
+	if(++slot.retiresSinceCollect >= collectInterval)
+		collect();
+}
+
+//The global epoch moves from e to e + 1 only when every thread inside a guard entered at e
+inline bool EpochManager::tryAdvance() noexcept{
+	uint64_t current = globalEpoch.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int limit = epoch::ThreadRegistry::limit();
+	for(int i = 0; i < limit; ++i){
+		uint64_t e = slots[i].epoch.load(std::memory_order_acquire);
+		if(e != quiescent && e != current)
+			return false;
+	}
+	if(numOverflowGuards.load(std::memory_order_acquire) > 0){
+		std::lock_guard<std::mutex> guard(overflowMutex);
+		for(const OverflowGuard& g : overflowGuards){
+			if(g.epoch != current)
+				return false;
+		}
+	}
+	return globalEpoch.compare_exchange_strong(current, current + 1, std::memory_order_acq_rel);
+}
+
+inline void EpochManager::collect() noexcept{
+	int id = epoch::ThreadRegistry::id();
+	if(id == epoch::overflowId)
+		return collectOverflow();
+	Slot& slot = slots[id];
+	slot.retiresSinceCollect = 0;
+	tryAdvance();
+	//Readers that saw a node retired at epoch e entered at e or earlier, and have all left by e + 2
+	uint64_t safe = globalEpoch.load(std::memory_order_acquire);
+	size_t kept = 0;
+	for(auto& retired : slot.limbo){
+		if(retired.epoch + 2 <= safe)
+			retired.deleter(retired.ptr);
+		else
+			slot.limbo[kept++] = retired;
+	}
+	slot.limbo.resize(kept);
+}
+
+inline size_t EpochManager::pendingCount() const noexcept{
+	size_t total = overflowLimbo.size();
+	for(auto& slot : slots)
+		total += slot.limbo.size();
+	return total;
+}
+
+//Overflow threads cannot keep their nesting depth in a slot of their own, so each one inside a guard has
+//an entry in overflowGuards, found by thread id. The list is short: only threads past maxThreads use it.
+inline void EpochManager::enterOverflow() noexcept{
+	{
+		std::lock_guard<std::mutex> guard(overflowMutex);
+		std::thread::id self = std::this_thread::get_id();
+		for(OverflowGuard& g : overflowGuards){
+			if(g.thread == self){
+				++g.depth;
+				return;
+			}
+		}
+		overflowGuards.push_back(OverflowGuard{self, 1, globalEpoch.load(std::memory_order_relaxed)});
+		numOverflowGuards.fetch_add(1, std::memory_order_relaxed);
+	}
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+inline void EpochManager::exitOverflow() noexcept{
+	std::lock_guard<std::mutex> guard(overflowMutex);
+	std::thread::id self = std::this_thread::get_id();
+	for(size_t i = 0; i < overflowGuards.size(); ++i){
+		if(overflowGuards[i].thread == self){
+			if(--overflowGuards[i].depth == 0){
+				overflowGuards[i] = overflowGuards.back();
+				overflowGuards.pop_back();
+				numOverflowGuards.fetch_sub(1, std::memory_order_release);
+			}
+			return;
+		}
+	}
+}
+
+inline void EpochManager::retireOverflow(const Retired& retired) noexcept{
+	bool full;
+	{
+		std::lock_guard<std::mutex> guard(overflowMutex);
+		overflowLimbo.push_back(retired);
+		full = overflowLimbo.size() % collectInterval == 0;
+	}
+	if(full)
+		collectOverflow();
+}
+
+inline void EpochManager::collectOverflow() noexcept{
+	tryAdvance();
+	uint64_t safe = globalEpoch.load(std::memory_order_acquire);
+	std::vector<Retired> ready;
+	{
+		std::lock_guard<std::mutex> guard(overflowMutex);
+		size_t kept = 0;
+		for(auto& retired : overflowLimbo){
+			if(retired.epoch + 2 <= safe)
+				ready.push_back(retired);
+			else
+				overflowLimbo[kept++] = retired;
+		}
+		overflowLimbo.resize(kept);
+	}
+	for(auto& retired : ready)
+		retired.deleter(retired.ptr);
+}
+/*===================== End of EpochManager =========================================*/
+
+#endif
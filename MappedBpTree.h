@@ -0,0 +1,271 @@
+#ifndef MAPPED_BPTREE_H
+#define MAPPED_BPTREE_H
+
+#include "Snapshot.h"
+#include "NodeSearch.h"
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//Read-only tree served straight from a snapshot written by BpTree::saveSnapshot. Opening maps the file
+//and checks its header (and, with compressed keys, one descriptor per block), with no deserialization, so
+//startup barely depends on the number of keys and every process mapping the same snapshot shares one copy
+//in the page cache.
+template<typename Key, typename Value, typename Compare = std::less<Key>>
+class MappedBpTree{
+	static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+			"Snapshots store keys and values as raw bytes");
+	public:
+		MappedBpTree() noexcept;
+		MappedBpTree(const MappedBpTree&) = delete;
+		MappedBpTree& operator=(const MappedBpTree&) = delete;
+		~MappedBpTree();
+		//Map a snapshot. Returns false if the file cannot be mapped, is truncated, has sections or index
+		//levels inconsistent with its entry count, or was written for other key or value types.
+		bool open(const char* path) noexcept;
+		void close() noexcept;
+		bool find(const Key&, Value&) const noexcept;
+		//Call fn(key, value) for keys in [lo, hi) in ascending order. If fn returns bool, false stops the scan.
+		template<typename Fn>
+		void scan(const Key& lo, const Key& hi, Fn&& fn) const;
+		//Call fn(key, value) for every entry in ascending order
+		template<typename Fn>
+		void forEach(Fn&& fn) const;
+		size_t size() const noexcept{
+			return numEntries;
+		}
+	private:
+		size_t lowerBound(const Key&) const noexcept; //Position of the first entry not less than the key
+		size_t lowerBoundInBlock(size_t block, int len, const Key&) const noexcept;
+		Key keyAt(size_t pos) const noexcept;
+		static bool keyLess(const Key& a, const Key& b) noexcept{
+			return Compare()(a, b);
+		}
+
+		void* base;
+		size_t mappedBytes;
+		size_t numEntries;
+		int numLevels;
+		const Key* keys;
+		const char* packedKeys; //Keys section of a snapshot with compressed keys, else nullptr
+		const Value* vals;
+		const Key* levels[snapshot::maxLevels];
+		size_t levelCounts[snapshot::maxLevels];
+		static constexpr size_t blockKeys = snapshot::blockKeys<Key>();
+};
+
+template<typename Key, typename Value, typename Compare>
+MappedBpTree<Key, Value, Compare>::MappedBpTree() noexcept
+	: base(nullptr), mappedBytes(0), numEntries(0), numLevels(0), keys(nullptr), packedKeys(nullptr), vals(nullptr){
+}
+
+template<typename Key, typename Value, typename Compare>
+MappedBpTree<Key, Value, Compare>::~MappedBpTree(){
+	close();
+}
+
+template<typename Key, typename Value, typename Compare>
+void MappedBpTree<Key, Value, Compare>::close() noexcept{
+	if(base)
+		munmap(base, mappedBytes);
+	base = nullptr;
+	mappedBytes = numEntries = 0;
+	numLevels = 0;
+	keys = nullptr;
+	packedKeys = nullptr;
+}
+
+template<typename Key, typename Value, typename Compare>
+bool MappedBpTree<Key, Value, Compare>::open(const char* path) noexcept{
+	close();
+	int fd = ::open(path, O_RDONLY);
+	if(fd < 0)
+		return false;
+	struct stat st;
+	if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(snapshot::Header)){
+		::close(fd);
+		return false;
+	}
+	void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if(mapped == MAP_FAILED)
+		return false;
+	base = mapped;
+	mappedBytes = st.st_size;
+
+	const snapshot::Header& header = *static_cast<const snapshot::Header*>(base);
+	const bool compressed = header.flags & snapshot::compressedKeys;
+	//Sections must start on a cache line and hold count items of the given size, without overflow
+	auto fits = [this](uint64_t offset, uint64_t count, size_t itemBytes){
+		return offset % snapshot::sectionAlignment == 0 && offset <= mappedBytes && count <= (mappedBytes - offset) / itemBytes;
+	};
+	bool valid = header.magic == snapshot::magic && header.formatVersion == snapshot::formatVersion
+		&& header.keyBytes == sizeof(Key) && header.valueBytes == sizeof(Value) && header.blockKeys == blockKeys
+		&& header.numLevels <= (uint32_t)snapshot::maxLevels && header.fileBytes == mappedBytes
+		&& (header.flags & ~snapshot::compressedKeys) == 0
+		&& (!compressed || snapshot::isCompressible<Key, Compare>())
+		&& fits(header.valsOffset, header.numEntries, sizeof(Value)) && header.keysOffset <= header.valsOffset;
+	const uint64_t numBlocks = valid ? (header.numEntries + blockKeys - 1) / blockKeys : 0;
+	valid = valid && fits(header.keysOffset, compressed ? numBlocks : header.numEntries, compressed ? sizeof(uint64_t) : sizeof(Key));
+	//Each level must hold exactly the block starts of the one below, as saveSnapshot writes them, so that a
+	//descent never indexes past a level; the top level fits in one block
+	uint64_t expectedCount = header.numEntries;
+	for(uint32_t l = 0; valid && l < header.numLevels; ++l){
+		bool top = l + 1 == header.numLevels;
+		expectedCount = (expectedCount + blockKeys - 1) / blockKeys;
+		valid = header.levelCounts[l] == expectedCount && (top ? expectedCount <= blockKeys : expectedCount > blockKeys)
+			&& fits(header.levelOffsets[l], expectedCount, sizeof(Key));
+	}
+	valid = valid && (header.numLevels > 0 || header.numEntries == 0);
+	//Every block of compressed differences must lie, aligned to its width, between the descriptors and the values
+	if(compressed){
+		const char* section = static_cast<const char*>(base) + header.keysOffset;
+		const uint64_t sectionBytes = header.valsOffset - header.keysOffset;
+		for(uint64_t block = 0; valid && block < numBlocks; ++block){
+			uint64_t descriptor = reinterpret_cast<const uint64_t*>(section)[block];
+			uint64_t offset = descriptor >> 2, widthLog2 = descriptor & 3;
+			uint64_t len = std::min<uint64_t>(blockKeys, header.numEntries - block * blockKeys);
+			valid = offset >= numBlocks * sizeof(uint64_t) && offset % (1u << widthLog2) == 0 && offset <= sectionBytes
+				&& len << widthLog2 <= sectionBytes - offset;
+		}
+	}
+	if(!valid){
+		close();
+		return false;
+	}
+
+	const char* bytes = static_cast<const char*>(base);
+	numEntries = header.numEntries;
+	numLevels = header.numLevels;
+	keys = compressed ? nullptr : reinterpret_cast<const Key*>(bytes + header.keysOffset);
+	packedKeys = compressed ? bytes + header.keysOffset : nullptr;
+	vals = reinterpret_cast<const Value*>(bytes + header.valsOffset);
+	for(int l = 0; l < numLevels; ++l){
+		levels[l] = reinterpret_cast<const Key*>(bytes + header.levelOffsets[l]);
+		levelCounts[l] = header.levelCounts[l];
+	}
+	//Every lookup goes through the index levels, so fault them in up front
+	if(numLevels > 0){
+		size_t indexStart = header.levelOffsets[0] / sysconf(_SC_PAGESIZE) * sysconf(_SC_PAGESIZE);
+		madvise(static_cast<char*>(base) + indexStart, mappedBytes - indexStart, MADV_WILLNEED);
+	}
+	return true;
+}
+
+//Descend the index levels, at each one picking the last entry of the current block that is not
+//greater than k, then search the data block it leads to
+template<typename Key, typename Value, typename Compare>
+size_t MappedBpTree<Key, Value, Compare>::lowerBound(const Key& k) const noexcept{
+	size_t block = 0;
+	for(int l = numLevels - 1; l >= 0; --l){
+		size_t first = block * blockKeys;
+		int len = std::min(blockKeys, levelCounts[l] - first);
+		int pos = NodeSearch<Key, Compare>::upperBound(levels[l] + first, len, k);
+		block = first + (pos > 0 ? pos - 1 : 0);
+	}
+	size_t first = block * blockKeys;
+	int len = std::min(blockKeys, numEntries - first);
+	if(packedKeys)
+		return first + lowerBoundInBlock(block, len, k);
+	return first + NodeSearch<Key, Compare>::lowerBound(keys + first, len, k);
+}
+
+//Count the differences in a compressed block below k's difference from the block's first key, without
+//decoding the block. 4 and 8 byte differences use the vector search; the narrow ones a branchless count.
+template<typename Key, typename Value, typename Compare>
+size_t MappedBpTree<Key, Value, Compare>::lowerBoundInBlock(size_t block, int len, const Key& k) const noexcept{
+	if constexpr(snapshot::isCompressible<Key, Compare>()){
+		typedef typename std::make_unsigned<Key>::type Delta;
+		const Key blockBase = levels[0][block];
+		if(keyLess(k, blockBase))
+			return 0;
+		const uint64_t target = (Delta)k - (Delta)blockBase;
+		uint64_t descriptor = reinterpret_cast<const uint64_t*>(packedKeys)[block];
+		const char* deltas = packedKeys + (descriptor >> 2);
+		auto countBelow = [&](auto* d, uint64_t maxDelta) -> size_t{
+			if(target > maxDelta)
+				return len;
+			size_t count = 0;
+			for(int i = 0; i < len; ++i)
+				count += d[i] < target;
+			return count;
+		};
+		switch(descriptor & 3){
+			case 0:
+				return countBelow(reinterpret_cast<const uint8_t*>(deltas), 0xFF);
+			case 1:
+				return countBelow(reinterpret_cast<const uint16_t*>(deltas), 0xFFFF);
+			case 2:
+				if(target > 0xFFFFFFFFull)
+					return len;
+				return NodeSearch<uint32_t, std::less<uint32_t>>::lowerBound(reinterpret_cast<const uint32_t*>(deltas), len, (uint32_t)target);
+			default:
+				return NodeSearch<uint64_t, std::less<uint64_t>>::lowerBound(reinterpret_cast<const uint64_t*>(deltas), len, target);
+		}
+	}else{
+		return 0; //Only integer keys are ever compressed
+	}
+}
+
+template<typename Key, typename Value, typename Compare>
+Key MappedBpTree<Key, Value, Compare>::keyAt(size_t pos) const noexcept{
+	if constexpr(snapshot::isCompressible<Key, Compare>()){
+		if(packedKeys){
+			typedef typename std::make_unsigned<Key>::type Delta;
+			size_t block = pos / blockKeys, i = pos % blockKeys;
+			uint64_t descriptor = reinterpret_cast<const uint64_t*>(packedKeys)[block];
+			const char* deltas = packedKeys + (descriptor >> 2);
+			uint64_t delta;
+			switch(descriptor & 3){
+				case 0: delta = reinterpret_cast<const uint8_t*>(deltas)[i]; break;
+				case 1: delta = reinterpret_cast<const uint16_t*>(deltas)[i]; break;
+				case 2: delta = reinterpret_cast<const uint32_t*>(deltas)[i]; break;
+				default: delta = reinterpret_cast<const uint64_t*>(deltas)[i]; break;
+			}
+			return (Key)((Delta)levels[0][block] + (Delta)delta);
+		}
+	}
+	return keys[pos];
+}
+
+template<typename Key, typename Value, typename Compare>
+bool MappedBpTree<Key, Value, Compare>::find(const Key& k, Value& out) const noexcept{
+	if(numEntries == 0)
+		return false;
+	size_t pos = lowerBound(k);
+	if(pos == numEntries || keyLess(k, keyAt(pos)))
+		return false;
+	out = vals[pos];
+	return true;
+}
+
+template<typename Key, typename Value, typename Compare>
+template<typename Fn>
+void MappedBpTree<Key, Value, Compare>::scan(const Key& lo, const Key& hi, Fn&& fn) const{
+	if(numEntries == 0)
+		return;
+	for(size_t pos = lowerBound(lo); pos < numEntries; ++pos){
+		const Key k = keyAt(pos);
+		if(!keyLess(k, hi))
+			return;
+		if constexpr(std::is_void<decltype(fn(k, vals[pos]))>::value){
+			fn(k, vals[pos]);
+		}else{
+			if(!static_cast<bool>(fn(k, vals[pos])))
+				return;
+		}
+	}
+}
+
+template<typename Key, typename Value, typename Compare>
+template<typename Fn>
+void MappedBpTree<Key, Value, Compare>::forEach(Fn&& fn) const{
+	for(size_t pos = 0; pos < numEntries; ++pos)
+		fn(keyAt(pos), vals[pos]);
+}
+
+#endif
@@ -1,97 +1,734 @@
 #ifndef NODE_H
 #define NODE_H
 
-#include<vector>
+#include<array>
 #include<algorithm>
-#include<cmath>
+#include<functional>
 #include<memory>
 #include<string>
+#include<sstream>
 #include<iterator>
 #include<iostream>
+#include<utility>
+#include "NodeSearch.h"
+#include "TreeStats.h"
+
+template<typename, typename, typename, int, typename, typename> class BpTree;
+template<typename, bool> class BpTreeIterator;
+template<typename> class BpTreeVersion;
+template<typename> struct NodePath;
+
+//Separator placed in an interior node between a left and a right leaf. Any s with leftLast < s <= rightFirst
+//routes every key correctly; the default is rightFirst itself.
+template<typename Key, typename Compare>
+struct SeparatorPolicy{
+	static Key shortest(const Key&, const Key& rightFirst){
+		return rightFirst;
+	}
+};
+
+//Lexicographic strings keep the shortest prefix of rightFirst that still sorts above leftLast (suffix
+//truncation): one character past their common prefix. Interior nodes then hold short keys that stay
+//within the small-string buffer.
+template<typename String>
+struct TruncatingSeparator{
+	static String shortest(const String& leftLast, const String& rightFirst){
+		size_t common = std::mismatch(leftLast.begin(), leftLast.begin() + std::min(leftLast.size(), rightFirst.size()), rightFirst.begin()).first - leftLast.begin();
+		return rightFirst.substr(0, std::min(common + 1, rightFirst.size()));
+	}
+};
+
+template<typename Char, typename CharTraits, typename Alloc>
+struct SeparatorPolicy<std::basic_string<Char, CharTraits, Alloc>, std::less<std::basic_string<Char, CharTraits, Alloc>>>
+	: TruncatingSeparator<std::basic_string<Char, CharTraits, Alloc>>{
+};
+
+template<typename Char, typename CharTraits, typename Alloc>
+struct SeparatorPolicy<std::basic_string<Char, CharTraits, Alloc>, std::less<>>
+	: TruncatingSeparator<std::basic_string<Char, CharTraits, Alloc>>{
+};
+
+//Node sizing and fill thresholds of a tree, as percentages of a node's capacity.
+//LeafKeys sets the leaf capacity apart from the tree's KeysLimit, which then only sizes interior nodes
+//(0 keeps leaves at KeysLimit): wide leaves favour scans and bulk storage, narrow ones point writes,
+//while interior nodes stay within a few cache lines.
+//MinFill is the fill rebalancing restores and the least either half of a split or a bulk-loaded node gets.
+//SplitAt is the share of keys a full node keeps on the left when it splits, within what MinFill allows.
+//MergeBelow is the fill under which a node is rebalanced with a sibling. Set below MinFill it merges
+//lazily: a node drains to nearly empty before it borrows or merges, so a workload hovering at a node
+//boundary does not split and merge it over and over. bench/tune_bench.cpp picks these from a trace.
+template<int LeafKeys = 0, int MinFill = 50, int SplitAt = 50, int MergeBelow = MinFill>
+struct NodePolicy{
+	static_assert(LeafKeys == 0 || LeafKeys >= 3, "A leaf must hold at least 3 keys");
+	static_assert(MinFill >= 0 && MinFill <= 50, "MinFill above 50% leaves no room to split");
+	static_assert(SplitAt > 0 && SplitAt < 100, "SplitAt must leave keys on both sides");
+	static_assert(MergeBelow >= 0 && MergeBelow <= MinFill, "MergeBelow cannot exceed MinFill");
+	static constexpr int leafKeys = LeafKeys;
+	static constexpr int minFill = MinFill;
+	static constexpr int splitAt = SplitAt;
+	static constexpr int mergeBelow = MergeBelow;
+};
+
+//Compile-time description of a tree: key/value types, ordering, fanout and fill policy.
+//All split and fill thresholds are derived here so nodes never compute them at runtime. With the default
+//policy they come to half of each node, as in a textbook B+ tree.
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Policy = NodePolicy<>>
+struct NodeTraits{
+	static_assert(KeysLimit >= 3, "A node must hold at least 3 keys");
+	typedef Key KeyType;
+	typedef Value ValueType;
+	typedef Compare KeyCompare;
+	typedef Policy FillPolicy;
+
+	static constexpr int percentOf(int n, int percent){ //Rounded up
+		return (n * percent + 99) / 100;
+	}
+	static constexpr int clamp(int n, int lo, int hi){
+		return n < lo ? lo : (n > hi ? hi : n);
+	}
+
+	static constexpr int keysLimit = KeysLimit;
+	static constexpr int interiorKeysLimit = KeysLimit;
+	static constexpr int leafKeysLimit = Policy::leafKeys ? Policy::leafKeys : KeysLimit;
+	static constexpr int leafMinKeys = clamp(percentOf(leafKeysLimit, Policy::minFill), 1, (leafKeysLimit + 1) / 2); //Fill rebalancing restores
+	static constexpr int leafMergeKeys = clamp(percentOf(leafKeysLimit, Policy::mergeBelow), 1, leafMinKeys); //Fewest keys a non-root leaf may hold
+	static constexpr int leafRemainingKeys = clamp(percentOf(leafKeysLimit + 1, Policy::splitAt), leafMinKeys, leafKeysLimit + 1 - leafMinKeys); //Keys kept in the left leaf on split
+	static constexpr int leafSplitKeys = leafKeysLimit + 1 - leafRemainingKeys; //Keys moved to the new right leaf on split
+	static constexpr int interiorMinNext = clamp(percentOf(interiorKeysLimit, Policy::minFill), 2, (interiorKeysLimit + 1) / 2); //Children rebalancing restores
+	static constexpr int interiorMergeNext = clamp(percentOf(interiorKeysLimit, Policy::mergeBelow), 2, interiorMinNext); //Fewest children a non-root interior node may hold
+	static constexpr int interiorRemainingKeys = clamp(percentOf(interiorKeysLimit, Policy::splitAt), interiorMinNext - 1, interiorKeysLimit + 1 - interiorMinNext); //Keys kept in the left interior node on split
+	static constexpr int interiorSplitKeys = interiorKeysLimit - interiorRemainingKeys; //Keys moved to the new right interior node on split
+	static constexpr size_t cacheLineSize = 64; //Nodes start on a cache line and occupy whole lines
+
+	static Key separator(const Key& leftLast, const Key& rightFirst){
+		return SeparatorPolicy<Key, Compare>::shortest(leftLast, rightFirst);
+	}
+};
+
+//Largest keysLimit whose leaf and interior nodes both fit in the given number of bytes,
+//e.g. fanoutForBytes<uint64_t, uint64_t>(256) for four cache lines or 4096 for a page.
+//The node header takes 16 bytes and a leaf adds its two chain pointers.
+template<typename Key, typename Value>
+constexpr int fanoutForBytes(size_t bytes){
+	return (int)((bytes - 16 - 2 * sizeof(void*)) / (sizeof(Key) + (sizeof(Value) > sizeof(void*) ? sizeof(Value) : sizeof(void*)))) - 1;
+}
+
+//The same for leaves alone, for NodePolicy's LeafKeys
+template<typename Key, typename Value>
+constexpr int leafFanoutForBytes(size_t bytes){
+	return (int)((bytes - 16 - 2 * sizeof(void*)) / (sizeof(Key) + sizeof(Value))) - 1;
+}
+
+//The same for interior nodes alone, for KeysLimit when leaves are sized apart
+template<typename Key>
+constexpr int interiorFanoutForBytes(size_t bytes){
+	return (int)((bytes - 16 - sizeof(void*)) / (sizeof(Key) + sizeof(void*))) - 1;
+}
+
+//Nodes carry no vtable, no heap-allocated members and no parent pointer: the header, keys and next
+//pointers/values sit inline in one block aligned to a cache line, so a descent touches one contiguous
+//region per level. Structural changes find parents and siblings through the NodePath of the descent.
+//Node is the header every node starts with; NodeKeys adds a key array sized for leaves or interior nodes.
+template<typename Traits>
 class Node{
 	public:
-		Node(int);
-		bool hasKey(int) const noexcept;
-		bool isLimitExceeded() const noexcept;	
-		bool coalescible(int) const noexcept;
+		typedef typename Traits::KeyType Key;
+		typedef typename Traits::KeyCompare Compare;
+
+		Node(bool);
+		bool isLeafNode() const noexcept{
+			return leaf;
+		}
+		//Keys of a node of either kind; code that knows the kind reaches keys directly
+		Key* keyData() noexcept;
+		const Key* keyData() const noexcept;
+		int capacity() const noexcept{
+			return leaf ? Traits::leafKeysLimit : Traits::interiorKeysLimit;
+		}
 		std::string keysToString() const noexcept;
-		virtual ~Node(){
+
+		int numKeys;
+		int refs; //Parents and versions pointing at this node; above one it is shared with a version (see BpTreeVersion.h)
+		bool leaf;
+
+		template<typename, typename, typename, int, typename, typename> friend class BpTree;
+		template<typename> friend class BpTreeVersion;
+	protected:
+		static bool keyLess(const Key& a, const Key& b) noexcept{
+			return Compare()(a, b);
+		}
+};
+
+template<typename Traits, int KeysLimit>
+class alignas(Traits::cacheLineSize) NodeKeys : public Node<Traits>{
+	public:
+		typedef Node<Traits> Base;
+		typedef typename Base::Key Key;
+		typedef typename Base::Compare Compare;
+		static constexpr int keysLimit = KeysLimit;
+		using Base::numKeys;
+
+		explicit NodeKeys(bool isLeaf) : Base(isLeaf){
 		}
+		bool hasKey(const Key&) const noexcept;
+		bool isLimitExceeded() const noexcept;
+		bool coalescible(int) const noexcept;
 
-		Node* parent;
-		std::vector<int> keys;
+		std::array<Key, KeysLimit + 1> keys; //One spare slot holds the overflowing key until the node is split
 
-		friend class BpTree;
-		friend class InteriorNode;
-		friend class LeafNode;
+		template<typename, typename, typename, int, typename, typename> friend class BpTree;
+		template<typename> friend class BpTreeVersion;
 	protected:
-		virtual bool isFullEnough() const noexcept = 0;
-		virtual bool isRedistributable() const noexcept = 0;
-		virtual bool isLeafNode() const noexcept = 0;
-		virtual void cleanNode() noexcept = 0;
-		virtual Node* getNextNode(int) const noexcept = 0;
-		Node* getLeftSibling() const noexcept;
-		Node* getRightSibling() const noexcept;
-		int getIndexOfKey(int) const noexcept;
-
-		int keysLimit;
+		int getIndexOfKey(const Key&) const noexcept;
+		//Searches take any key type Compare orders against Key
+		template<typename K>
+		int lowerBound(const K&) const noexcept;
+		template<typename K>
+		int upperBound(const K&) const noexcept;
+		template<typename K>
+		bool keyAt(int, const K&) const noexcept;
 };
 
-class InteriorNode : public Node{
+template<typename Traits>
+class InteriorNode : public NodeKeys<Traits, Traits::interiorKeysLimit>{
 	public:
-		InteriorNode(int);
-		InteriorNode(int, std::unique_ptr<Node>);
-		bool isLeafNode() const noexcept override;
-		Node* getNextNode(int) const noexcept;
-		int split(InteriorNode*) noexcept;
-		void insertKey(int, std::unique_ptr<Node>) noexcept;
-		Node* removeKey(int, int) noexcept ;
+		typedef Node<Traits> Base;
+		typedef NodeKeys<Traits, Traits::interiorKeysLimit> Keys;
+		typedef typename Base::Key Key;
+		using Keys::keysLimit;
+		using Keys::numKeys;
+		using Keys::keys;
+
+		InteriorNode();
+		InteriorNode(Base*);
+		template<typename K>
+		Base* getNextNode(const K&) const noexcept;
+		Key split(InteriorNode*, int = Traits::interiorRemainingKeys) noexcept;
+		void insertKey(int, Key&&, Base*) noexcept;
+		Base* removeKey(int, NodePath<Traits>&) noexcept ;
 		~InteriorNode(){}
-		friend class BpTree;
-		friend class Node;
+		template<typename, typename, typename, int, typename, typename> friend class BpTree;
+		template<typename> friend class Node;
+		template<typename, int> friend class NodeKeys;
+		template<typename> friend class LeafNode;
+		template<typename> friend class BpTreeVersion;
 	private:
-		bool isFullEnough() const noexcept override;
-		bool isRedistributable() const noexcept override;
-		InteriorNode* getLeftSibling() const noexcept ;
-		InteriorNode* getRightSibling() const noexcept;
-		Node* redistributeLeftInterior(InteriorNode*) noexcept;
-		Node* redistributeRightInterior(InteriorNode*) noexcept;
-		Node* coalescLeftInterior(InteriorNode*, int) noexcept;
-		Node* coalescRightInterior(InteriorNode*, int) noexcept;
-		void cleanNode() noexcept override;		
-
-		std::vector<std::unique_ptr<Node>> next; //List of pointers pointing to next nodes
+		bool isFullEnough() const noexcept;
+		bool isRedistributable() const noexcept;
+		static InteriorNode* getLeftSibling(const InteriorNode*, int) noexcept;
+		static InteriorNode* getRightSibling(const InteriorNode*, int) noexcept;
+		Base* redistributeLeftInterior(InteriorNode*, InteriorNode*, int) noexcept;
+		Base* redistributeRightInterior(InteriorNode*, InteriorNode*, int) noexcept;
+		Base* coalescLeftInterior(InteriorNode*, InteriorNode*, int, NodePath<Traits>&) noexcept;
+		Base* coalescRightInterior(InteriorNode*, InteriorNode*, int, NodePath<Traits>&) noexcept;
+		void cleanNode() noexcept;
+
+		std::array<Base*, keysLimit + 2> next; //List of pointers pointing to next nodes, owned by this node
 };
 
-class LeafNode : public Node{
+template<typename Traits>
+class LeafNode : public NodeKeys<Traits, Traits::leafKeysLimit>{
 	public:
-		LeafNode(int);
-		std::string getVal(int) const noexcept;
+		typedef Node<Traits> Base;
+		typedef NodeKeys<Traits, Traits::leafKeysLimit> Keys;
+		typedef typename Base::Key Key;
+		typedef typename Traits::ValueType Value;
+		using Keys::keysLimit;
+		using Keys::numKeys;
+		using Keys::keys;
+
+		LeafNode();
+		Value getVal(const Key&) const noexcept;
 		std::string valsToString() const noexcept;
-		bool isLeafNode() const noexcept override;
-		Node* getNextNode(int i) const noexcept override;
-		int split(LeafNode*) noexcept ;
-		void insertKey(int, const std::string&) noexcept;
-		Node* removeKey(int) noexcept ;
+		Base* getNextNode(const Key&) const noexcept;
+		Key split(LeafNode*, int = Traits::leafRemainingKeys) noexcept ;
+		template<typename K, typename V>
+		void insertKey(int, K&&, V&&) noexcept;
+		Base* removeKey(int, NodePath<Traits>&) noexcept ;
+		Base* rebalance(NodePath<Traits>&) noexcept;
 		~LeafNode(){}
-		friend class BpTree;
-		friend class Node;
+		template<typename, typename, typename, int, typename, typename> friend class BpTree;
+		template<typename> friend class Node;
+		template<typename, int> friend class NodeKeys;
+		template<typename, bool> friend class BpTreeIterator;
+		template<typename> friend class BpTreeVersion;
 	private:
-		bool isFullEnough() const noexcept override;
-		bool isRedistributable() const noexcept override;
-		LeafNode* getLeftSibling() const noexcept ;
-		LeafNode* getRightSibling() const noexcept ;
-		Node* redistributeLeftLeaf(LeafNode*) noexcept;
-		Node* redistributeRightLeaf(LeafNode*) noexcept;
-		Node* coalescLeftLeaf(LeafNode*, int) noexcept;
-		Node* coalescRightLeaf(LeafNode*, int) noexcept;
-		void cleanNode() noexcept override;
+		bool isFullEnough() const noexcept;
+		static LeafNode* getLeftSibling(const InteriorNode<Traits>*, int) noexcept ;
+		static LeafNode* getRightSibling(const InteriorNode<Traits>*, int) noexcept ;
+		Base* redistributeLeftLeaf(LeafNode*, InteriorNode<Traits>*, int, int) noexcept;
+		Base* redistributeRightLeaf(LeafNode*, InteriorNode<Traits>*, int, int) noexcept;
+		Base* coalescLeftLeaf(LeafNode*, InteriorNode<Traits>*, int, NodePath<Traits>&) noexcept;
+		Base* coalescRightLeaf(LeafNode*, InteriorNode<Traits>*, int, NodePath<Traits>&) noexcept;
+		void cleanNode() noexcept;
 
 		LeafNode* nextLeaf;
 		LeafNode* prevLeaf;
-		std::vector<std::string> vals; //List of values
+		std::array<Value, keysLimit + 1> vals; //List of values
+	};
+
+//Interior nodes passed on the way down from the root, each with the slot of next taken, so splits and
+//merges reach parents and siblings without parent pointers. Structural changes consume it bottom-up.
+//Nodes emptied by coalescing are collected in retired for the tree to hand back to its allocator.
+template<typename Traits>
+struct NodePath{
+	//A non-root interior node has at least two next nodes, so no tree that fits in memory is deeper
+	static constexpr int maxDepth = 64;
+	struct Step{
+		InteriorNode<Traits>* node;
+		int slot; //Position in node->next the path continues from
 	};
 
+	NodePath() noexcept : depth(0), numRetired(0){
+	}
+	void push(InteriorNode<Traits>* node, int slot) noexcept{
+		steps[depth++] = Step{node, slot};
+	}
+	Step pop() noexcept{
+		return steps[--depth];
+	}
+	bool empty() const noexcept{ //The node being changed is the root
+		return depth == 0;
+	}
+	void retire(Node<Traits>* node) noexcept{
+		retired[numRetired++] = node;
+	}
+
+	std::array<Step, maxDepth> steps;
+	int depth;
+	std::array<Node<Traits>*, maxDepth> retired;
+	int numRetired;
+};
+
+
+/*======== NODE class implementation ========*/
+template<typename Traits>
+Node<Traits>::Node(bool isLeaf) : numKeys(0), refs(1), leaf(isLeaf){
+}
+
+template<typename Traits>
+typename Node<Traits>::Key* Node<Traits>::keyData() noexcept{
+	return leaf ? static_cast<LeafNode<Traits>*>(this)->keys.data() : static_cast<InteriorNode<Traits>*>(this)->keys.data();
+}
+
+template<typename Traits>
+const typename Node<Traits>::Key* Node<Traits>::keyData() const noexcept{
+	return leaf ? static_cast<const LeafNode<Traits>*>(this)->keys.data() : static_cast<const InteriorNode<Traits>*>(this)->keys.data();
+}
+
+template<typename Traits>
+std::string Node<Traits>::keysToString() const noexcept{
+	if(numKeys == 0)
+		return "[]";
+	std::ostringstream res;
+	res << "[";
+	for(int i = 0; i < numKeys; ++i){
+		if(i > 0)
+			res << ",";
+		res << keyData()[i];
+	}
+	res << "]";
+	return res.str();
+}
+/*===================== END OF NODE =======================================*/
+
+
+/*==================== NodeKeys class implementation ==========================*/
+template<typename Traits, int KeysLimit>
+bool NodeKeys<Traits, KeysLimit>::hasKey(const Key& k) const noexcept{
+	return getIndexOfKey(k) != -1;
+}
+
+//Number of keys less than k, i.e. the position k has or would have in this node
+template<typename Traits, int KeysLimit>
+template<typename K>
+int NodeKeys<Traits, KeysLimit>::lowerBound(const K& k) const noexcept{
+	return NodeSearch<Key, Compare>::lowerBound(keys.data(), numKeys, k);
+}
+
+//Number of keys not greater than k, i.e. the next pointer slot to follow for k
+template<typename Traits, int KeysLimit>
+template<typename K>
+int NodeKeys<Traits, KeysLimit>::upperBound(const K& k) const noexcept{
+	return NodeSearch<Key, Compare>::upperBound(keys.data(), numKeys, k);
+}
+
+//Whether k is stored at a position returned by lowerBound
+template<typename Traits, int KeysLimit>
+template<typename K>
+bool NodeKeys<Traits, KeysLimit>::keyAt(int pos, const K& k) const noexcept{
+	return pos < numKeys && !Compare()(k, keys[pos]);
+}
+
+template<typename Traits, int KeysLimit>
+int NodeKeys<Traits, KeysLimit>::getIndexOfKey(const Key& k) const noexcept{
+	int pos = lowerBound(k);
+	return keyAt(pos, k) ? pos : -1;
+}
+
+template<typename Traits, int KeysLimit>
+bool NodeKeys<Traits, KeysLimit>::isLimitExceeded() const noexcept{
+	return numKeys > KeysLimit;
+}
+
+template<typename Traits, int KeysLimit>
+bool NodeKeys<Traits, KeysLimit>::coalescible(int k) const noexcept{
+	return numKeys + k <= KeysLimit;
+}
+/*===================== End of NodeKeys =======================================*/
+
+
+/*==================== InteriorNode class implementation ==========================*/
+template<typename Traits>
+InteriorNode<Traits>::InteriorNode() : Keys(false){
+	next.fill(nullptr);
+}
+
+template<typename Traits>
+InteriorNode<Traits>::InteriorNode(Base* n) : InteriorNode(){
+	next[0] = n;
+}
+
+template<typename Traits>
+bool InteriorNode<Traits>::isFullEnough() const noexcept{
+	return numKeys + 1 >= Traits::interiorMergeNext;
+}
+
+//Whether a sibling can give up a child and still not need rebalancing itself
+template<typename Traits>
+bool InteriorNode<Traits>::isRedistributable() const noexcept{
+	return numKeys >= Traits::interiorMergeNext;
+}
+
+template<typename Traits>
+void InteriorNode<Traits>::cleanNode() noexcept{
+	next.fill(nullptr);
+	numKeys = 0;
+}
+
+//Insert k at keyPos with newNode right after it: the slot of the split node on the descent path
+template<typename Traits>
+void InteriorNode<Traits>::insertKey(int keyPos, Key&& k, Base* newNode) noexcept{
+	std::move_backward(keys.begin() + keyPos, keys.begin() + numKeys, keys.begin() + numKeys + 1);
+	std::move_backward(next.begin() + keyPos + 1, next.begin() + numKeys + 1, next.begin() + numKeys + 2);
+	keys[keyPos] = std::move(k);
+	next[keyPos + 1] = newNode;
+	++numKeys;
+}
+
+template<typename Traits>
+template<typename K>
+typename InteriorNode<Traits>::Base* InteriorNode<Traits>::getNextNode(const K& k) const noexcept{
+	return next[this->upperBound(k)];
+}
+
+//Keep numOfRemainingKeys keys, by default half, and move all but the separator above them to newSplitNode.
+//Appends keep keysLimit - 1 so the left node stays nearly full and newSplitNode gets one key.
+template<typename Traits>
+typename InteriorNode<Traits>::Key InteriorNode<Traits>::split(InteriorNode* newSplitNode, int numOfRemainingKeys) noexcept{
+	BPTREE_STATS_EVENT(treestats::interiorSplit);
+	static_assert(Traits::interiorRemainingKeys + 1 + Traits::interiorSplitKeys == keysLimit + 1, "Interior split must account for every key");
+	const int numOfSplitKeys = keysLimit - numOfRemainingKeys;
+
+	//Key right after the remaining keys is removed and inserted into node's parent
+	Key removedKey = std::move(keys[numOfRemainingKeys]);
+
+	//Split keys and next node pointers to new node
+	std::move(keys.begin() + numOfRemainingKeys + 1, keys.end(), newSplitNode->keys.begin());
+	std::copy(next.begin() + numOfRemainingKeys + 1, next.end(), newSplitNode->next.begin());
+	std::fill(next.begin() + numOfRemainingKeys + 1, next.end(), nullptr);
+	newSplitNode->numKeys = numOfSplitKeys;
+	numKeys = numOfRemainingKeys;
+
+	return removedKey;
+}
+
+template<typename Traits>
+InteriorNode<Traits>* InteriorNode<Traits>::getLeftSibling(const InteriorNode* par, int idxInParent) noexcept{
+	if(idxInParent <= 0)
+		return nullptr;
+	return static_cast<InteriorNode*>(par->next[idxInParent - 1]);
+}
+
+template<typename Traits>
+InteriorNode<Traits>* InteriorNode<Traits>::getRightSibling(const InteriorNode* par, int idxInParent) noexcept{
+	if(idxInParent >= par->numKeys)
+		return nullptr;
+	return static_cast<InteriorNode*>(par->next[idxInParent + 1]);
+}
+
+//Remove keys[keyPos] together with the next node on its right, then rebalance if needed.
+//That next node has already been emptied by coalescing and is retired on path. The steps above
+//this node are popped off path as the rebalancing climbs.
+template<typename Traits>
+typename InteriorNode<Traits>::Base* InteriorNode<Traits>::removeKey(int keyPos, NodePath<Traits>& path) noexcept{
+	path.retire(next[keyPos + 1]);
+	std::move(keys.begin() + keyPos + 1, keys.begin() + numKeys, keys.begin() + keyPos);
+	std::move(next.begin() + keyPos + 2, next.begin() + numKeys + 1, next.begin() + keyPos + 1);
+	--numKeys;
+	next[numKeys + 1] = nullptr;
+	if(path.empty() || isFullEnough())
+		return this;
+	auto step = path.pop();
+	InteriorNode* leftSibling = getLeftSibling(step.node, step.slot);
+	InteriorNode* rightSibling = getRightSibling(step.node, step.slot);
+
+	if(leftSibling && leftSibling->isRedistributable()){
+		return redistributeLeftInterior(leftSibling, step.node, step.slot);
+	}else if(rightSibling && rightSibling->isRedistributable()){
+		return redistributeRightInterior(rightSibling, step.node, step.slot);
+	}else if(leftSibling && leftSibling->coalescible(numKeys + 1)){
+		return coalescLeftInterior(leftSibling, step.node, step.slot, path);
+	}else if(rightSibling && rightSibling->coalescible(numKeys + 1)){
+		return coalescRightInterior(rightSibling, step.node, step.slot, path);
+	}
+	return this;
+}
+
+template<typename Traits>
+typename InteriorNode<Traits>::Base* InteriorNode<Traits>::redistributeLeftInterior(InteriorNode* sibling, InteriorNode* par, int idxInParent) noexcept{
+	BPTREE_STATS_EVENT(treestats::interiorRedistribute);
+	Key& parentKey = par->keys[idxInParent - 1];
+
+	std::move_backward(keys.begin(), keys.begin() + numKeys, keys.begin() + numKeys + 1);
+	std::move_backward(next.begin(), next.begin() + numKeys + 1, next.begin() + numKeys + 2);
+	keys[0] = std::move(parentKey);
+	parentKey = std::move(sibling->keys[sibling->numKeys - 1]);
+
+	next[0] = sibling->next[sibling->numKeys];
+	sibling->next[sibling->numKeys] = nullptr;
+	--sibling->numKeys;
+	++numKeys;
+	return this;
+}
+
+template<typename Traits>
+typename InteriorNode<Traits>::Base* InteriorNode<Traits>::redistributeRightInterior(InteriorNode* sibling, InteriorNode* par, int idxInParent) noexcept{
+	BPTREE_STATS_EVENT(treestats::interiorRedistribute);
+	Key& parentKey = par->keys[idxInParent];
+
+	keys[numKeys] = std::move(parentKey);
+	parentKey = std::move(sibling->keys[0]);
+	next[numKeys + 1] = sibling->next[0];
+	++numKeys;
+
+	std::move(sibling->keys.begin() + 1, sibling->keys.begin() + sibling->numKeys, sibling->keys.begin());
+	std::move(sibling->next.begin() + 1, sibling->next.begin() + sibling->numKeys + 1, sibling->next.begin());
+	sibling->next[sibling->numKeys] = nullptr;
+	--sibling->numKeys;
+	return this;
+}
+
+//Append this node to its left sibling and drop this node from the parent
+template<typename Traits>
+typename InteriorNode<Traits>::Base* InteriorNode<Traits>::coalescLeftInterior(InteriorNode* sibling, InteriorNode* par, int idxInParent, NodePath<Traits>& path) noexcept{
+	BPTREE_STATS_EVENT(treestats::interiorCoalesce);
+	sibling->keys[sibling->numKeys] = std::move(par->keys[idxInParent - 1]);
+	std::move(keys.begin(), keys.begin() + numKeys, sibling->keys.begin() + sibling->numKeys + 1);
+	std::copy(next.begin(), next.begin() + numKeys + 1, sibling->next.begin() + sibling->numKeys + 1);
+	sibling->numKeys += numKeys + 1;
+	cleanNode();
+
+	return par->removeKey(idxInParent - 1, path); //Retires this node
+}
+
+//Append the right sibling to this node and drop the sibling from the parent
+template<typename Traits>
+typename InteriorNode<Traits>::Base* InteriorNode<Traits>::coalescRightInterior(InteriorNode* sibling, InteriorNode* par, int idxInParent, NodePath<Traits>& path) noexcept{
+	BPTREE_STATS_EVENT(treestats::interiorCoalesce);
+	keys[numKeys] = std::move(par->keys[idxInParent]);
+	std::move(sibling->keys.begin(), sibling->keys.begin() + sibling->numKeys, keys.begin() + numKeys + 1);
+	std::copy(sibling->next.begin(), sibling->next.begin() + sibling->numKeys + 1, next.begin() + numKeys + 1);
+	numKeys += sibling->numKeys + 1;
+	sibling->cleanNode();
+
+	return par->removeKey(idxInParent, path);
+}
+
+/*===================== End of InteriorNode =========================================*/
+
+/*==================== LeafNode class implementation =================================*/
+template<typename Traits>
+LeafNode<Traits>::LeafNode() : Keys(true), nextLeaf(nullptr), prevLeaf(nullptr){
+}
+
+template<typename Traits>
+void LeafNode<Traits>::cleanNode() noexcept{
+	numKeys = 0;
+}
+
+template<typename Traits>
+bool LeafNode<Traits>::isFullEnough() const noexcept{
+	return numKeys >= Traits::leafMergeKeys;
+}
+
+template<typename Traits>
+typename LeafNode<Traits>::Value LeafNode<Traits>::getVal(const Key& k) const noexcept{
+	int keyIndex = this->getIndexOfKey(k);
+	if(keyIndex == -1)
+		return Value();
+	return vals[keyIndex];
+
+}
+
+template<typename Traits>
+std::string LeafNode<Traits>::valsToString() const noexcept{
+	std::ostringstream res;
+	for(int i = 0; i < numKeys; ++i){
+		if(i > 0)
+			res << "\n";
+		res << vals[i];
+	}
+	return res.str();
+}
+
+
+template<typename Traits>
+typename LeafNode<Traits>::Base* LeafNode<Traits>::getNextNode(const Key&) const noexcept{
+	return nextLeaf;
+}
+
+//Insert at keyPos, the lowerBound of k found while checking for duplicates. Rvalues are moved into the slots.
+template<typename Traits>
+template<typename K, typename V>
+void LeafNode<Traits>::insertKey(int keyPos, K&& k, V&& v) noexcept{
+	std::move_backward(keys.begin() + keyPos, keys.begin() + numKeys, keys.begin() + numKeys + 1);
+	std::move_backward(vals.begin() + keyPos, vals.begin() + numKeys, vals.begin() + numKeys + 1);
+	keys[keyPos] = std::forward<K>(k);
+	vals[keyPos] = std::forward<V>(v);
+	++numKeys;
+}
+
+//Keep numOfRemainingKeys keys, by default half, and move the rest to newSplitNode. Appends keep
+//keysLimit so the left leaf stays full.
+template<typename Traits>
+typename LeafNode<Traits>::Key LeafNode<Traits>::split(LeafNode* newSplitNode, int numOfRemainingKeys) noexcept{
+	BPTREE_STATS_EVENT(treestats::leafSplit);
+	const int numOfSplitKeys = keysLimit + 1 - numOfRemainingKeys;
+
+	//Split keys and values to new node
+	std::move(keys.begin() + numOfRemainingKeys, keys.end(), newSplitNode->keys.begin());
+	std::move(vals.begin() + numOfRemainingKeys, vals.end(), newSplitNode->vals.begin());
+	newSplitNode->numKeys = numOfSplitKeys;
+	numKeys = numOfRemainingKeys;
+
+	newSplitNode->nextLeaf = nextLeaf;
+	newSplitNode->prevLeaf = this;
+	nextLeaf = newSplitNode;
+	if(newSplitNode->nextLeaf)
+		newSplitNode->nextLeaf->prevLeaf = newSplitNode;
+	return Traits::separator(keys[numKeys - 1], newSplitNode->keys[0]);
+}
+
+template<typename Traits>
+LeafNode<Traits>* LeafNode<Traits>::getLeftSibling(const InteriorNode<Traits>* par, int idxInParent) noexcept{
+	if(idxInParent <= 0)
+		return nullptr;
+	return static_cast<LeafNode*>(par->next[idxInParent - 1]);
+}
+
+template<typename Traits>
+LeafNode<Traits>* LeafNode<Traits>::getRightSibling(const InteriorNode<Traits>* par, int idxInParent) noexcept{
+	if(idxInParent >= par->numKeys)
+		return nullptr;
+	return static_cast<LeafNode*>(par->next[idxInParent + 1]);
+}
+
+template<typename Traits>
+typename LeafNode<Traits>::Base* LeafNode<Traits>::removeKey(int keyPos, NodePath<Traits>& path) noexcept{
+	std::move(keys.begin() + keyPos + 1, keys.begin() + numKeys, keys.begin() + keyPos);
+	std::move(vals.begin() + keyPos + 1, vals.begin() + numKeys, vals.begin() + keyPos);
+	--numKeys;
+	return rebalance(path);
+}
+
+//Bring a leaf that fell below leafMergeKeys back to leafMinKeys by borrowing from a sibling or merging
+//with one. Borrowing evens out the two leaves, so a leaf left several keys short by a batch is fixed in
+//one step. path is the descent to this leaf.
+template<typename Traits>
+typename LeafNode<Traits>::Base* LeafNode<Traits>::rebalance(NodePath<Traits>& path) noexcept{
+	if(path.empty() || isFullEnough())
+		return this;
+	auto step = path.pop();
+	LeafNode* leftSibling = getLeftSibling(step.node, step.slot);
+	LeafNode* rightSibling = getRightSibling(step.node, step.slot);
+
+	if(leftSibling && leftSibling->numKeys + numKeys >= 2 * Traits::leafMinKeys){
+		return redistributeLeftLeaf(leftSibling, step.node, step.slot, (leftSibling->numKeys - numKeys) / 2);
+	}else if(rightSibling && rightSibling->numKeys + numKeys >= 2 * Traits::leafMinKeys){
+		return redistributeRightLeaf(rightSibling, step.node, step.slot, (rightSibling->numKeys - numKeys) / 2);
+	}else if(leftSibling && leftSibling->coalescible(numKeys)){
+		return coalescLeftLeaf(leftSibling, step.node, step.slot, path);
+	}else if(rightSibling && rightSibling->coalescible(numKeys)){
+		return coalescRightLeaf(rightSibling, step.node, step.slot, path);
+	}
+	return this;
+}
+
+template<typename Traits>
+typename LeafNode<Traits>::Base* LeafNode<Traits>::redistributeLeftLeaf(LeafNode* sibling, InteriorNode<Traits>* par, int idxInParent, int count) noexcept{
+	BPTREE_STATS_EVENT(treestats::leafRedistribute);
+	sibling->numKeys -= count;
+	std::move_backward(keys.begin(), keys.begin() + numKeys, keys.begin() + numKeys + count);
+	std::move_backward(vals.begin(), vals.begin() + numKeys, vals.begin() + numKeys + count);
+	std::move(sibling->keys.begin() + sibling->numKeys, sibling->keys.begin() + sibling->numKeys + count, keys.begin());
+	std::move(sibling->vals.begin() + sibling->numKeys, sibling->vals.begin() + sibling->numKeys + count, vals.begin());
+	numKeys += count;
+
+	par->keys[idxInParent - 1] = Traits::separator(sibling->keys[sibling->numKeys - 1], keys[0]);
+	return this;
+}
+
+template<typename Traits>
+typename LeafNode<Traits>::Base* LeafNode<Traits>::redistributeRightLeaf(LeafNode* sibling, InteriorNode<Traits>* par, int idxInParent, int count) noexcept{
+	BPTREE_STATS_EVENT(treestats::leafRedistribute);
+	std::move(sibling->keys.begin(), sibling->keys.begin() + count, keys.begin() + numKeys);
+	std::move(sibling->vals.begin(), sibling->vals.begin() + count, vals.begin() + numKeys);
+	numKeys += count;
+	std::move(sibling->keys.begin() + count, sibling->keys.begin() + sibling->numKeys, sibling->keys.begin());
+	std::move(sibling->vals.begin() + count, sibling->vals.begin() + sibling->numKeys, sibling->vals.begin());
+	sibling->numKeys -= count;
+
+	par->keys[idxInParent] = Traits::separator(keys[numKeys - 1], sibling->keys[0]);
+	return this;
+
+}
+
+//Append this leaf to its left sibling and drop this leaf from the parent
+template<typename Traits>
+typename LeafNode<Traits>::Base* LeafNode<Traits>::coalescLeftLeaf(LeafNode* sibling, InteriorNode<Traits>* par, int idxInParent, NodePath<Traits>& path) noexcept{
+	BPTREE_STATS_EVENT(treestats::leafCoalesce);
+	std::move(keys.begin(), keys.begin() + numKeys, sibling->keys.begin() + sibling->numKeys);
+	std::move(vals.begin(), vals.begin() + numKeys, sibling->vals.begin() + sibling->numKeys);
+	sibling->numKeys += numKeys;
+
+	sibling->nextLeaf = nextLeaf;
+	if(nextLeaf)
+		nextLeaf->prevLeaf = sibling;
+
+	cleanNode();
+
+	return par->removeKey(idxInParent - 1, path); //Retires this leaf
+}
+
+//Append the right sibling to this leaf and drop the sibling from the parent
+template<typename Traits>
+typename LeafNode<Traits>::Base* LeafNode<Traits>::coalescRightLeaf(LeafNode* sibling, InteriorNode<Traits>* par, int idxInParent, NodePath<Traits>& path) noexcept{
+	BPTREE_STATS_EVENT(treestats::leafCoalesce);
+	std::move(sibling->keys.begin(), sibling->keys.begin() + sibling->numKeys, keys.begin() + numKeys);
+	std::move(sibling->vals.begin(), sibling->vals.begin() + sibling->numKeys, vals.begin() + numKeys);
+	numKeys += sibling->numKeys;
+
+	nextLeaf = sibling->nextLeaf;
+	if(nextLeaf)
+		nextLeaf->prevLeaf = this;
+
+	sibling->cleanNode();
+
+	return par->removeKey(idxInParent, path);
+
+}
 
+/*=======================End of LeafNode ============================================*/
 
 #endif
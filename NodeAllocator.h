@@ -0,0 +1,183 @@
+#ifndef NODE_ALLOCATOR_H
+#define NODE_ALLOCATOR_H
+
+#include<cstddef>
+#include<cstdint>
+#include<new>
+#include<utility>
+#include<vector>
+#include<sys/mman.h>
+
+//Node allocators give BpTree typed create/destroy calls.
+//releasesAll tells the tree that dropping the allocator frees every node it handed out,
+//so trivially destructible trees can skip walking their nodes on teardown.
+
+//Default allocator: every node is its own aligned operator new allocation
+class NewDeleteNodeAllocator{
+	public:
+		static constexpr bool releasesAll = false;
+
+		template<typename T, typename... Args>
+		T* create(Args&&... args){
+			return new T(std::forward<Args>(args)...);
+		}
+
+		template<typename T>
+		void destroy(T* p) noexcept{
+			delete p;
+		}
+};
+
+//Slab arena: nodes are carved out of large chunks with a bump pointer and recycled through one
+//free list per node size, so leaves and interior nodes each reuse their own freed slots.
+//Chunks can be backed by huge pages to cut TLB misses on large trees. All memory is returned
+//at once when the arena is destroyed.
+class ArenaNodeAllocator{
+	public:
+		static constexpr bool releasesAll = true;
+		static constexpr size_t slotAlignment = 64;
+		static constexpr size_t defaultChunkBytes = 2 << 20;
+
+		explicit ArenaNodeAllocator(bool hugePages = false, size_t chunkBytes = defaultChunkBytes) noexcept;
+		ArenaNodeAllocator(const ArenaNodeAllocator&) noexcept; //Copies the settings, not the memory
+		ArenaNodeAllocator& operator=(const ArenaNodeAllocator&) = delete;
+		ArenaNodeAllocator(ArenaNodeAllocator&&) noexcept; //Takes over the chunks, leaving other empty
+		ArenaNodeAllocator& operator=(ArenaNodeAllocator&&) noexcept; //Releases this arena's chunks first
+		~ArenaNodeAllocator();
+
+		template<typename T, typename... Args>
+		T* create(Args&&... args){
+			return new (allocate(sizeof(T))) T(std::forward<Args>(args)...);
+		}
+
+		template<typename T>
+		void destroy(T* p) noexcept{
+			p->~T();
+			deallocate(p, sizeof(T));
+		}
+
+		void* allocate(size_t);
+		void deallocate(void*, size_t) noexcept;
+		void release() noexcept; //Return every chunk to the OS and forget all free lists
+		size_t bytesReserved() const noexcept;
+	private:
+		struct FreeSlot{
+			FreeSlot* next;
+		};
+		struct Chunk{
+			void* base;
+			size_t bytes;
+		};
+		static size_t sizeClass(size_t bytes) noexcept{
+			return (bytes + slotAlignment - 1) / slotAlignment;
+		}
+		Chunk mapChunk(size_t);
+
+		bool hugePages;
+		size_t chunkBytes;
+		char* cursor; //Bump pointer into the newest chunk
+		char* limit;
+		std::vector<FreeSlot*> freeLists; //Indexed by size class
+		std::vector<Chunk> chunks;
+};
+
+/*==================== ArenaNodeAllocator implementation ==========================*/
+inline ArenaNodeAllocator::ArenaNodeAllocator(bool huge, size_t bytes) noexcept
+	: hugePages(huge), chunkBytes(bytes), cursor(nullptr), limit(nullptr){
+}
+
+inline ArenaNodeAllocator::ArenaNodeAllocator(const ArenaNodeAllocator& other) noexcept
+	: ArenaNodeAllocator(other.hugePages, other.chunkBytes){
+}
+
+inline ArenaNodeAllocator::ArenaNodeAllocator(ArenaNodeAllocator&& other) noexcept
+	: hugePages(other.hugePages), chunkBytes(other.chunkBytes), cursor(other.cursor), limit(other.limit),
+	freeLists(std::move(other.freeLists)), chunks(std::move(other.chunks)){
+	other.freeLists.clear();
+	other.chunks.clear();
+	other.cursor = other.limit = nullptr;
+}
+
+inline ArenaNodeAllocator& ArenaNodeAllocator::operator=(ArenaNodeAllocator&& other) noexcept{
+	if(this != &other){
+		release();
+		hugePages = other.hugePages;
+		chunkBytes = other.chunkBytes;
+		cursor = other.cursor;
+		limit = other.limit;
+		freeLists.swap(other.freeLists);
+		chunks.swap(other.chunks);
+		other.cursor = other.limit = nullptr;
+	}
+	return *this;
+}
+
+inline ArenaNodeAllocator::~ArenaNodeAllocator(){
+	release();
+}
+
+inline ArenaNodeAllocator::Chunk ArenaNodeAllocator::mapChunk(size_t bytes){
+	void* base = MAP_FAILED;
+#ifdef MAP_HUGETLB
+	if(hugePages)
+		base = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+	if(base == MAP_FAILED){
+		//No reserved huge pages: fall back to regular pages and ask for transparent huge pages
+		base = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(base == MAP_FAILED)
+			throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+		if(hugePages)
+			madvise(base, bytes, MADV_HUGEPAGE);
+#endif
+	}
+	Chunk chunk = {base, bytes};
+	chunks.push_back(chunk);
+	return chunk;
+}
+
+inline void* ArenaNodeAllocator::allocate(size_t bytes){
+	size_t cls = sizeClass(bytes);
+	if(cls >= freeLists.size())
+		freeLists.resize(cls + 1, nullptr);
+	if(freeLists[cls]){
+		FreeSlot* slot = freeLists[cls];
+		freeLists[cls] = slot->next;
+		return slot;
+	}
+	size_t slotBytes = cls * slotAlignment;
+	if(cursor == nullptr || (size_t)(limit - cursor) < slotBytes){
+		Chunk chunk = mapChunk(slotBytes > chunkBytes ? slotBytes : chunkBytes);
+		cursor = static_cast<char*>(chunk.base);
+		limit = cursor + chunk.bytes;
+	}
+	void* slot = cursor;
+	cursor += slotBytes;
+	return slot;
+}
+
+inline void ArenaNodeAllocator::deallocate(void* p, size_t bytes) noexcept{
+	size_t cls = sizeClass(bytes); //Always below freeLists.size(), the slot came from allocate()
+	FreeSlot* slot = static_cast<FreeSlot*>(p);
+	slot->next = freeLists[cls];
+	freeLists[cls] = slot;
+}
+
+inline void ArenaNodeAllocator::release() noexcept{
+	for(auto& chunk : chunks)
+		munmap(chunk.base, chunk.bytes);
+	chunks.clear();
+	freeLists.clear();
+	cursor = limit = nullptr;
+}
+
+inline size_t ArenaNodeAllocator::bytesReserved() const noexcept{
+	size_t total = 0;
+	for(auto& chunk : chunks)
+		total += chunk.bytes;
+	return total;
+}
+/*===================== End of ArenaNodeAllocator =========================================*/
+
+#endif
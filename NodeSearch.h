@@ -0,0 +1,181 @@
+#ifndef NODE_SEARCH_H
+#define NODE_SEARCH_H
+
+#include<algorithm>
+#include<cstdint>
+#include<functional>
+#include<limits>
+#include<type_traits>
+#if defined(__x86_64__) || defined(__i386__)
+#include<immintrin.h>
+#define BPTREE_X86_SIMD 1
+#endif
+
+//In-node key search. Both searches return a number of keys, which is the key position for a leaf
+//(lowerBound: keys strictly less than k) and the next pointer slot for an interior node
+//(upperBound: keys less than or equal to k), so a node is searched exactly once per visit.
+
+//Generic path: binary search with the tree's comparator. k may be of another type than Key when
+//Compare is transparent (heterogeneous lookup).
+template<typename Key, typename Compare, typename Enable = void>
+struct NodeSearch{
+	template<typename K>
+	static int lowerBound(const Key* keys, int n, const K& k) noexcept{
+		return std::lower_bound(keys, keys + n, k, Compare()) - keys;
+	}
+	template<typename K>
+	static int upperBound(const Key* keys, int n, const K& k) noexcept{
+		return std::upper_bound(keys, keys + n, k, Compare()) - keys;
+	}
+};
+
+namespace nodesearch{
+
+//Window at which binary search hands over to a linear vector count
+constexpr int linearWindow = 32;
+
+//Counts keys below k (or at most k when OrEqual) in a sorted window. Unsigned keys are
+//compared as signed after xoring the sign bit into both sides, which is what bias holds.
+template<typename Int>
+using CountFn = int (*)(const Int*, int, Int, Int);
+
+template<typename Int, bool OrEqual>
+int countScalar(const Int* keys, int n, Int k, Int bias) noexcept{
+	k ^= bias;
+	int count = 0;
+	for(int i = 0; i < n; ++i)
+		count += OrEqual ? (Int)(keys[i] ^ bias) <= k : (Int)(keys[i] ^ bias) < k;
+	return count;
+}
+
+#ifdef BPTREE_X86_SIMD
+template<bool OrEqual>
+__attribute__((target("sse4.2"))) int count64Sse42(const int64_t* keys, int n, int64_t k, int64_t bias) noexcept{
+	const __m128i biasv = _mm_set1_epi64x(bias);
+	const __m128i kv = _mm_set1_epi64x(k ^ bias);
+	int count = 0, i = 0;
+	for(; i + 2 <= n; i += 2){
+		__m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(keys + i)), biasv);
+		__m128i m = OrEqual ? _mm_cmpgt_epi64(v, kv) : _mm_cmpgt_epi64(kv, v);
+		int bits = __builtin_popcount(_mm_movemask_pd(_mm_castsi128_pd(m)));
+		count += OrEqual ? 2 - bits : bits;
+	}
+	return count + countScalar<int64_t, OrEqual>(keys + i, n - i, k, bias);
+}
+
+template<bool OrEqual>
+__attribute__((target("avx2"))) int count64Avx2(const int64_t* keys, int n, int64_t k, int64_t bias) noexcept{
+	const __m256i biasv = _mm256_set1_epi64x(bias);
+	const __m256i kv = _mm256_set1_epi64x(k ^ bias);
+	int count = 0, i = 0;
+	for(; i + 4 <= n; i += 4){
+		__m256i v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(keys + i)), biasv);
+		__m256i m = OrEqual ? _mm256_cmpgt_epi64(v, kv) : _mm256_cmpgt_epi64(kv, v);
+		int bits = __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(m)));
+		count += OrEqual ? 4 - bits : bits;
+	}
+	return count + countScalar<int64_t, OrEqual>(keys + i, n - i, k, bias);
+}
+
+template<bool OrEqual>
+__attribute__((target("sse4.2"))) int count32Sse42(const int32_t* keys, int n, int32_t k, int32_t bias) noexcept{
+	const __m128i biasv = _mm_set1_epi32(bias);
+	const __m128i kv = _mm_set1_epi32(k ^ bias);
+	int count = 0, i = 0;
+	for(; i + 4 <= n; i += 4){
+		__m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(keys + i)), biasv);
+		__m128i m = OrEqual ? _mm_cmpgt_epi32(v, kv) : _mm_cmpgt_epi32(kv, v);
+		int bits = __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(m)));
+		count += OrEqual ? 4 - bits : bits;
+	}
+	return count + countScalar<int32_t, OrEqual>(keys + i, n - i, k, bias);
+}
+
+template<bool OrEqual>
+__attribute__((target("avx2"))) int count32Avx2(const int32_t* keys, int n, int32_t k, int32_t bias) noexcept{
+	const __m256i biasv = _mm256_set1_epi32(bias);
+	const __m256i kv = _mm256_set1_epi32(k ^ bias);
+	int count = 0, i = 0;
+	for(; i + 8 <= n; i += 8){
+		__m256i v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(keys + i)), biasv);
+		__m256i m = OrEqual ? _mm256_cmpgt_epi32(v, kv) : _mm256_cmpgt_epi32(kv, v);
+		int bits = __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(m)));
+		count += OrEqual ? 8 - bits : bits;
+	}
+	return count + countScalar<int32_t, OrEqual>(keys + i, n - i, k, bias);
+}
+#endif
+
+//Picks the widest kernel the running CPU supports, on first use. The choice lives in a function-local
+//static rather than a static member so that trees used by other static initializers never see it unset.
+template<typename Int, bool OrEqual>
+struct Dispatch{
+	static CountFn<Int> select() noexcept{
+#ifdef BPTREE_X86_SIMD
+		__builtin_cpu_init();
+		if(sizeof(Int) == 8){
+			if(__builtin_cpu_supports("avx2"))
+				return (CountFn<Int>)&count64Avx2<OrEqual>;
+			if(__builtin_cpu_supports("sse4.2"))
+				return (CountFn<Int>)&count64Sse42<OrEqual>;
+		}else{
+			if(__builtin_cpu_supports("avx2"))
+				return (CountFn<Int>)&count32Avx2<OrEqual>;
+			if(__builtin_cpu_supports("sse4.2"))
+				return (CountFn<Int>)&count32Sse42<OrEqual>;
+		}
+#endif
+		return &countScalar<Int, OrEqual>;
+	}
+	static CountFn<Int> kernel() noexcept{
+		static const CountFn<Int> fn = select();
+		return fn;
+	}
+};
+
+template<typename Key, typename Compare>
+constexpr bool isVectorSearchable(){
+	return std::is_integral<Key>::value && !std::is_same<Key, bool>::value
+		&& (sizeof(Key) == 4 || sizeof(Key) == 8)
+		&& (std::is_same<Compare, std::less<Key>>::value || std::is_same<Compare, std::less<>>::value);
+}
+
+}
+
+//Integral keys under std::less: binary search narrows the node to a small window,
+//then a compare-and-movemask kernel chosen at startup counts the window in one pass.
+template<typename Key, typename Compare>
+struct NodeSearch<Key, Compare, typename std::enable_if<nodesearch::isVectorSearchable<Key, Compare>()>::type>{
+	typedef typename std::conditional<sizeof(Key) == 8, int64_t, int32_t>::type Int;
+	static constexpr Int bias = std::is_signed<Key>::value ? 0 : std::numeric_limits<Int>::min();
+
+	static int lowerBound(const Key* keys, int n, const Key& k) noexcept{
+		return search<false>(keys, n, k);
+	}
+	static int upperBound(const Key* keys, int n, const Key& k) noexcept{
+		return search<true>(keys, n, k);
+	}
+	//Probes of another type take the generic path
+	template<typename K>
+	static int lowerBound(const Key* keys, int n, const K& k) noexcept{
+		return NodeSearch<Key, Compare, bool>::lowerBound(keys, n, k);
+	}
+	template<typename K>
+	static int upperBound(const Key* keys, int n, const K& k) noexcept{
+		return NodeSearch<Key, Compare, bool>::upperBound(keys, n, k);
+	}
+	private:
+		template<bool OrEqual>
+		static int search(const Key* keys, int n, const Key& k) noexcept{
+			int base = 0;
+			while(n > nodesearch::linearWindow){
+				int half = n / 2;
+				bool goRight = OrEqual ? !(k < keys[base + half]) : keys[base + half] < k;
+				base = goRight ? base + half + 1 : base;
+				n = goRight ? n - half - 1 : half;
+			}
+			return base + nodesearch::Dispatch<Int, OrEqual>::kernel()((const Int*)(keys + base), n, (Int)k, bias);
+		}
+};
+
+#endif
@@ -0,0 +1,619 @@
+#ifndef OLC_BPTREE_H
+#define OLC_BPTREE_H
+
+#include "Node.h"
+#include "Epoch.h"
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <type_traits>
+#ifdef BPTREE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+//Thread-safe B+ tree using optimistic lock coupling (OLC).
+//Every node carries a version latch. Readers never write shared memory: they record a node's version,
+//read the node and re-check the version, restarting from the root if a writer got in between.
+//Writers upgrade only the versions of the nodes they change: the leaf for a plain insert or remove,
+//plus the parent for a split or merge. Full nodes are split on the way down, so a split never
+//propagates upwards. Underfull leaves are merged with a sibling; interior nodes only shrink, and
+//a root left with a single child is replaced by it.
+//Nodes may be read by optimistic readers after they are unlinked, so every operation runs inside an
+//epoch guard and unlinked nodes are retired to the EpochManager, which frees them once all readers
+//that could have seen them have left. Keys and values must be trivially copyable because readers may copy them
+//while a writer is changing them and only use the copy once the version check has passed.
+
+//Version latch: counter in the high bits, locked bit (2) and obsolete bit (1)
+class OptLock{
+	public:
+		OptLock() noexcept : version(0){
+		}
+		static bool isLocked(uint64_t v) noexcept{
+			return (v & 2) == 2;
+		}
+		static bool isObsolete(uint64_t v) noexcept{
+			return (v & 1) == 1;
+		}
+		uint64_t readLockOrRestart(bool& needRestart) const noexcept{
+			uint64_t v = awaitUnlocked();
+			if(isObsolete(v))
+				needRestart = true;
+			return v;
+		}
+		//Fails if anything was written to the node since v was read
+		void readUnlockOrRestart(uint64_t v, bool& needRestart) const noexcept{
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if(v != version.load(std::memory_order_relaxed))
+				needRestart = true;
+		}
+		void checkOrRestart(uint64_t v, bool& needRestart) const noexcept{
+			readUnlockOrRestart(v, needRestart);
+		}
+		void upgradeToWriteLockOrRestart(uint64_t& v, bool& needRestart) noexcept{
+			if(version.compare_exchange_strong(v, v + 2, std::memory_order_acquire))
+				v += 2;
+			else
+				needRestart = true;
+		}
+		//Blocking acquire, used for siblings while their parent is already write locked
+		void writeLockOrRestart(bool& needRestart) noexcept{
+			for(;;){
+				uint64_t v = readLockOrRestart(needRestart);
+				if(needRestart)
+					return;
+				if(version.compare_exchange_weak(v, v + 2, std::memory_order_acquire))
+					return;
+			}
+		}
+		void writeUnlock() noexcept{
+			version.fetch_add(2, std::memory_order_release);
+		}
+		void writeUnlockObsolete() noexcept{
+			version.fetch_add(3, std::memory_order_release);
+		}
+	private:
+		uint64_t awaitUnlocked() const noexcept{
+			uint64_t v = version.load(std::memory_order_acquire);
+			for(int spins = 0; isLocked(v); ++spins){
+				if(spins < 64){
+#ifdef BPTREE_X86_SIMD
+					_mm_pause();
+#endif
+				}else{
+					std::this_thread::yield();
+				}
+				v = version.load(std::memory_order_acquire);
+			}
+			return v;
+		}
+
+		std::atomic<uint64_t> version;
+};
+
+template<typename Traits>
+class alignas(Traits::cacheLineSize) OlcNode{
+	public:
+		typedef typename Traits::KeyType Key;
+		typedef typename Traits::KeyCompare Compare;
+		static constexpr int keysLimit = Traits::keysLimit;
+
+		explicit OlcNode(bool isLeaf) noexcept : numKeys(0), leaf(isLeaf){
+		}
+		bool isLeafNode() const noexcept{
+			return leaf;
+		}
+		//Key count clamped to the array, since an optimistic reader may see a count being changed
+		int size() const noexcept{
+			int n = numKeys;
+			return n < 0 ? 0 : (n > keysLimit ? keysLimit : n);
+		}
+		int lowerBound(const Key& k) const noexcept{
+			return NodeSearch<Key, Compare>::lowerBound(keys.data(), size(), k);
+		}
+		int upperBound(const Key& k) const noexcept{
+			return NodeSearch<Key, Compare>::upperBound(keys.data(), size(), k);
+		}
+		static bool keyLess(const Key& a, const Key& b) noexcept{
+			return Compare()(a, b);
+		}
+
+		OptLock lock;
+		int numKeys;
+		bool leaf;
+		std::array<Key, keysLimit> keys;
+};
+
+template<typename Traits>
+class OlcInteriorNode : public OlcNode<Traits>{
+	public:
+		typedef OlcNode<Traits> Base;
+		typedef typename Base::Key Key;
+		using Base::keysLimit;
+		using Base::numKeys;
+		using Base::keys;
+
+		OlcInteriorNode() noexcept : Base(false){
+			next.fill(nullptr);
+		}
+		bool isFull() const noexcept{
+			return numKeys == keysLimit;
+		}
+		void insertKey(const Key& k, Base* child) noexcept{
+			int pos = this->upperBound(k);
+			std::move_backward(keys.begin() + pos, keys.begin() + numKeys, keys.begin() + numKeys + 1);
+			std::move_backward(next.begin() + pos + 1, next.begin() + numKeys + 1, next.begin() + numKeys + 2);
+			keys[pos] = k;
+			next[pos + 1] = child;
+			++numKeys;
+		}
+		//Remove keys[pos] and the next pointer on its right
+		void removeKey(int pos) noexcept{
+			std::move(keys.begin() + pos + 1, keys.begin() + numKeys, keys.begin() + pos);
+			std::move(next.begin() + pos + 2, next.begin() + numKeys + 1, next.begin() + pos + 1);
+			--numKeys;
+		}
+		//Move the upper half into newSplitNode and return the key to push into the parent
+		Key split(OlcInteriorNode* newSplitNode) noexcept{
+			constexpr int numOfRemainingKeys = keysLimit / 2;
+			constexpr int numOfSplitKeys = keysLimit - numOfRemainingKeys - 1;
+			std::copy(keys.begin() + numOfRemainingKeys + 1, keys.end(), newSplitNode->keys.begin());
+			std::copy(next.begin() + numOfRemainingKeys + 1, next.end(), newSplitNode->next.begin());
+			newSplitNode->numKeys = numOfSplitKeys;
+			numKeys = numOfRemainingKeys;
+			return keys[numOfRemainingKeys];
+		}
+		int slotOf(const Base* child) const noexcept{
+			for(int i = 0; i <= numKeys; ++i){
+				if(next[i] == child)
+					return i;
+			}
+			return -1;
+		}
+
+		std::array<Base*, keysLimit + 1> next;
+};
+
+template<typename Traits>
+class OlcLeafNode : public OlcNode<Traits>{
+	public:
+		typedef OlcNode<Traits> Base;
+		typedef typename Base::Key Key;
+		typedef typename Traits::ValueType Value;
+		using Base::keysLimit;
+		using Base::numKeys;
+		using Base::keys;
+
+		OlcLeafNode() noexcept : Base(true), nextLeaf(nullptr){
+		}
+		bool isFull() const noexcept{
+			return numKeys == keysLimit;
+		}
+		void insertKey(int pos, const Key& k, const Value& v) noexcept{
+			std::move_backward(keys.begin() + pos, keys.begin() + numKeys, keys.begin() + numKeys + 1);
+			std::move_backward(vals.begin() + pos, vals.begin() + numKeys, vals.begin() + numKeys + 1);
+			keys[pos] = k;
+			vals[pos] = v;
+			++numKeys;
+		}
+		void removeKey(int pos) noexcept{
+			std::move(keys.begin() + pos + 1, keys.begin() + numKeys, keys.begin() + pos);
+			std::move(vals.begin() + pos + 1, vals.begin() + numKeys, vals.begin() + pos);
+			--numKeys;
+		}
+		//Move the upper half into newSplitNode, link it after this leaf and return its first key
+		Key split(OlcLeafNode* newSplitNode) noexcept{
+			constexpr int numOfRemainingKeys = (keysLimit + 1) / 2;
+			std::copy(keys.begin() + numOfRemainingKeys, keys.end(), newSplitNode->keys.begin());
+			std::copy(vals.begin() + numOfRemainingKeys, vals.end(), newSplitNode->vals.begin());
+			newSplitNode->numKeys = keysLimit - numOfRemainingKeys;
+			numKeys = numOfRemainingKeys;
+			newSplitNode->nextLeaf = nextLeaf;
+			nextLeaf = newSplitNode;
+			return newSplitNode->keys[0];
+		}
+
+		OlcLeafNode* nextLeaf;
+		std::array<Value, keysLimit> vals;
+};
+
+template<typename Key, typename Value, typename Compare = std::less<Key>, int KeysLimit = fanoutForBytes<Key, Value>(1024)>
+class OlcBpTree{
+	static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+			"Optimistic readers copy keys and values while they may be changing");
+	public:
+		typedef NodeTraits<Key, Value, Compare, KeysLimit> Traits;
+		typedef OlcNode<Traits> Node;
+		typedef OlcInteriorNode<Traits> InteriorNode;
+		typedef OlcLeafNode<Traits> LeafNode;
+		static constexpr int keysLimit = KeysLimit;
+		static constexpr int mergeThreshold = KeysLimit / 4; //Leaves with fewer keys try to merge with a sibling
+
+		OlcBpTree();
+		OlcBpTree(const OlcBpTree&) = delete;
+		OlcBpTree& operator=(const OlcBpTree&) = delete;
+		~OlcBpTree();
+		bool insert(const Key&, const Value&) noexcept;
+		bool remove(const Key&) noexcept;
+		bool find(const Key&, Value&) const noexcept;
+		//Call fn(key, value) for keys in [lo, hi) in ascending order. Entries are copied out of each
+		//leaf and validated before fn sees them; if fn returns bool, false stops the scan.
+		template<typename Fn>
+		void scan(const Key& lo, const Key& hi, Fn&& fn) const;
+	private:
+		LeafNode* findLeaf(const Key&, uint64_t&) const noexcept;
+		void makeRoot(const Key&, Node*, Node*) noexcept;
+		void mergeLeaf(InteriorNode*, LeafNode*) noexcept;
+		void retire(Node*) noexcept;
+		void destroySubtree(Node*) noexcept;
+		static void destroyNode(Node*) noexcept;
+		static void reclaimNode(void*) noexcept;
+
+		std::atomic<Node*> root;
+		mutable EpochManager epochs; //Readers enter it too, so it is mutable
+};
+
+template<typename Key, typename Value, typename Compare, int KeysLimit>
+OlcBpTree<Key, Value, Compare, KeysLimit>::OlcBpTree() : root(new LeafNode()){
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit>
+OlcBpTree<Key, Value, Compare, KeysLimit>::~OlcBpTree(){
+	destroySubtree(root.load());
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit>
+void OlcBpTree<Key, Value, Compare, KeysLimit>::destroyNode(Node* node) noexcept{
+	if(node->isLeafNode())
+		delete static_cast<LeafNode*>(node);
+	else
+		delete static_cast<InteriorNode*>(node);
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit>
+void OlcBpTree<Key, Value, Compare, KeysLimit>::destroySubtree(Node* node) noexcept{
+	if(!node->isLeafNode()){
+		auto interior = static_cast<InteriorNode*>(node);
+		for(int i = 0; i <= interior->numKeys; ++i)
+			destroySubtree(interior->next[i]);
+	}
+	destroyNode(node);
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit>
+void OlcBpTree<Key, Value, Compare, KeysLimit>::reclaimNode(void* node) noexcept{
+	destroyNode(static_cast<Node*>(node));
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit>
+void OlcBpTree<Key, Value, Compare, KeysLimit>::retire(Node* node) noexcept{
+	epochs.retire(node, &reclaimNode);
+}
+
+//Called with the old root write locked
+template<typename Key, typename Value, typename Compare, int KeysLimit>
+void OlcBpTree<Key, Value, Compare, KeysLimit>::makeRoot(const Key& k, Node* left, Node* right) noexcept{
+	InteriorNode* newRoot = new InteriorNode();
+	newRoot->keys[0] = k;
+	newRoot->next[0] = left;
+	newRoot->next[1] = right;
+	newRoot->numKeys = 1;
+	root.store(newRoot, std::memory_order_release);
+}
+
+//Descend to the leaf for k, coupling version checks from parent to child. Returns the leaf and
+//its version; the caller validates that version after reading the leaf.
+template<typename Key, typename Value, typename Compare, int KeysLimit>
+typename OlcBpTree<Key, Value, Compare, KeysLimit>::LeafNode* OlcBpTree<Key, Value, Compare, KeysLimit>::findLeaf(const Key& k, uint64_t& version) const noexcept{
+	for(;;){
+		bool needRestart = false;
+		Node* node = root.load(std::memory_order_acquire);
+		uint64_t v = node->lock.readLockOrRestart(needRestart);
+		if(needRestart || node != root.load(std::memory_order_acquire))
+			continue;
+		while(!node->isLeafNode() && !needRestart){
+			InteriorNode* interior = static_cast<InteriorNode*>(node);
+			uint64_t interiorVersion = v;
+			Node* child = interior->next[interior->upperBound(k)];
+			interior->lock.checkOrRestart(interiorVersion, needRestart);
+			if(needRestart)
+				break;
+			v = child->lock.readLockOrRestart(needRestart);
+			//A split of the child also changes this node, so checking it again after reading the
+			//child's version proves k was routed to the right child at that version
+			interior->lock.checkOrRestart(interiorVersion, needRestart);
+			node = child;
+		}
+		if(needRestart)
+			continue;
+		version = v;
+		return static_cast<LeafNode*>(node);
+	}
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit>
+bool OlcBpTree<Key, Value, Compare, KeysLimit>::find(const Key& k, Value& out) const noexcept{
+	EpochManager::Guard guard(epochs);
+	for(;;){
+		uint64_t v;
+		LeafNode* leaf = findLeaf(k, v);
+		int pos = leaf->lowerBound(k);
+		bool found = pos < leaf->size() && !Node::keyLess(k, leaf->keys[pos]);
+		Value val = found ? leaf->vals[pos] : Value();
+		bool needRestart = false;
+		leaf->lock.readUnlockOrRestart(v, needRestart);
+		if(needRestart)
+			continue;
+		if(found)
+			out = val;
+		return found;
+	}
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit>
+bool OlcBpTree<Key, Value, Compare, KeysLimit>::insert(const Key& k, const Value& val) noexcept{
+	EpochManager::Guard guard(epochs);
+	for(;;){
+		bool needRestart = false;
+		Node* node = root.load(std::memory_order_acquire);
+		uint64_t v = node->lock.readLockOrRestart(needRestart);
+		if(needRestart || node != root.load(std::memory_order_acquire))
+			continue;
+		InteriorNode* parent = nullptr;
+		uint64_t parentVersion = 0;
+
+		bool split = false;
+		while(!node->isLeafNode()){
+			InteriorNode* interior = static_cast<InteriorNode*>(node);
+			if(interior->isFull()){
+				//Split full interior nodes on the way down so the parent always has room
+				if(parent){
+					parent->lock.upgradeToWriteLockOrRestart(parentVersion, needRestart);
+					if(needRestart)
+						break;
+				}
+				interior->lock.upgradeToWriteLockOrRestart(v, needRestart);
+				if(needRestart){
+					if(parent)
+						parent->lock.writeUnlock();
+					break;
+				}
+				if(!parent && node != root.load(std::memory_order_acquire)){
+					interior->lock.writeUnlock();
+					needRestart = true;
+					break;
+				}
+				InteriorNode* newSplitNode = new InteriorNode();
+				Key splitKey = interior->split(newSplitNode);
+				if(parent)
+					parent->insertKey(splitKey, newSplitNode);
+				else
+					makeRoot(splitKey, interior, newSplitNode);
+				interior->lock.writeUnlock();
+				if(parent)
+					parent->lock.writeUnlock();
+				split = true;
+				break;
+			}
+			if(parent){
+				parent->lock.readUnlockOrRestart(parentVersion, needRestart);
+				if(needRestart)
+					break;
+			}
+			parent = interior;
+			parentVersion = v;
+			node = interior->next[interior->upperBound(k)];
+			interior->lock.checkOrRestart(v, needRestart);
+			if(needRestart)
+				break;
+			v = node->lock.readLockOrRestart(needRestart);
+			if(needRestart)
+				break;
+			interior->lock.checkOrRestart(parentVersion, needRestart);
+			if(needRestart)
+				break;
+		}
+		if(needRestart || split)
+			continue;
+
+		LeafNode* leaf = static_cast<LeafNode*>(node);
+		int pos = leaf->lowerBound(k);
+		if(pos < leaf->size() && !Node::keyLess(k, leaf->keys[pos])){ //Duplicated key
+			leaf->lock.readUnlockOrRestart(v, needRestart);
+			if(needRestart)
+				continue;
+			return false;
+		}
+		if(!leaf->isFull()){
+			leaf->lock.upgradeToWriteLockOrRestart(v, needRestart);
+			if(needRestart)
+				continue;
+			leaf->insertKey(pos, k, val);
+			leaf->lock.writeUnlock();
+			return true;
+		}
+
+		//Full leaf: split it under the parent's lock and retry the insert
+		if(parent){
+			parent->lock.upgradeToWriteLockOrRestart(parentVersion, needRestart);
+			if(needRestart)
+				continue;
+		}
+		leaf->lock.upgradeToWriteLockOrRestart(v, needRestart);
+		if(needRestart){
+			if(parent)
+				parent->lock.writeUnlock();
+			continue;
+		}
+		if(!parent && node != root.load(std::memory_order_acquire)){
+			leaf->lock.writeUnlock();
+			continue;
+		}
+		LeafNode* newSplitNode = new LeafNode();
+		Key splitKey = leaf->split(newSplitNode);
+		if(parent)
+			parent->insertKey(splitKey, newSplitNode);
+		else
+			makeRoot(splitKey, leaf, newSplitNode);
+		leaf->lock.writeUnlock();
+		if(parent)
+			parent->lock.writeUnlock();
+	}
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit>
+bool OlcBpTree<Key, Value, Compare, KeysLimit>::remove(const Key& k) noexcept{
+	EpochManager::Guard guard(epochs);
+	for(;;){
+		bool needRestart = false;
+		Node* node = root.load(std::memory_order_acquire);
+		uint64_t v = node->lock.readLockOrRestart(needRestart);
+		if(needRestart || node != root.load(std::memory_order_acquire))
+			continue;
+		InteriorNode* parent = nullptr;
+		uint64_t parentVersion = 0;
+		while(!node->isLeafNode()){
+			InteriorNode* interior = static_cast<InteriorNode*>(node);
+			if(parent){
+				parent->lock.readUnlockOrRestart(parentVersion, needRestart);
+				if(needRestart)
+					break;
+			}
+			parent = interior;
+			parentVersion = v;
+			node = interior->next[interior->upperBound(k)];
+			interior->lock.checkOrRestart(v, needRestart);
+			if(needRestart)
+				break;
+			v = node->lock.readLockOrRestart(needRestart);
+			if(needRestart)
+				break;
+			interior->lock.checkOrRestart(parentVersion, needRestart);
+			if(needRestart)
+				break;
+		}
+		if(needRestart)
+			continue;
+
+		LeafNode* leaf = static_cast<LeafNode*>(node);
+		int pos = leaf->lowerBound(k);
+		if(pos >= leaf->size() || Node::keyLess(k, leaf->keys[pos])){
+			leaf->lock.readUnlockOrRestart(v, needRestart);
+			if(needRestart)
+				continue;
+			return false;
+		}
+		if(!parent || leaf->numKeys - 1 >= mergeThreshold){
+			leaf->lock.upgradeToWriteLockOrRestart(v, needRestart);
+			if(needRestart)
+				continue;
+			leaf->removeKey(pos);
+			leaf->lock.writeUnlock();
+			return true;
+		}
+
+		//The leaf becomes underfull: take the parent too so it can be merged with a sibling
+		parent->lock.upgradeToWriteLockOrRestart(parentVersion, needRestart);
+		if(needRestart)
+			continue;
+		leaf->lock.upgradeToWriteLockOrRestart(v, needRestart);
+		if(needRestart){
+			parent->lock.writeUnlock();
+			continue;
+		}
+		leaf->removeKey(pos);
+		mergeLeaf(parent, leaf);
+		return true;
+	}
+}
+
+//Merge leaf with a sibling if they fit in one node, then release both locks. Called with parent and
+//leaf write locked. The right node of the pair is unlinked, marked obsolete and retired.
+template<typename Key, typename Value, typename Compare, int KeysLimit>
+void OlcBpTree<Key, Value, Compare, KeysLimit>::mergeLeaf(InteriorNode* parent, LeafNode* leaf) noexcept{
+	int slot = parent->slotOf(leaf);
+	if(parent->numKeys == 0 || slot < 0){
+		leaf->lock.writeUnlock();
+		parent->lock.writeUnlock();
+		return;
+	}
+	int sepPos = slot < parent->numKeys ? slot : slot - 1;
+	LeafNode* sibling = static_cast<LeafNode*>(parent->next[slot < parent->numKeys ? slot + 1 : slot - 1]);
+	bool needRestart = false;
+	sibling->lock.writeLockOrRestart(needRestart); //A child cannot become obsolete while its parent is locked
+	LeafNode* left = static_cast<LeafNode*>(parent->next[sepPos]);
+	LeafNode* right = static_cast<LeafNode*>(parent->next[sepPos + 1]);
+
+	if(left->numKeys + right->numKeys > keysLimit){
+		sibling->lock.writeUnlock();
+		leaf->lock.writeUnlock();
+		parent->lock.writeUnlock();
+		return;
+	}
+	std::copy(right->keys.begin(), right->keys.begin() + right->numKeys, left->keys.begin() + left->numKeys);
+	std::copy(right->vals.begin(), right->vals.begin() + right->numKeys, left->vals.begin() + left->numKeys);
+	left->numKeys += right->numKeys;
+	left->nextLeaf = right->nextLeaf;
+	parent->removeKey(sepPos);
+	left->lock.writeUnlock();
+	right->lock.writeUnlockObsolete();
+	retire(right);
+
+	//A root left with one next node is replaced by that node
+	if(parent->numKeys == 0 && parent == root.load(std::memory_order_acquire)){
+		root.store(parent->next[0], std::memory_order_release);
+		parent->lock.writeUnlockObsolete();
+		retire(parent);
+		return;
+	}
+	parent->lock.writeUnlock();
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit>
+template<typename Fn>
+void OlcBpTree<Key, Value, Compare, KeysLimit>::scan(const Key& lo, const Key& hi, Fn&& fn) const{
+	std::array<Key, KeysLimit> keyCopies;
+	std::array<Value, KeysLimit> valCopies;
+	EpochManager::Guard guard(epochs); //Held across fn, so a slow callback delays reclamation
+	Key cursor = lo;
+	bool inclusive = true; //Whether cursor itself is still to be visited
+	for(;;){
+		uint64_t v;
+		LeafNode* leaf = findLeaf(cursor, v);
+		for(;;){
+			int pos = inclusive ? leaf->lowerBound(cursor) : leaf->upperBound(cursor);
+			int n = leaf->size();
+			int count = 0;
+			for(; pos < n && Node::keyLess(leaf->keys[pos], hi); ++pos, ++count){
+				keyCopies[count] = leaf->keys[pos];
+				valCopies[count] = leaf->vals[pos];
+			}
+			bool reachedHi = pos < n;
+			LeafNode* nextLeaf = leaf->nextLeaf;
+			bool needRestart = false;
+			leaf->lock.readUnlockOrRestart(v, needRestart);
+			if(needRestart)
+				break;
+			for(int i = 0; i < count; ++i){
+				cursor = keyCopies[i];
+				inclusive = false;
+				bool keepGoing = true;
+				if constexpr(std::is_void<decltype(fn(keyCopies[i], valCopies[i]))>::value)
+					fn(static_cast<const Key&>(keyCopies[i]), static_cast<const Value&>(valCopies[i]));
+				else
+					keepGoing = static_cast<bool>(fn(static_cast<const Key&>(keyCopies[i]), static_cast<const Value&>(valCopies[i])));
+				if(!keepGoing)
+					return;
+			}
+			if(reachedHi || !nextLeaf)
+				return;
+			//nextLeaf was read before validating this leaf, so it was the successor at that version.
+			//If it has since been merged away it is obsolete and the scan resumes from the root.
+			v = nextLeaf->lock.readLockOrRestart(needRestart);
+			if(needRestart)
+				break;
+			leaf = nextLeaf;
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef OP_TRACE_H
+#define OP_TRACE_H
+
+#include<cstddef>
+#include<cstdint>
+#include<cstdio>
+#include<type_traits>
+#include<vector>
+#include<sys/stat.h>
+
+//A recorded sequence of tree operations that can be saved, loaded and replayed against any BpTree.
+//bench/tune_bench.cpp replays a trace against trees of several capacities and fill policies (see
+//NodePolicy in Node.h) and recommends the one that serves it fastest. Only keys are recorded; replayed
+//inserts store default-constructed values. Keys are written as raw bytes, so they must be trivially
+//copyable, and a trace file only loads for keys of the same size.
+template<typename Key>
+class OpTrace{
+	static_assert(std::is_trivially_copyable<Key>::value, "Trace keys are written as raw bytes");
+	public:
+		enum Type : uint8_t{
+			insertOp,
+			removeOp,
+			findOp,
+			scanOp
+		};
+		struct Op{
+			Type type;
+			Key key;
+			Key hi; //End of a scan, otherwise key
+		};
+
+		void insert(const Key& k){
+			ops.push_back(Op{insertOp, k, k});
+		}
+		void remove(const Key& k){
+			ops.push_back(Op{removeOp, k, k});
+		}
+		void find(const Key& k){
+			ops.push_back(Op{findOp, k, k});
+		}
+		void scan(const Key& lo, const Key& hi){ //Keys in [lo, hi)
+			ops.push_back(Op{scanOp, lo, hi});
+		}
+		void clear() noexcept{
+			ops.clear();
+		}
+		size_t size() const noexcept{
+			return ops.size();
+		}
+		const std::vector<Op>& operations() const noexcept{
+			return ops;
+		}
+		bool save(const char* path) const; //false if the file cannot be written
+		bool load(const char* path); //false, leaving the trace empty, if the file is unreadable, truncated or holds other keys
+		//Apply the operations to tree in order. Returns the number of keys finds and scans came across.
+		template<typename Tree>
+		size_t replay(Tree&) const;
+	private:
+		struct FileHeader{
+			uint64_t magic;
+			uint32_t formatVersion;
+			uint32_t keyBytes;
+			uint64_t numOps;
+		};
+		static constexpr uint64_t fileMagic = 0x3145434152545042ull; //"BPTRACE1"
+		static constexpr uint32_t formatVersion = 1;
+
+		std::vector<Op> ops;
+};
+
+/*==================== OpTrace implementation ==========================*/
+//Each operation is its type byte followed by key and hi, so no padding reaches the file
+template<typename Key>
+bool OpTrace<Key>::save(const char* path) const{
+	FILE* out = fopen(path, "wb");
+	if(!out)
+		return false;
+	FileHeader header{fileMagic, formatVersion, (uint32_t)sizeof(Key), ops.size()};
+	bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+	for(size_t i = 0; ok && i < ops.size(); ++i){
+		ok = fwrite(&ops[i].type, 1, 1, out) == 1 && fwrite(&ops[i].key, sizeof(Key), 1, out) == 1
+				&& fwrite(&ops[i].hi, sizeof(Key), 1, out) == 1;
+	}
+	return fclose(out) == 0 && ok;
+}
+
+template<typename Key>
+bool OpTrace<Key>::load(const char* path){
+	ops.clear();
+	FILE* in = fopen(path, "rb");
+	if(!in)
+		return false;
+	//The operation count must match the file's size before it sizes anything
+	const uint64_t opBytes = 1 + 2 * sizeof(Key);
+	struct stat st;
+	FileHeader header;
+	bool ok = fstat(fileno(in), &st) == 0 && fread(&header, sizeof(header), 1, in) == 1 && header.magic == fileMagic
+			&& header.formatVersion == formatVersion && header.keyBytes == sizeof(Key)
+			&& (uint64_t)st.st_size - sizeof(header) == header.numOps * opBytes && header.numOps <= (uint64_t)st.st_size / opBytes;
+	if(ok)
+		ops.resize(header.numOps);
+	for(size_t i = 0; ok && i < ops.size(); ++i){
+		ok = fread(&ops[i].type, 1, 1, in) == 1 && ops[i].type <= scanOp && fread(&ops[i].key, sizeof(Key), 1, in) == 1
+				&& fread(&ops[i].hi, sizeof(Key), 1, in) == 1;
+	}
+	fclose(in);
+	if(!ok)
+		ops.clear();
+	return ok;
+}
+
+template<typename Key>
+template<typename Tree>
+size_t OpTrace<Key>::replay(Tree& tree) const{
+	typedef typename Tree::Traits::ValueType Value;
+	size_t seen = 0;
+	for(const Op& op : ops){
+		switch(op.type){
+			case insertOp:
+				tree.insert(op.key, Value());
+				break;
+			case removeOp:
+				tree.remove(op.key);
+				break;
+			case findOp:
+				seen += tree.findPtr(op.key) != nullptr;
+				break;
+			case scanOp:
+				tree.scan(op.key, op.hi, [&seen](const Key&, const Value&){
+					++seen;
+				});
+				break;
+		}
+	}
+	return seen;
+}
+/*===================== End of OpTrace =========================================*/
+
+#endif
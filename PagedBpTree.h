@@ -0,0 +1,734 @@
+#ifndef PAGED_BPTREE_H
+#define PAGED_BPTREE_H
+
+#include "BufferPool.h"
+#include "NodeSearch.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+//Disk-backed B+ tree. Every node is one BufferPool page and refers to other nodes by page id, so the
+//index survives restarts and can be larger than memory: only pages held by the buffer pool are resident.
+//Page 0 holds the file header (format, key and value sizes, root page, free page list); opening an
+//existing file reads only that page. Pages emptied by merges go onto a free list and are reused by splits.
+//Pages carry no parent ids: insert and remove remember the (page, slot) path taken from the root and
+//walk it back up for splits and merges. A page is pinned for as long as it is read or changed.
+//Changes reach the file when pages are evicted and on flush() or close(); a crash in between can
+//lose or tear recent changes. Keys and values are stored as raw bytes, so both must be trivially copyable.
+//Given an AsyncIo, findAsync and scanAsync descend without blocking on page reads, so many lookups keep
+//their reads in flight together; scans read the next leaves under the current parent ahead of the cursor.
+template<typename Key, typename Value, typename Compare = std::less<Key>>
+class PagedBpTree{
+	static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+			"Keys and values are copied to and from pages as raw bytes");
+	public:
+		typedef BufferPool::PageId PageId;
+		static constexpr size_t pageSize = BufferPool::pageSize;
+
+		explicit PagedBpTree(size_t poolFrames = BufferPool::defaultFrames);
+		PagedBpTree(const PagedBpTree&) = delete;
+		PagedBpTree& operator=(const PagedBpTree&) = delete;
+		~PagedBpTree();
+		//Open an index file, starting an empty index if the file is new or empty. Returns false if the
+		//file cannot be opened or was written for other key, value or page sizes.
+		bool open(const char* path, bool directIo = false); //directIo as in BufferPool::open
+		void close(); //Finishes outstanding asynchronous operations first
+		void flush(); //Write the header and every dirty page, then sync the file
+		bool isOpen() const noexcept{
+			return pool.isOpen();
+		}
+		bool insert(const Key&, const Value&);
+		bool remove(const Key&);
+		bool find(const Key&, Value&);
+		//Call fn(key, value) for keys in [lo, hi) in ascending order. If fn returns bool, false stops the scan.
+		template<typename Fn>
+		void scan(const Key& lo, const Key& hi, Fn&& fn);
+		uint64_t size() const noexcept{
+			return header.numEntries;
+		}
+
+		//Asynchronous reads through io, which also batches write-back (see BufferPool). Operations start
+		//on the next poll(), wait() or drain(), and their callbacks run inside those calls on this thread.
+		//Each operation pins one page at a time and a scan reads up to prefetchLeaves more, so the pool
+		//needs more frames than that many pages outstanding. insert and remove must not be called while
+		//operations are outstanding; drain() first.
+		void setAsyncIo(AsyncIo* io) noexcept{
+			pool.setAsyncIo(io);
+		}
+		//done(ok, found, value), with a default-constructed value when k is missing. ok is false, and found
+		//with it, when a page on the way could not be read.
+		template<typename Done>
+		void findAsync(const Key& k, Done&& done);
+		//fn(key, value) for keys in [lo, hi) in ascending order as in scan, then done(ok). ok is false when
+		//a failed page read cut the scan short, after fn saw the keys before that page.
+		template<typename Fn, typename Done>
+		void scanAsync(const Key& lo, const Key& hi, Fn&& fn, Done&& done);
+		size_t poll(); //Step the operations whose pages arrived; returns how many finished
+		size_t wait(); //poll(), blocking until an operation finishes unless none is outstanding
+		void drain(); //Finish every outstanding operation
+		size_t outstanding() const noexcept{
+			return numAsyncOps;
+		}
+		static constexpr size_t prefetchLeaves = 8;
+
+		const BufferPool& bufferPool() const noexcept{
+			return pool;
+		}
+	private:
+		struct FileHeader{
+			uint64_t magic;
+			uint32_t formatVersion;
+			uint32_t pageBytes;
+			uint32_t keyBytes;
+			uint32_t valueBytes;
+			PageId root;
+			PageId freeList; //First free page; free pages chain through nextLeaf
+			uint64_t numEntries;
+		};
+		struct PageHeader{
+			uint32_t leaf;
+			uint32_t numKeys;
+			PageId nextLeaf; //0, the header page, stands for none
+			PageId prevLeaf;
+		};
+		struct PathEntry{
+			PageId page;
+			int slot; //Child slot followed from page
+		};
+		//A lookup or scan stepped by stepAsync each time the page it waits for arrives. A scan takes the
+		//leaves under the parent of the leaf it reached, and descends again at the parent's fence (the
+		//separator bounding the parent on the right) once they run out.
+		struct AsyncOp : BufferPool::PageWaiter{
+			PagedBpTree* tree;
+			PageId page; //Pinned or being read
+			Key key; //Descend towards key
+			Key hi;
+			bool scanning;
+			bool descended; //The current leaf was reached from the root, so starts at lowerBound(key)
+			bool hasFence;
+			bool hasParentFence;
+			Key fence;
+			Key parentFence;
+			std::vector<PageId> leaves; //Children of the parent, from the leaf reached
+			size_t nextLeaf;
+			std::function<void(bool, bool, const Value&)> found;
+			std::function<bool(const Key&, const Value&)> visit;
+			std::function<void(bool)> done;
+		};
+		static constexpr uint64_t fileMagic = 0x45455254504250ull; //"PBPTREE"
+		static constexpr uint32_t formatVersion = 1;
+
+		static constexpr size_t roundUp(size_t n, size_t align){
+			return (n + align - 1) / align * align;
+		}
+		static constexpr size_t keysOffset = roundUp(sizeof(PageHeader), alignof(Key));
+		static constexpr int leafCapacity = (pageSize - keysOffset - alignof(Value)) / (sizeof(Key) + sizeof(Value));
+		static constexpr size_t valsOffset = roundUp(keysOffset + leafCapacity * sizeof(Key), alignof(Value));
+		static constexpr int interiorCapacity = (pageSize - keysOffset - alignof(PageId) - sizeof(PageId)) / (sizeof(Key) + sizeof(PageId));
+		static constexpr size_t childrenOffset = roundUp(keysOffset + interiorCapacity * sizeof(Key), alignof(PageId));
+		static constexpr int leafMinKeys = leafCapacity / 2;
+		static constexpr int interiorMinKeys = interiorCapacity / 2;
+		static_assert(leafCapacity >= 3 && interiorCapacity >= 3, "A page must hold at least 3 keys");
+		static_assert(valsOffset + leafCapacity * sizeof(Value) <= pageSize, "Leaf layout overflows the page");
+		static_assert(childrenOffset + (interiorCapacity + 1) * sizeof(PageId) <= pageSize, "Interior layout overflows the page");
+
+		static PageHeader* node(char* page) noexcept{
+			return reinterpret_cast<PageHeader*>(page);
+		}
+		static Key* keysOf(char* page) noexcept{
+			return reinterpret_cast<Key*>(page + keysOffset);
+		}
+		static Value* valsOf(char* page) noexcept{
+			return reinterpret_cast<Value*>(page + valsOffset);
+		}
+		static PageId* childrenOf(char* page) noexcept{
+			return reinterpret_cast<PageId*>(page + childrenOffset);
+		}
+		static int lowerBound(char* page, const Key& k) noexcept{
+			return NodeSearch<Key, Compare>::lowerBound(keysOf(page), node(page)->numKeys, k);
+		}
+		static int upperBound(char* page, const Key& k) noexcept{
+			return NodeSearch<Key, Compare>::upperBound(keysOf(page), node(page)->numKeys, k);
+		}
+		static bool keyLess(const Key& a, const Key& b) noexcept{
+			return Compare()(a, b);
+		}
+
+		PageId descend(const Key&, std::vector<PathEntry>*);
+		PageRef newPage(bool leaf);
+		void freePage(PageRef&) noexcept;
+		void writeHeader();
+		void insertIntoParent(PageId, Key, PageId);
+		void rebalanceLeaf(PageRef&);
+		void rebalanceInterior(PageRef&);
+		static void insertIntoLeaf(char*, int, const Key&, const Value&) noexcept;
+		static void removeFromInterior(char*, int) noexcept;
+		static void resumeAsync(BufferPool::PageWaiter*, char*);
+		void startAsync(AsyncOp*);
+		void stepAsync(AsyncOp*, char*);
+		bool scanLeafAsync(AsyncOp*, char*);
+		void finishAsync(AsyncOp*, char*, bool ok);
+
+		BufferPool pool;
+		FileHeader header;
+		std::vector<PathEntry> path; //Root-to-leaf path of the current insert or remove
+		std::vector<Key> scratchKeys; //Room for an overflowing interior node during a split
+		std::vector<PageId> scratchChildren;
+		std::vector<AsyncOp*> starting; //Asynchronous operations waiting for the next poll()
+		size_t numAsyncOps;
+		size_t numFinishedOps;
+};
+
+template<typename Key, typename Value, typename Compare>
+PagedBpTree<Key, Value, Compare>::PagedBpTree(size_t poolFrames) : pool(poolFrames), header(), numAsyncOps(0), numFinishedOps(0){
+}
+
+template<typename Key, typename Value, typename Compare>
+PagedBpTree<Key, Value, Compare>::~PagedBpTree(){
+	try{
+		close();
+	}catch(...){
+		//Write-back errors cannot be reported here; call close() first to see them
+	}
+}
+
+template<typename Key, typename Value, typename Compare>
+bool PagedBpTree<Key, Value, Compare>::open(const char* filePath, bool directIo){
+	close();
+	if(!pool.open(filePath, directIo))
+		return false;
+	if(pool.pageCount() == 0){
+		PageId headerPage;
+		PageRef headerRef(pool, headerPage, pool.allocatePage(headerPage));
+		headerRef.markDirty();
+		header = FileHeader{fileMagic, formatVersion, (uint32_t)pageSize, (uint32_t)sizeof(Key), (uint32_t)sizeof(Value), 0, 0, 0};
+		header.root = newPage(true).id();
+		writeHeader();
+		return true;
+	}
+	{
+		PageRef headerRef(pool, 0);
+		std::memcpy(&header, headerRef.data(), sizeof(header));
+	}
+	if(header.magic != fileMagic || header.formatVersion != formatVersion || header.pageBytes != pageSize
+			|| header.keyBytes != sizeof(Key) || header.valueBytes != sizeof(Value)){
+		pool.close();
+		return false;
+	}
+	return true;
+}
+
+template<typename Key, typename Value, typename Compare>
+void PagedBpTree<Key, Value, Compare>::close(){
+	if(!pool.isOpen())
+		return;
+	drain();
+	writeHeader();
+	pool.close();
+}
+
+template<typename Key, typename Value, typename Compare>
+void PagedBpTree<Key, Value, Compare>::flush(){
+	writeHeader();
+	pool.flush();
+}
+
+template<typename Key, typename Value, typename Compare>
+void PagedBpTree<Key, Value, Compare>::writeHeader(){
+	PageRef headerRef(pool, 0);
+	std::memcpy(headerRef.data(), &header, sizeof(header));
+	headerRef.markDirty();
+}
+
+//A page from the free list, or a new one at the end of the file, set up as an empty node
+template<typename Key, typename Value, typename Compare>
+PageRef PagedBpTree<Key, Value, Compare>::newPage(bool leaf){
+	PageId id;
+	char* data;
+	if(header.freeList){
+		id = header.freeList;
+		data = pool.pin(id);
+		header.freeList = node(data)->nextLeaf;
+	}else{
+		data = pool.allocatePage(id);
+	}
+	PageRef ref(pool, id, data);
+	*node(data) = PageHeader{leaf, 0, 0, 0};
+	ref.markDirty();
+	return ref;
+}
+
+template<typename Key, typename Value, typename Compare>
+void PagedBpTree<Key, Value, Compare>::freePage(PageRef& ref) noexcept{
+	*node(ref.data()) = PageHeader{0, 0, header.freeList, 0};
+	header.freeList = ref.id();
+	ref.markDirty();
+}
+
+//Walk from the root to the leaf for k, recording the path when one is given
+template<typename Key, typename Value, typename Compare>
+typename PagedBpTree<Key, Value, Compare>::PageId PagedBpTree<Key, Value, Compare>::descend(const Key& k, std::vector<PathEntry>* trail){
+	if(trail)
+		trail->clear();
+	PageId id = header.root;
+	for(;;){
+		PageRef ref(pool, id);
+		if(node(ref.data())->leaf)
+			return id;
+		int slot = upperBound(ref.data(), k);
+		if(trail)
+			trail->push_back(PathEntry{id, slot});
+		id = childrenOf(ref.data())[slot];
+	}
+}
+
+template<typename Key, typename Value, typename Compare>
+bool PagedBpTree<Key, Value, Compare>::find(const Key& k, Value& out){
+	PageRef leaf(pool, descend(k, nullptr));
+	int pos = lowerBound(leaf.data(), k);
+	if(pos == (int)node(leaf.data())->numKeys || keyLess(k, keysOf(leaf.data())[pos]))
+		return false;
+	out = valsOf(leaf.data())[pos];
+	return true;
+}
+
+template<typename Key, typename Value, typename Compare>
+bool PagedBpTree<Key, Value, Compare>::insert(const Key& k, const Value& v){
+	assert(numAsyncOps == 0 && "drain() asynchronous operations before changing the tree");
+	PageRef leaf(pool, descend(k, &path));
+	char* data = leaf.data();
+	int n = node(data)->numKeys;
+	int pos = lowerBound(data, k);
+	if(pos < n && !keyLess(k, keysOf(data)[pos])) //Duplicated key
+		return false;
+	++header.numEntries;
+	leaf.markDirty();
+	if(n < leafCapacity){
+		insertIntoLeaf(data, pos, k, v);
+		return true;
+	}
+
+	//Move the upper half to a new right leaf, then insert into whichever half k belongs to
+	PageRef right = newPage(true);
+	char* rightData = right.data();
+	const int keep = leafCapacity / 2;
+	std::copy(keysOf(data) + keep, keysOf(data) + n, keysOf(rightData));
+	std::copy(valsOf(data) + keep, valsOf(data) + n, valsOf(rightData));
+	node(rightData)->numKeys = n - keep;
+	node(data)->numKeys = keep;
+	node(rightData)->nextLeaf = node(data)->nextLeaf;
+	node(rightData)->prevLeaf = leaf.id();
+	if(node(data)->nextLeaf){
+		PageRef after(pool, node(data)->nextLeaf);
+		node(after.data())->prevLeaf = right.id();
+		after.markDirty();
+	}
+	node(data)->nextLeaf = right.id();
+	if(pos > keep)
+		insertIntoLeaf(rightData, pos - keep, k, v);
+	else
+		insertIntoLeaf(data, pos, k, v);
+	insertIntoParent(leaf.id(), keysOf(rightData)[0], right.id());
+	return true;
+}
+
+template<typename Key, typename Value, typename Compare>
+void PagedBpTree<Key, Value, Compare>::insertIntoLeaf(char* data, int pos, const Key& k, const Value& v) noexcept{
+	int n = node(data)->numKeys;
+	std::copy_backward(keysOf(data) + pos, keysOf(data) + n, keysOf(data) + n + 1);
+	std::copy_backward(valsOf(data) + pos, valsOf(data) + n, valsOf(data) + n + 1);
+	keysOf(data)[pos] = k;
+	valsOf(data)[pos] = v;
+	++node(data)->numKeys;
+}
+
+//Add separator and rightId after leftId in the parent on the recorded path, splitting interior nodes
+//upwards as needed and growing a new root when the old root splits
+template<typename Key, typename Value, typename Compare>
+void PagedBpTree<Key, Value, Compare>::insertIntoParent(PageId leftId, Key separator, PageId rightId){
+	for(;;){
+		if(path.empty()){
+			PageRef newRoot = newPage(false);
+			char* data = newRoot.data();
+			keysOf(data)[0] = separator;
+			childrenOf(data)[0] = leftId;
+			childrenOf(data)[1] = rightId;
+			node(data)->numKeys = 1;
+			header.root = newRoot.id();
+			return;
+		}
+		PathEntry entry = path.back();
+		path.pop_back();
+		PageRef parent(pool, entry.page);
+		char* data = parent.data();
+		int n = node(data)->numKeys;
+		int slot = entry.slot;
+		parent.markDirty();
+		if(n < interiorCapacity){
+			std::copy_backward(keysOf(data) + slot, keysOf(data) + n, keysOf(data) + n + 1);
+			std::copy_backward(childrenOf(data) + slot + 1, childrenOf(data) + n + 1, childrenOf(data) + n + 2);
+			keysOf(data)[slot] = separator;
+			childrenOf(data)[slot + 1] = rightId;
+			++node(data)->numKeys;
+			return;
+		}
+
+		//Lay out the overflowing node in scratch space, keep the lower half and push the middle key up
+		scratchKeys.assign(keysOf(data), keysOf(data) + n);
+		scratchChildren.assign(childrenOf(data), childrenOf(data) + n + 1);
+		scratchKeys.insert(scratchKeys.begin() + slot, separator);
+		scratchChildren.insert(scratchChildren.begin() + slot + 1, rightId);
+		const int keep = (n + 1) / 2;
+		PageRef newRight = newPage(false);
+		char* rightData = newRight.data();
+		std::copy(scratchKeys.begin(), scratchKeys.begin() + keep, keysOf(data));
+		std::copy(scratchChildren.begin(), scratchChildren.begin() + keep + 1, childrenOf(data));
+		node(data)->numKeys = keep;
+		std::copy(scratchKeys.begin() + keep + 1, scratchKeys.end(), keysOf(rightData));
+		std::copy(scratchChildren.begin() + keep + 1, scratchChildren.end(), childrenOf(rightData));
+		node(rightData)->numKeys = n - keep;
+		leftId = entry.page;
+		separator = scratchKeys[keep];
+		rightId = newRight.id();
+	}
+}
+
+template<typename Key, typename Value, typename Compare>
+bool PagedBpTree<Key, Value, Compare>::remove(const Key& k){
+	assert(numAsyncOps == 0 && "drain() asynchronous operations before changing the tree");
+	PageRef leaf(pool, descend(k, &path));
+	char* data = leaf.data();
+	int n = node(data)->numKeys;
+	int pos = lowerBound(data, k);
+	if(pos == n || keyLess(k, keysOf(data)[pos]))
+		return false;
+	std::copy(keysOf(data) + pos + 1, keysOf(data) + n, keysOf(data) + pos);
+	std::copy(valsOf(data) + pos + 1, valsOf(data) + n, valsOf(data) + pos);
+	--node(data)->numKeys;
+	--header.numEntries;
+	leaf.markDirty();
+	if(!path.empty() && (int)node(data)->numKeys < leafMinKeys)
+		rebalanceLeaf(leaf);
+	return true;
+}
+
+template<typename Key, typename Value, typename Compare>
+void PagedBpTree<Key, Value, Compare>::removeFromInterior(char* data, int keyPos) noexcept{
+	int n = node(data)->numKeys;
+	std::copy(keysOf(data) + keyPos + 1, keysOf(data) + n, keysOf(data) + keyPos);
+	std::copy(childrenOf(data) + keyPos + 2, childrenOf(data) + n + 1, childrenOf(data) + keyPos + 1);
+	--node(data)->numKeys;
+}
+
+//Borrow a key from a sibling of an underfull leaf, or merge the two when the sibling has none to spare.
+//The left sibling is preferred; merges always keep the left page and free the right one.
+template<typename Key, typename Value, typename Compare>
+void PagedBpTree<Key, Value, Compare>::rebalanceLeaf(PageRef& leaf){
+	PathEntry entry = path.back();
+	path.pop_back();
+	PageRef parent(pool, entry.page);
+	parent.markDirty();
+	const int slot = entry.slot;
+	const bool hasLeft = slot > 0;
+	PageRef sibling(pool, childrenOf(parent.data())[hasLeft ? slot - 1 : slot + 1]);
+	sibling.markDirty();
+	PageRef& left = hasLeft ? sibling : leaf;
+	PageRef& right = hasLeft ? leaf : sibling;
+	char* l = left.data();
+	char* r = right.data();
+	int ln = node(l)->numKeys, rn = node(r)->numKeys;
+	const int sepPos = hasLeft ? slot - 1 : slot;
+
+	if(node(sibling.data())->numKeys > leafMinKeys){
+		if(hasLeft){
+			std::copy_backward(keysOf(r), keysOf(r) + rn, keysOf(r) + rn + 1);
+			std::copy_backward(valsOf(r), valsOf(r) + rn, valsOf(r) + rn + 1);
+			keysOf(r)[0] = keysOf(l)[ln - 1];
+			valsOf(r)[0] = valsOf(l)[ln - 1];
+		}else{
+			keysOf(l)[ln] = keysOf(r)[0];
+			valsOf(l)[ln] = valsOf(r)[0];
+			std::copy(keysOf(r) + 1, keysOf(r) + rn, keysOf(r));
+			std::copy(valsOf(r) + 1, valsOf(r) + rn, valsOf(r));
+		}
+		node(l)->numKeys += hasLeft ? -1 : 1;
+		node(r)->numKeys += hasLeft ? 1 : -1;
+		keysOf(parent.data())[sepPos] = keysOf(r)[0];
+		return;
+	}
+
+	std::copy(keysOf(r), keysOf(r) + rn, keysOf(l) + ln);
+	std::copy(valsOf(r), valsOf(r) + rn, valsOf(l) + ln);
+	node(l)->numKeys = ln + rn;
+	node(l)->nextLeaf = node(r)->nextLeaf;
+	if(node(r)->nextLeaf){
+		PageRef after(pool, node(r)->nextLeaf);
+		node(after.data())->prevLeaf = left.id();
+		after.markDirty();
+	}
+	freePage(right);
+	removeFromInterior(parent.data(), sepPos);
+	rebalanceInterior(parent);
+}
+
+//Fix an interior node that lost a key, the same way as rebalanceLeaf but rotating keys through the
+//parent. A root left with a single child is replaced by that child.
+template<typename Key, typename Value, typename Compare>
+void PagedBpTree<Key, Value, Compare>::rebalanceInterior(PageRef& current){
+	char* data = current.data();
+	if(path.empty()){
+		if(node(data)->numKeys == 0){
+			header.root = childrenOf(data)[0];
+			freePage(current);
+		}
+		return;
+	}
+	if((int)node(data)->numKeys >= interiorMinKeys)
+		return;
+
+	PathEntry entry = path.back();
+	path.pop_back();
+	PageRef parent(pool, entry.page);
+	parent.markDirty();
+	const int slot = entry.slot;
+	const bool hasLeft = slot > 0;
+	PageRef sibling(pool, childrenOf(parent.data())[hasLeft ? slot - 1 : slot + 1]);
+	sibling.markDirty();
+	PageRef& left = hasLeft ? sibling : current;
+	PageRef& right = hasLeft ? current : sibling;
+	char* l = left.data();
+	char* r = right.data();
+	int ln = node(l)->numKeys, rn = node(r)->numKeys;
+	const int sepPos = hasLeft ? slot - 1 : slot;
+	Key& separator = keysOf(parent.data())[sepPos];
+
+	if((int)node(sibling.data())->numKeys > interiorMinKeys){
+		if(hasLeft){ //Rotate the left sibling's last child over to the front of right
+			std::copy_backward(keysOf(r), keysOf(r) + rn, keysOf(r) + rn + 1);
+			std::copy_backward(childrenOf(r), childrenOf(r) + rn + 1, childrenOf(r) + rn + 2);
+			keysOf(r)[0] = separator;
+			childrenOf(r)[0] = childrenOf(l)[ln];
+			separator = keysOf(l)[ln - 1];
+		}else{ //Rotate the right sibling's first child over to the end of left
+			keysOf(l)[ln] = separator;
+			childrenOf(l)[ln + 1] = childrenOf(r)[0];
+			separator = keysOf(r)[0];
+			std::copy(keysOf(r) + 1, keysOf(r) + rn, keysOf(r));
+			std::copy(childrenOf(r) + 1, childrenOf(r) + rn + 1, childrenOf(r));
+		}
+		node(l)->numKeys += hasLeft ? -1 : 1;
+		node(r)->numKeys += hasLeft ? 1 : -1;
+		return;
+	}
+
+	keysOf(l)[ln] = separator;
+	std::copy(keysOf(r), keysOf(r) + rn, keysOf(l) + ln + 1);
+	std::copy(childrenOf(r), childrenOf(r) + rn + 1, childrenOf(l) + ln + 1);
+	node(l)->numKeys = ln + rn + 1;
+	freePage(right);
+	removeFromInterior(parent.data(), sepPos);
+	rebalanceInterior(parent);
+}
+
+template<typename Key, typename Value, typename Compare>
+template<typename Fn>
+void PagedBpTree<Key, Value, Compare>::scan(const Key& lo, const Key& hi, Fn&& fn){
+	PageId id = descend(lo, nullptr);
+	bool first = true;
+	while(id){
+		PageRef leaf(pool, id);
+		char* data = leaf.data();
+		int n = node(data)->numKeys;
+		for(int i = first ? lowerBound(data, lo) : 0; i < n; ++i){
+			const Key& k = keysOf(data)[i];
+			if(!keyLess(k, hi))
+				return;
+			const Value& v = valsOf(data)[i];
+			if constexpr(std::is_void<decltype(fn(k, v))>::value){
+				fn(k, v);
+			}else{
+				if(!static_cast<bool>(fn(k, v)))
+					return;
+			}
+		}
+		first = false;
+		id = node(data)->nextLeaf;
+	}
+}
+
+template<typename Key, typename Value, typename Compare>
+template<typename Done>
+void PagedBpTree<Key, Value, Compare>::findAsync(const Key& k, Done&& done){
+	AsyncOp* op = new AsyncOp();
+	op->key = k;
+	op->scanning = false;
+	op->found = std::forward<Done>(done);
+	starting.push_back(op);
+	++numAsyncOps;
+}
+
+template<typename Key, typename Value, typename Compare>
+template<typename Fn, typename Done>
+void PagedBpTree<Key, Value, Compare>::scanAsync(const Key& lo, const Key& hi, Fn&& fn, Done&& done){
+	AsyncOp* op = new AsyncOp();
+	op->key = lo;
+	op->hi = hi;
+	op->scanning = true;
+	op->visit = [fn = std::forward<Fn>(fn)](const Key& k, const Value& v) mutable{
+		if constexpr(std::is_void<decltype(fn(k, v))>::value){
+			fn(k, v);
+			return true;
+		}else{
+			return static_cast<bool>(fn(k, v));
+		}
+	};
+	op->done = std::forward<Done>(done);
+	starting.push_back(op);
+	++numAsyncOps;
+}
+
+//Pin the root, descending at once if it is resident
+template<typename Key, typename Value, typename Compare>
+void PagedBpTree<Key, Value, Compare>::startAsync(AsyncOp* op){
+	op->resume = &PagedBpTree::resumeAsync;
+	op->tree = this;
+	op->descended = true;
+	op->hasFence = op->hasParentFence = false;
+	op->leaves.clear();
+	op->nextLeaf = 0;
+	op->page = header.root;
+	if(char* data = pool.pinAsync(op->page, op))
+		stepAsync(op, data);
+}
+
+template<typename Key, typename Value, typename Compare>
+void PagedBpTree<Key, Value, Compare>::resumeAsync(BufferPool::PageWaiter* waiter, char* data){
+	AsyncOp* op = static_cast<AsyncOp*>(waiter);
+	if(data)
+		op->tree->stepAsync(op, data);
+	else
+		op->tree->finishAsync(op, nullptr, false);
+}
+
+//Carry on from the pinned page until the operation ends or waits for a page being read
+template<typename Key, typename Value, typename Compare>
+void PagedBpTree<Key, Value, Compare>::stepAsync(AsyncOp* op, char* data){
+	for(;;){
+		if(!node(data)->leaf){
+			int n = node(data)->numKeys;
+			int slot = upperBound(data, op->key);
+			if(op->scanning){
+				op->parentFence = op->fence;
+				op->hasParentFence = op->hasFence;
+				if(slot < n){
+					op->fence = keysOf(data)[slot];
+					op->hasFence = true;
+				}
+				op->leaves.assign(childrenOf(data) + slot, childrenOf(data) + n + 1);
+				op->nextLeaf = 1;
+			}
+			PageId child = childrenOf(data)[slot];
+			pool.unpin(op->page, false);
+			op->page = child;
+		}else if(!op->scanning || !scanLeafAsync(op, data)){
+			finishAsync(op, data, true);
+			return;
+		}else{
+			pool.unpin(op->page, false);
+			if(op->descended){ //Read the leaves after this one ahead of the cursor
+				for(size_t i = 1; i < op->leaves.size() && i <= prefetchLeaves; ++i)
+					pool.prefetch(op->leaves[i]);
+				op->descended = false;
+			}else if(op->nextLeaf + prefetchLeaves - 1 < op->leaves.size()){
+				pool.prefetch(op->leaves[op->nextLeaf + prefetchLeaves - 1]);
+			}
+			if(op->nextLeaf < op->leaves.size()){
+				op->page = op->leaves[op->nextLeaf++];
+			}else if(op->hasParentFence && keyLess(op->parentFence, op->hi)){
+				op->key = op->parentFence;
+				op->descended = true;
+				op->hasFence = op->hasParentFence = false;
+				op->leaves.clear();
+				op->nextLeaf = 0;
+				op->page = header.root;
+			}else{
+				finishAsync(op, nullptr, true);
+				return;
+			}
+		}
+		data = pool.pinAsync(op->page, op);
+		if(!data)
+			return;
+	}
+}
+
+//Visit the leaf's keys in range; false once the scan is over
+template<typename Key, typename Value, typename Compare>
+bool PagedBpTree<Key, Value, Compare>::scanLeafAsync(AsyncOp* op, char* data){
+	int n = node(data)->numKeys;
+	for(int i = op->descended ? lowerBound(data, op->key) : 0; i < n; ++i){
+		const Key& k = keysOf(data)[i];
+		if(!keyLess(k, op->hi) || !op->visit(k, valsOf(data)[i]))
+			return false;
+	}
+	return true;
+}
+
+//End the operation, unpinning the leaf it holds if any, and run its callback with ok false if a page
+//could not be read
+template<typename Key, typename Value, typename Compare>
+void PagedBpTree<Key, Value, Compare>::finishAsync(AsyncOp* op, char* leaf, bool ok){
+	bool hit = false;
+	Value v = Value();
+	if(ok && leaf && !op->scanning){
+		int pos = lowerBound(leaf, op->key);
+		hit = pos < (int)node(leaf)->numKeys && !keyLess(op->key, keysOf(leaf)[pos]);
+		if(hit)
+			v = valsOf(leaf)[pos];
+	}
+	if(leaf)
+		pool.unpin(op->page, false);
+	std::unique_ptr<AsyncOp> owned(op);
+	--numAsyncOps;
+	++numFinishedOps;
+	if(op->scanning)
+		op->done(ok);
+	else
+		op->found(ok, hit, v);
+}
+
+template<typename Key, typename Value, typename Compare>
+size_t PagedBpTree<Key, Value, Compare>::poll(){
+	size_t before = numFinishedOps;
+	do{
+		//Operations started by callbacks are picked up by the next turn, so none of them recurse
+		std::vector<AsyncOp*> batch;
+		batch.swap(starting);
+		for(AsyncOp* op : batch)
+			startAsync(op);
+		pool.poll();
+	}while(!starting.empty());
+	return numFinishedOps - before;
+}
+
+template<typename Key, typename Value, typename Compare>
+size_t PagedBpTree<Key, Value, Compare>::wait(){
+	size_t finished = poll();
+	while(finished == 0 && numAsyncOps > 0){
+		pool.wait();
+		finished += poll();
+	}
+	return finished;
+}
+
+template<typename Key, typename Value, typename Compare>
+void PagedBpTree<Key, Value, Compare>::drain(){
+	while(numAsyncOps > 0)
+		wait();
+}
+
+#endif
@@ -0,0 +1,383 @@
+#ifndef SHARDED_BPTREE_H
+#define SHARDED_BPTREE_H
+
+#include "BpTree.h"
+#include "Epoch.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <shared_mutex>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+//Key space split over independent BpTrees (shards), each with its own allocator and reader-writer latch,
+//so writers on different shards share no lock and no node.
+//Range partitioning gives shard i the keys in [bounds[i - 1], bounds[i]). Scans visit the shards in key
+//order, and rebalance() moves a boundary to shed load from a hot shard while operations go on.
+//Hash partitioning spreads any key distribution evenly, and scans merge all the shards in key order.
+//The range routing table is immutable: rebalance() swaps in a new one and retires the old one to an
+//EpochManager, so routing takes no lock. An operation that raced with a boundary move finds its key
+//outside the shard's range once it holds the latch, and routes again.
+template<typename Key, typename Value, typename Compare = std::less<Key>, int KeysLimit = 3,
+		typename Allocator = NewDeleteNodeAllocator, typename Hash = std::hash<Key>>
+class ShardedBpTree{
+	public:
+		typedef BpTree<Key, Value, Compare, KeysLimit, Allocator> Tree;
+		static constexpr size_t numSamples = 256; //Recent write keys kept per range shard to pick split points
+		static constexpr unsigned sampleEvery = 8; //One write in this many is sampled
+		static constexpr size_t minSamples = 16; //Fewest samples rebalance() splits a shard on
+
+		//Hash partitioning over numShards shards
+		explicit ShardedBpTree(int numShards, const Allocator& = Allocator());
+		//Range partitioning at strictly ascending bounds, into bounds.size() + 1 shards
+		explicit ShardedBpTree(std::vector<Key> bounds, const Allocator& = Allocator());
+		ShardedBpTree(const ShardedBpTree&) = delete;
+		ShardedBpTree& operator=(const ShardedBpTree&) = delete;
+		~ShardedBpTree();
+
+		bool insert(const Key&, const Value&);
+		bool upsert(const Key&, const Value&); //Returns whether the key was added
+		bool remove(const Key&);
+		Value find(const Key&) const;
+		//Call fn(key, value) for keys in [lo, hi) in ascending order. If fn returns bool, false stops the scan.
+		//Range shards are read one at a time under their latch. Hash shards are all latched for the whole
+		//scan and merged, which holds off their writers until it ends.
+		template<typename Fn>
+		void scan(const Key& lo, const Key& hi, Fn&& fn) const;
+		//Range partitioning: if the busiest shard has taken at least threshold times the mean load since the
+		//last call, move its boundary with the less busy neighbour so that about half the difference in
+		//their load changes sides. The split point is a quantile of the keys sampled from the shard's
+		//recent writes. Load counts restart on every call. Returns whether a boundary moved.
+		//Does nothing under hash partitioning.
+		bool rebalance(double threshold = 1.5);
+		int numShards() const noexcept{
+			return shards.size();
+		}
+		std::vector<Key> bounds() const; //Current range bounds, empty under hash partitioning
+		//The tree of a shard, for statistics. Not synchronized with writers.
+		const Tree& shard(int i) const noexcept{
+			return shards[i]->tree;
+		}
+		//Check every shard's tree (see BpTree::validate) and, for range partitioning, that its keys lie in its range
+		bool validate(std::string* error = nullptr) const;
+	private:
+		struct Routing{
+			std::vector<Key> bounds;
+
+			int shardOf(const Key& k) const noexcept{
+				return std::upper_bound(bounds.begin(), bounds.end(), k, Compare()) - bounds.begin();
+			}
+		};
+		//Shards sit on cache lines of their own so one shard's latch traffic leaves its neighbours alone
+		struct alignas(64) Shard{
+			mutable std::shared_mutex latch;
+			Tree tree;
+			std::atomic<uint64_t> load{0}; //Operations since the last rebalance()
+			//Range partitioning: the shard owns [lo, hi), where an absent bound is open. Guarded by latch.
+			bool hasLo = false, hasHi = false;
+			Key lo, hi;
+			std::vector<Key> samples; //Guarded by latch, written under it exclusively
+			size_t numWrites = 0;
+
+			explicit Shard(const Allocator& alloc) : tree(alloc){
+			}
+			bool owns(const Key& k) const noexcept{
+				return (!hasLo || !Compare()(k, lo)) && (!hasHi || Compare()(k, hi));
+			}
+			void sampleWrite(const Key& k){
+				if(numWrites++ % sampleEvery != 0)
+					return;
+				if(samples.size() < numSamples)
+					samples.push_back(k);
+				else
+					samples[numWrites / sampleEvery % numSamples] = k;
+			}
+		};
+		typedef std::shared_lock<std::shared_mutex> ReadLock;
+		typedef std::unique_lock<std::shared_mutex> WriteLock;
+
+		template<typename Lock, typename Op>
+		auto withShard(const Key&, Op&&) const -> decltype(std::declval<Op&>()(std::declval<Shard&>()));
+		template<typename Fn, typename... Args>
+		static bool invokeScanCallback(Fn&, Args&&...);
+		static void deleteRouting(void*) noexcept;
+		void moveKeys(Shard&, Shard&, const Key*, const Key*);
+
+		std::vector<std::unique_ptr<Shard>> shards;
+		const bool ranged;
+		std::atomic<const Routing*> routing; //nullptr under hash partitioning
+		mutable EpochManager epochs; //Keeps retired routing tables alive for the operations still reading them
+		std::mutex rebalancing; //One rebalance() at a time
+};
+
+/*==================== ShardedBpTree implementation ==========================*/
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Hash>
+ShardedBpTree<Key, Value, Compare, KeysLimit, Allocator, Hash>::ShardedBpTree(int numShards, const Allocator& alloc)
+	: ranged(false), routing(nullptr){
+	assert(numShards > 0);
+	for(int i = 0; i < numShards; ++i)
+		shards.push_back(std::make_unique<Shard>(alloc));
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Hash>
+ShardedBpTree<Key, Value, Compare, KeysLimit, Allocator, Hash>::ShardedBpTree(std::vector<Key> bounds, const Allocator& alloc)
+	: ranged(true), routing(nullptr){
+	assert(std::adjacent_find(bounds.begin(), bounds.end(), [](const Key& a, const Key& b){
+		return !Compare()(a, b);
+	}) == bounds.end());
+	for(size_t i = 0; i <= bounds.size(); ++i){
+		shards.push_back(std::make_unique<Shard>(alloc));
+		Shard& shard = *shards.back();
+		if(i > 0){
+			shard.hasLo = true;
+			shard.lo = bounds[i - 1];
+		}
+		if(i < bounds.size()){
+			shard.hasHi = true;
+			shard.hi = bounds[i];
+		}
+	}
+	routing.store(new Routing{std::move(bounds)}, std::memory_order_release);
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Hash>
+ShardedBpTree<Key, Value, Compare, KeysLimit, Allocator, Hash>::~ShardedBpTree(){
+	delete routing.load(std::memory_order_acquire);
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Hash>
+void ShardedBpTree<Key, Value, Compare, KeysLimit, Allocator, Hash>::deleteRouting(void* p) noexcept{
+	delete static_cast<Routing*>(p);
+}
+
+//Latch the shard that owns k with Lock and return op(shard)
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Hash>
+template<typename Lock, typename Op>
+auto ShardedBpTree<Key, Value, Compare, KeysLimit, Allocator, Hash>::withShard(const Key& k, Op&& op) const
+		-> decltype(std::declval<Op&>()(std::declval<Shard&>())){
+	if(!ranged){
+		Shard& shard = *shards[Hash()(k) % shards.size()];
+		Lock lock(shard.latch);
+		shard.load.fetch_add(1, std::memory_order_relaxed);
+		return op(shard);
+	}
+	EpochManager::Guard guard(epochs);
+	for(;;){
+		Shard& shard = *shards[routing.load(std::memory_order_acquire)->shardOf(k)];
+		Lock lock(shard.latch);
+		if(!shard.owns(k))
+			continue; //A boundary moved after the table was read; the latch made the new table visible
+		shard.load.fetch_add(1, std::memory_order_relaxed);
+		return op(shard);
+	}
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Hash>
+bool ShardedBpTree<Key, Value, Compare, KeysLimit, Allocator, Hash>::insert(const Key& k, const Value& v){
+	return withShard<WriteLock>(k, [&](Shard& shard){
+		if(ranged)
+			shard.sampleWrite(k);
+		return shard.tree.insert(k, v);
+	});
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Hash>
+bool ShardedBpTree<Key, Value, Compare, KeysLimit, Allocator, Hash>::upsert(const Key& k, const Value& v){
+	return withShard<WriteLock>(k, [&](Shard& shard){
+		if(ranged)
+			shard.sampleWrite(k);
+		return shard.tree.upsert(k, v);
+	});
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Hash>
+bool ShardedBpTree<Key, Value, Compare, KeysLimit, Allocator, Hash>::remove(const Key& k){
+	return withShard<WriteLock>(k, [&](Shard& shard){
+		if(ranged)
+			shard.sampleWrite(k);
+		return shard.tree.remove(k);
+	});
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Hash>
+Value ShardedBpTree<Key, Value, Compare, KeysLimit, Allocator, Hash>::find(const Key& k) const{
+	return withShard<ReadLock>(k, [&](const Shard& shard){
+		return shard.tree.find(k);
+	});
+}
+
+//Run a scan callback, treating callbacks that return nothing as "keep going"
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Hash>
+template<typename Fn, typename... Args>
+bool ShardedBpTree<Key, Value, Compare, KeysLimit, Allocator, Hash>::invokeScanCallback(Fn& fn, Args&&... args){
+	if constexpr(std::is_void<decltype(fn(std::forward<Args>(args)...))>::value){
+		fn(std::forward<Args>(args)...);
+		return true;
+	}else{
+		return static_cast<bool>(fn(std::forward<Args>(args)...));
+	}
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Hash>
+template<typename Fn>
+void ShardedBpTree<Key, Value, Compare, KeysLimit, Allocator, Hash>::scan(const Key& lo, const Key& hi, Fn&& fn) const{
+	Compare less;
+	bool more = true;
+	if(ranged){
+		//Every key below cursor has been passed to fn. Each shard is routed to afresh, so a boundary
+		//moved between two shards neither skips nor repeats keys.
+		EpochManager::Guard guard(epochs);
+		Key cursor = lo;
+		while(more && less(cursor, hi)){
+			Shard& shard = *shards[routing.load(std::memory_order_acquire)->shardOf(cursor)];
+			ReadLock lock(shard.latch);
+			if(!shard.owns(cursor))
+				continue;
+			shard.load.fetch_add(1, std::memory_order_relaxed);
+			const bool last = !shard.hasHi || !less(shard.hi, hi);
+			shard.tree.scan(cursor, last ? hi : shard.hi, [&](const Key& k, const Value& v){
+				return more = invokeScanCallback(fn, k, v);
+			});
+			if(last)
+				break;
+			cursor = shard.hi;
+		}
+		return;
+	}
+
+	//Hash shards each hold keys from the whole range: merge their runs through a heap of shard cursors
+	typedef typename Tree::const_iterator Iterator;
+	std::vector<ReadLock> locks;
+	locks.reserve(shards.size());
+	std::vector<Iterator> cursors;
+	cursors.reserve(shards.size());
+	for(auto& shard : shards){
+		locks.emplace_back(shard->latch);
+		shard->load.fetch_add(1, std::memory_order_relaxed);
+		cursors.push_back(static_cast<const Tree&>(shard->tree).lowerBound(lo));
+	}
+	auto later = [&cursors, &less](size_t a, size_t b){
+		return less(cursors[b].key(), cursors[a].key());
+	};
+	std::priority_queue<size_t, std::vector<size_t>, decltype(later)> heap(later);
+	auto advance = [&](size_t i){
+		if(cursors[i] != static_cast<const Tree&>(shards[i]->tree).end() && less(cursors[i].key(), hi))
+			heap.push(i);
+	};
+	for(size_t i = 0; i < shards.size(); ++i)
+		advance(i);
+	while(!heap.empty()){
+		size_t i = heap.top();
+		heap.pop();
+		if(!invokeScanCallback(fn, cursors[i].key(), cursors[i].value()))
+			return;
+		++cursors[i];
+		advance(i);
+	}
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Hash>
+bool ShardedBpTree<Key, Value, Compare, KeysLimit, Allocator, Hash>::rebalance(double threshold){
+	if(!ranged || shards.size() < 2)
+		return false;
+	std::lock_guard<std::mutex> serial(rebalancing);
+	const int n = shards.size();
+	std::vector<uint64_t> loads(n);
+	uint64_t total = 0;
+	for(int i = 0; i < n; ++i)
+		total += loads[i] = shards[i]->load.exchange(0, std::memory_order_relaxed);
+	const int hot = std::max_element(loads.begin(), loads.end()) - loads.begin();
+	if(total == 0 || loads[hot] < threshold * total / n)
+		return false;
+	const int neighbour = hot == 0 ? 1 : hot == n - 1 ? n - 2 : loads[hot - 1] <= loads[hot + 1] ? hot - 1 : hot + 1;
+	const double share = (loads[hot] - loads[neighbour]) / (2.0 * loads[hot]);
+
+	//Latch in index order, as the only code that holds two latches
+	Shard& hotShard = *shards[hot];
+	Shard& target = *shards[neighbour];
+	WriteLock first(shards[std::min(hot, neighbour)]->latch), second(shards[std::max(hot, neighbour)]->latch);
+	if(hotShard.samples.size() < minSamples)
+		return false;
+	Compare less;
+	std::vector<Key> sorted = hotShard.samples;
+	std::sort(sorted.begin(), sorted.end(), less);
+	//Moving right hands over the hot shard's upper keys, moving left its lower ones
+	const bool right = neighbour > hot;
+	size_t pos = std::min(sorted.size() - 1, (size_t)((right ? 1 - share : share) * sorted.size()));
+	Key split = sorted[pos];
+	//Both shards must keep a non-empty range; samples of keys the shard has since lost are skipped
+	if(!hotShard.owns(split) || (hotShard.hasLo && !less(hotShard.lo, split)))
+		return false;
+
+	if(right){
+		moveKeys(hotShard, target, &split, nullptr);
+		hotShard.hi = split;
+		target.lo = split;
+	}else{
+		moveKeys(hotShard, target, nullptr, &split);
+		hotShard.lo = split;
+		target.hi = split;
+	}
+	hotShard.samples.clear();
+	target.samples.clear();
+	const Routing* old = routing.load(std::memory_order_relaxed);
+	Routing* table = new Routing(*old);
+	table->bounds[std::min(hot, neighbour)] = split;
+	routing.store(table, std::memory_order_release);
+	epochs.retire(const_cast<Routing*>(old), &deleteRouting);
+	return true;
+}
+
+//Move the entries of from in [lo, hi) to to; an absent bound is open. Both shards are latched.
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Hash>
+void ShardedBpTree<Key, Value, Compare, KeysLimit, Allocator, Hash>::moveKeys(Shard& from, Shard& to, const Key* lo, const Key* hi){
+	std::vector<std::pair<Key, Value>> entries;
+	std::vector<Key> keys;
+	for(auto it = lo ? from.tree.lowerBound(*lo) : from.tree.begin(); it != from.tree.end() && (!hi || Compare()(it.key(), *hi)); ++it){
+		keys.push_back(it.key());
+		entries.emplace_back(it.key(), std::move(it.value()));
+	}
+	from.tree.removeBatch(keys.begin(), keys.end());
+	to.tree.insertBatch(std::make_move_iterator(entries.begin()), std::make_move_iterator(entries.end()));
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Hash>
+std::vector<Key> ShardedBpTree<Key, Value, Compare, KeysLimit, Allocator, Hash>::bounds() const{
+	if(!ranged)
+		return std::vector<Key>();
+	EpochManager::Guard guard(epochs);
+	return routing.load(std::memory_order_acquire)->bounds;
+}
+
+template<typename Key, typename Value, typename Compare, int KeysLimit, typename Allocator, typename Hash>
+bool ShardedBpTree<Key, Value, Compare, KeysLimit, Allocator, Hash>::validate(std::string* error) const{
+	for(size_t i = 0; i < shards.size(); ++i){
+		const Shard& shard = *shards[i];
+		ReadLock lock(shard.latch);
+		std::string message;
+		if(!shard.tree.validate(&message))
+			message = "shard " + std::to_string(i) + ": " + message;
+		else if(shard.tree.begin() != shard.tree.end() && (!shard.owns(shard.tree.begin().key()) || !shard.owns(std::prev(shard.tree.end()).key())))
+			message = "shard " + std::to_string(i) + " holds keys outside its range";
+		for(auto it = shard.tree.begin(); !ranged && message.empty() && it != shard.tree.end(); ++it){
+			if(Hash()(it.key()) % shards.size() != i)
+				message = "shard " + std::to_string(i) + " holds a key that hashes to another shard";
+		}
+		if(!message.empty()){
+			if(error)
+				*error = message;
+			return false;
+		}
+	}
+	return true;
+}
+/*===================== End of ShardedBpTree =========================================*/
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include<cstddef>
+#include<cstdint>
+#include<functional>
+#include<type_traits>
+
+//On-disk layout shared by BpTree::saveSnapshot and MappedBpTree.
+//A snapshot is a frozen tree stored without pointers: the header, then every key in order, then every
+//value in the same order, then the index levels. Index level 0 holds the first key of each block of
+//blockKeys entries, level 1 the first key of each block of level 0, and so on until a level fits in one
+//block. A child is found by position (block i of a level covers entries i * blockKeys onwards of the level
+//below), so the file is searched in place straight from the mapping. Sections start on cache lines.
+//With the compressedKeys flag, integer keys are stored frame-of-reference: each block of blockKeys entries
+//keeps only the difference of every key from the block's first key (which is already in index level 0),
+//in the narrowest of 1, 2, 4 or 8 bytes that holds the block's largest difference. The keys section then
+//starts with one uint64 per block, the byte offset of its differences from the start of the section shifted
+//left by 2 and ORed with log2 of their width, followed by the blocks, each aligned to its width. Dense or
+//clustered keys take one or two bytes each, and a block is still searched in place with a vector compare.
+namespace snapshot{
+
+constexpr uint64_t magic = 0x3150414e53505442ull; //"BTPSNAP1"
+constexpr uint32_t formatVersion = 1;
+constexpr int maxLevels = 16;
+constexpr size_t sectionAlignment = 64;
+constexpr uint32_t compressedKeys = 1; //Header::flags
+
+struct Header{
+	uint64_t magic;
+	uint32_t formatVersion;
+	uint32_t keyBytes;
+	uint32_t valueBytes;
+	uint32_t blockKeys;
+	uint32_t numLevels;
+	uint32_t flags;
+	uint64_t numEntries;
+	uint64_t fileBytes;
+	uint64_t keysOffset;
+	uint64_t valsOffset;
+	uint64_t levelOffsets[maxLevels];
+	uint64_t levelCounts[maxLevels];
+};
+
+//Keys per index block: four cache lines of keys, so a block is one vector search
+template<typename Key>
+constexpr uint32_t blockKeys(){
+	return 256 / sizeof(Key) > 4 ? 256 / sizeof(Key) : 4;
+}
+
+//Frame-of-reference needs keys that subtract like integers in the tree's order
+template<typename Key, typename Compare>
+constexpr bool isCompressible(){
+	return std::is_integral<Key>::value && !std::is_same<Key, bool>::value
+		&& (std::is_same<Compare, std::less<Key>>::value || std::is_same<Compare, std::less<>>::value);
+}
+
+//log2 of the narrowest width, in bytes, that holds every difference up to maxDelta
+inline uint32_t deltaWidthLog2(uint64_t maxDelta){
+	return maxDelta <= 0xFF ? 0 : maxDelta <= 0xFFFF ? 1 : maxDelta <= 0xFFFFFFFFull ? 2 : 3;
+}
+
+constexpr uint64_t alignSection(uint64_t offset){
+	return (offset + sectionAlignment - 1) / sectionAlignment * sectionAlignment;
+}
+
+}
+
+#endif
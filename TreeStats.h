@@ -0,0 +1,347 @@
+#ifndef TREE_STATS_H
+#define TREE_STATS_H
+
+#include "Epoch.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+//Statistics returned by BpTree::stats(). The tree's shape (height, nodes and fill per level) is measured
+//when stats() is called, so it is always available. Structural events, descent depth and operation latency
+//are counted on the hot path only when BPTREE_STATS is defined; without it the hooks expand to nothing.
+//Each tree keeps one counter block per thread, written only by its owner with relaxed loads and stores
+//(no read-modify-write), and stats() sums the blocks.
+
+namespace treestats{
+
+enum Op{
+	findOp,
+	insertOp,
+	removeOp,
+	numOps
+};
+
+enum Event{
+	leafSplit,
+	interiorSplit,
+	leafRedistribute,
+	interiorRedistribute,
+	leafCoalesce,
+	interiorCoalesce,
+	numEvents
+};
+
+constexpr const char* opNames[numOps] = {"find", "insert", "remove"};
+constexpr const char* eventNames[numEvents] = {"leaf_split", "interior_split", "leaf_redistribute",
+	"interior_redistribute", "leaf_coalesce", "interior_coalesce"};
+
+constexpr int fillBuckets = 10; //Tenths of a node's capacity
+constexpr int latencySampleInterval = 16; //One operation in this many is timed
+//Latency buckets: four per power of two of nanoseconds, so a percentile is within 25%
+constexpr int subBucketBits = 2;
+constexpr int latencyBuckets = 64 << subBucketBits;
+
+inline int latencyBucket(uint64_t ns) noexcept{
+	if(ns < (1u << subBucketBits))
+		return ns;
+	int msb = 63 - __builtin_clzll(ns);
+	return msb << subBucketBits | (ns >> (msb - subBucketBits) & ((1u << subBucketBits) - 1));
+}
+
+inline double latencyBucketMidpoint(int bucket) noexcept{
+	int msb = bucket >> subBucketBits;
+	if(msb < subBucketBits)
+		return bucket;
+	double width = (double)(1ull << (msb - subBucketBits));
+	return (double)(1ull << msb) + (bucket & ((1 << subBucketBits) - 1)) * width + width / 2;
+}
+
+//Single-writer counter: its owning thread adds with a plain load and store, other threads only read
+struct Counter{
+	std::atomic<uint64_t> value{0};
+	void add(uint64_t n) noexcept{
+		value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+	}
+	void raiseTo(uint64_t n) noexcept{
+		if(n > value.load(std::memory_order_relaxed))
+			value.store(n, std::memory_order_relaxed);
+	}
+	uint64_t get() const noexcept{
+		return value.load(std::memory_order_relaxed);
+	}
+};
+
+struct alignas(64) ThreadCounters{
+	Counter ops[numOps];
+	Counter depthSum[numOps];
+	Counter depthMax[numOps];
+	Counter events[numEvents];
+	Counter latency[numOps][latencyBuckets];
+	unsigned untimed = 0; //Operations since the last timed one, owner only
+};
+
+//Counter block and operation of the tree operation running on this thread, if any
+struct Context{
+	ThreadCounters* counters = nullptr;
+	int op = -1;
+};
+inline thread_local Context context;
+
+inline void count(Event event, uint64_t n = 1) noexcept{
+	if(context.counters)
+		context.counters->events[event].add(n);
+}
+
+inline void recordDepth(int depth) noexcept{
+	if(context.counters && context.op >= 0){
+		context.counters->depthSum[context.op].add(depth);
+		context.counters->depthMax[context.op].raiseTo(depth);
+	}
+}
+
+//Per-tree counter blocks, one per thread id (see epoch::ThreadRegistry), allocated on a thread's first use.
+//Threads past epoch::maxThreads share epoch::overflowId and go uncounted, since the blocks are single-writer.
+class Counters{
+	public:
+		Counters() noexcept{
+			for(auto& slot : slots)
+				slot.store(nullptr, std::memory_order_relaxed);
+		}
+		Counters(const Counters&) noexcept : Counters(){ //A copied tree starts counting afresh
+		}
+		Counters& operator=(const Counters&) noexcept{
+			return *this;
+		}
+		~Counters(){
+			for(auto& slot : slots)
+				delete slot.load(std::memory_order_relaxed);
+		}
+		ThreadCounters* local(){ //nullptr for an uncounted thread
+			int id = epoch::ThreadRegistry::id();
+			if(id == epoch::overflowId)
+				return nullptr;
+			auto& slot = slots[id];
+			ThreadCounters* counters = slot.load(std::memory_order_acquire);
+			if(!counters){
+				counters = new ThreadCounters();
+				slot.store(counters, std::memory_order_release);
+			}
+			return counters;
+		}
+		template<typename Fn>
+		void forEach(Fn&& fn) const{
+			for(auto& slot : slots){
+				if(const ThreadCounters* counters = slot.load(std::memory_order_acquire))
+					fn(*counters);
+			}
+		}
+	private:
+		std::array<std::atomic<ThreadCounters*>, epoch::maxThreads> slots;
+};
+
+//Opened at the top of a tree operation: routes this thread's hooks to the tree's counter block, counts
+//the operation and times one in latencySampleInterval. op < 0 only routes the hooks, for batch operations.
+class OpScope{
+	public:
+		OpScope(Counters& counters, int op) : previous(context), timed(false){
+			context.counters = counters.local();
+			context.op = op;
+			if(context.counters && op >= 0){
+				context.counters->ops[op].add(1);
+				if(++context.counters->untimed >= (unsigned)latencySampleInterval){
+					context.counters->untimed = 0;
+					timed = true;
+					begin = std::chrono::steady_clock::now();
+				}
+			}
+		}
+		OpScope(const OpScope&) = delete;
+		OpScope& operator=(const OpScope&) = delete;
+		~OpScope(){
+			if(timed){
+				uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+				context.counters->latency[context.op][latencyBucket(ns)].add(1);
+			}
+			context = previous;
+		}
+	private:
+		Context previous;
+		bool timed;
+		std::chrono::steady_clock::time_point begin;
+};
+
+}
+
+#ifdef BPTREE_STATS
+#define BPTREE_STATS_SCOPE(op) treestats::OpScope statsScope(counters, op)
+#define BPTREE_STATS_EVENT(...) treestats::count(__VA_ARGS__)
+#define BPTREE_STATS_DEPTH(depth) treestats::recordDepth(depth)
+#else
+#define BPTREE_STATS_SCOPE(op) ((void)0)
+#define BPTREE_STATS_EVENT(...) ((void)0)
+#define BPTREE_STATS_DEPTH(depth) ((void)(depth))
+#endif
+
+//Point-in-time statistics of one tree
+struct TreeStats{
+	struct Level{
+		size_t nodes = 0;
+		size_t keys = 0;
+		size_t fill[treestats::fillBuckets] = {}; //Nodes by keys / capacity, in tenths; full nodes in the last
+	};
+	struct OpStats{
+		uint64_t count = 0;
+		uint64_t timed = 0; //Operations the latency percentiles are drawn from
+		double meanDepth = 0;
+		uint64_t maxDepth = 0;
+		double p50Ns = 0, p90Ns = 0, p99Ns = 0, p999Ns = 0;
+	};
+
+	bool countersEnabled = false; //Whether the tree was built with BPTREE_STATS
+	int height = 0;
+	int keysLimit = 0; //Interior node capacity
+	int leafKeysLimit = 0;
+	size_t entries = 0;
+	size_t leafNodes = 0;
+	size_t interiorNodes = 0;
+	std::vector<Level> levels; //levels[0] is the leaf level, the root level is last
+	uint64_t events[treestats::numEvents] = {};
+	OpStats ops[treestats::numOps];
+
+	void addCounters(const treestats::Counters&);
+	std::string toJson() const;
+	std::string toPrometheus(const std::string& prefix = "bptree") const;
+};
+
+/*==================== TreeStats implementation ==========================*/
+inline void TreeStats::addCounters(const treestats::Counters& counters){
+	countersEnabled = true;
+	uint64_t latency[treestats::numOps][treestats::latencyBuckets] = {};
+	uint64_t depthSum[treestats::numOps] = {};
+	counters.forEach([&](const treestats::ThreadCounters& thread){
+		for(int e = 0; e < treestats::numEvents; ++e)
+			events[e] += thread.events[e].get();
+		for(int op = 0; op < treestats::numOps; ++op){
+			ops[op].count += thread.ops[op].get();
+			depthSum[op] += thread.depthSum[op].get();
+			ops[op].maxDepth = std::max(ops[op].maxDepth, thread.depthMax[op].get());
+			for(int b = 0; b < treestats::latencyBuckets; ++b)
+				latency[op][b] += thread.latency[op][b].get();
+		}
+	});
+	for(int op = 0; op < treestats::numOps; ++op){
+		OpStats& stats = ops[op];
+		stats.meanDepth = stats.count ? (double)depthSum[op] / stats.count : 0;
+		for(int b = 0; b < treestats::latencyBuckets; ++b)
+			stats.timed += latency[op][b];
+		const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+		double* results[] = {&stats.p50Ns, &stats.p90Ns, &stats.p99Ns, &stats.p999Ns};
+		for(int q = 0; q < 4 && stats.timed > 0; ++q){
+			uint64_t rank = (uint64_t)(quantiles[q] * (stats.timed - 1)) + 1, seen = 0;
+			for(int b = 0; b < treestats::latencyBuckets; ++b){
+				seen += latency[op][b];
+				if(seen >= rank){
+					*results[q] = treestats::latencyBucketMidpoint(b);
+					break;
+				}
+			}
+		}
+	}
+}
+
+inline std::string TreeStats::toJson() const{
+	std::string out;
+	char buffer[256];
+	snprintf(buffer, sizeof(buffer), "{\"countersEnabled\":%s,\"height\":%d,\"keysLimit\":%d,\"leafKeysLimit\":%d,"
+			"\"entries\":%zu,\"leafNodes\":%zu,\"interiorNodes\":%zu,\"levels\":[", countersEnabled ? "true" : "false", height,
+			keysLimit, leafKeysLimit, entries, leafNodes, interiorNodes);
+	out += buffer;
+	for(size_t l = 0; l < levels.size(); ++l){
+		snprintf(buffer, sizeof(buffer), "%s{\"level\":%zu,\"nodes\":%zu,\"keys\":%zu,\"fill\":[", l ? "," : "", l,
+				levels[l].nodes, levels[l].keys);
+		out += buffer;
+		for(int b = 0; b < treestats::fillBuckets; ++b)
+			out += (b ? "," : "") + std::to_string(levels[l].fill[b]);
+		out += "]}";
+	}
+	out += "],\"events\":{";
+	for(int e = 0; e < treestats::numEvents; ++e)
+		out += std::string(e ? "," : "") + "\"" + treestats::eventNames[e] + "\":" + std::to_string(events[e]);
+	out += "},\"ops\":{";
+	for(int op = 0; op < treestats::numOps; ++op){
+		const OpStats& s = ops[op];
+		snprintf(buffer, sizeof(buffer), "%s\"%s\":{\"count\":%llu,\"timed\":%llu,\"meanDepth\":%.3f,\"maxDepth\":%llu,"
+				"\"p50Ns\":%.0f,\"p90Ns\":%.0f,\"p99Ns\":%.0f,\"p999Ns\":%.0f}", op ? "," : "", treestats::opNames[op],
+				(unsigned long long)s.count, (unsigned long long)s.timed, s.meanDepth, (unsigned long long)s.maxDepth,
+				s.p50Ns, s.p90Ns, s.p99Ns, s.p999Ns);
+		out += buffer;
+	}
+	out += "}}";
+	return out;
+}
+
+inline std::string TreeStats::toPrometheus(const std::string& prefix) const{
+	std::string out;
+	char buffer[256];
+	auto gauge = [&](const char* name, const char* help, double value){
+		snprintf(buffer, sizeof(buffer), "# HELP %s_%s %s\n# TYPE %s_%s gauge\n%s_%s %.17g\n", prefix.c_str(), name, help,
+				prefix.c_str(), name, prefix.c_str(), name, value);
+		out += buffer;
+	};
+	gauge("height", "Levels from the root to the leaves.", height);
+	gauge("entries", "Keys stored.", entries);
+	gauge("leaf_nodes", "Leaf nodes.", leafNodes);
+	gauge("interior_nodes", "Interior nodes.", interiorNodes);
+
+	out += "# HELP " + prefix + "_level_nodes Nodes per level (0 holds the leaves) by fill, labelled with the upper edge of its decile.\n";
+	out += "# TYPE " + prefix + "_level_nodes gauge\n";
+	for(size_t l = 0; l < levels.size(); ++l){
+		for(int b = 0; b < treestats::fillBuckets; ++b){
+			snprintf(buffer, sizeof(buffer), "%s_level_nodes{level=\"%zu\",fill=\"%.1f\"} %zu\n", prefix.c_str(), l,
+					(double)(b + 1) / treestats::fillBuckets, levels[l].fill[b]);
+			out += buffer;
+		}
+	}
+	if(!countersEnabled)
+		return out;
+
+	out += "# HELP " + prefix + "_structural_events_total Node splits, redistributions and coalesces.\n";
+	out += "# TYPE " + prefix + "_structural_events_total counter\n";
+	for(int e = 0; e < treestats::numEvents; ++e)
+		out += prefix + "_structural_events_total{event=\"" + treestats::eventNames[e] + "\"} " + std::to_string(events[e]) + "\n";
+	out += "# HELP " + prefix + "_operations_total Operations by kind.\n";
+	out += "# TYPE " + prefix + "_operations_total counter\n";
+	for(int op = 0; op < treestats::numOps; ++op)
+		out += prefix + "_operations_total{op=\"" + treestats::opNames[op] + "\"} " + std::to_string(ops[op].count) + "\n";
+	out += "# HELP " + prefix + "_descent_depth_mean Mean nodes visited per descent.\n";
+	out += "# TYPE " + prefix + "_descent_depth_mean gauge\n";
+	for(int op = 0; op < treestats::numOps; ++op){
+		snprintf(buffer, sizeof(buffer), "%s_descent_depth_mean{op=\"%s\"} %.3f\n", prefix.c_str(), treestats::opNames[op], ops[op].meanDepth);
+		out += buffer;
+	}
+	out += "# HELP " + prefix + "_latency_ns Operation latency quantiles from sampled operations.\n";
+	out += "# TYPE " + prefix + "_latency_ns gauge\n";
+	for(int op = 0; op < treestats::numOps; ++op){
+		const OpStats& s = ops[op];
+		const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+		const double values[] = {s.p50Ns, s.p90Ns, s.p99Ns, s.p999Ns};
+		for(int q = 0; q < 4; ++q){
+			snprintf(buffer, sizeof(buffer), "%s_latency_ns{op=\"%s\",quantile=\"%g\"} %.0f\n", prefix.c_str(),
+					treestats::opNames[op], quantiles[q], values[q]);
+			out += buffer;
+		}
+	}
+	out += "# HELP " + prefix + "_latency_samples_total Operations timed for the latency quantiles.\n";
+	out += "# TYPE " + prefix + "_latency_samples_total counter\n";
+	for(int op = 0; op < treestats::numOps; ++op)
+		out += prefix + "_latency_samples_total{op=\"" + treestats::opNames[op] + "\"} " + std::to_string(ops[op].timed) + "\n";
+	return out;
+}
+/*===================== End of TreeStats =========================================*/
+
+#endif
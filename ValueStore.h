@@ -0,0 +1,97 @@
+#ifndef VALUE_STORE_H
+#define VALUE_STORE_H
+
+#include "NodeAllocator.h"
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+
+//Leaf-resident reference to a byte string. Values of up to inlineBytes bytes live inside the handle;
+//longer ones live in a ValueStore and the handle holds their address and length. A handle is 16 bytes
+//and trivially copyable, so splits, redistributions and merges move handles, never payloads.
+class alignas(8) ValueHandle{
+	public:
+		static constexpr size_t inlineBytes = 15;
+
+		ValueHandle() noexcept : raw{}, tag(0){
+		}
+		std::string_view view() const noexcept{ //Valid while the handle and its store entry are
+			if(tag != outOfLine)
+				return std::string_view(raw, tag);
+			return std::string_view(outOfLineData(), outOfLineLength());
+		}
+		size_t size() const noexcept{
+			return tag != outOfLine ? tag : outOfLineLength();
+		}
+		bool isInline() const noexcept{
+			return tag != outOfLine;
+		}
+	private:
+		friend class ValueStore;
+		static constexpr uint8_t outOfLine = 0xFF; //Any other tag is the inline length
+
+		const char* outOfLineData() const noexcept{
+			const char* data;
+			std::memcpy(&data, raw, sizeof(data));
+			return data;
+		}
+		uint32_t outOfLineLength() const noexcept{
+			uint32_t length;
+			std::memcpy(&length, raw + sizeof(const char*), sizeof(length));
+			return length;
+		}
+
+		char raw[inlineBytes];
+		uint8_t tag;
+};
+
+//Slab region for values too long to inline. Payloads are carved from large chunks of an
+//ArenaNodeAllocator in 64-byte size classes, and freed slots are reused by values of the same class.
+//Everything is returned when the store is destroyed or cleared.
+class ValueStore{
+	public:
+		explicit ValueStore(bool hugePages = false) noexcept : slab(hugePages){
+		}
+		ValueStore(const ValueStore&) = delete;
+		ValueStore& operator=(const ValueStore&) = delete;
+
+		ValueHandle store(std::string_view);
+		void release(const ValueHandle&) noexcept; //Free the payload of a handle made by store()
+		void clear() noexcept{ //Drop every payload, invalidating all handles
+			slab.release();
+		}
+		size_t bytesReserved() const noexcept{
+			return slab.bytesReserved();
+		}
+	private:
+		ArenaNodeAllocator slab;
+};
+
+/*==================== ValueStore implementation ==========================*/
+inline ValueHandle ValueStore::store(std::string_view value){
+	ValueHandle handle;
+	if(value.size() <= ValueHandle::inlineBytes){
+		std::memcpy(handle.raw, value.data(), value.size());
+		handle.tag = value.size();
+		return handle;
+	}
+	if(value.size() > UINT32_MAX)
+		throw std::length_error("ValueStore: value longer than 4 GiB");
+	char* data = static_cast<char*>(slab.allocate(value.size()));
+	std::memcpy(data, value.data(), value.size());
+	uint32_t length = value.size();
+	const char* address = data;
+	std::memcpy(handle.raw, &address, sizeof(address));
+	std::memcpy(handle.raw + sizeof(address), &length, sizeof(length));
+	handle.tag = ValueHandle::outOfLine;
+	return handle;
+}
+
+inline void ValueStore::release(const ValueHandle& handle) noexcept{
+	if(!handle.isInline())
+		slab.deallocate(const_cast<char*>(handle.outOfLineData()), handle.outOfLineLength());
+}
+/*===================== End of ValueStore =========================================*/
+
+#endif
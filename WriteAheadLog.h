@@ -0,0 +1,316 @@
+#ifndef WRITE_AHEAD_LOG_H
+#define WRITE_AHEAD_LOG_H
+
+#include<array>
+#include<cerrno>
+#include<chrono>
+#include<condition_variable>
+#include<cstdint>
+#include<cstdio>
+#include<cstring>
+#include<mutex>
+#include<system_error>
+#include<thread>
+#include<vector>
+#include<fcntl.h>
+#include<sys/stat.h>
+#include<unistd.h>
+#if defined(__x86_64__)
+#include<immintrin.h>
+#endif
+
+//Append-only log of typed records. Each record is framed as
+//	uint32 payload length | uint32 CRC32C of type and payload | uint8 type | payload
+//so replay can stop at the first torn or corrupt record, which is where a crash cut the log.
+//append() only buffers a record and hands out its log sequence number (LSN); commit(lsn) makes it
+//durable as the sync policy asks:
+//	everyOp:  commit waits until the record is on disk. Callers that commit together share one write
+//	          and one fdatasync (group commit): whoever finds no sync running flushes for everyone.
+//	batched:  commit syncs once batchRecords records are pending; a crash loses at most that many.
+//	interval: a background thread syncs every interval; a crash loses at most that much time.
+//I/O failures throw std::system_error. A failed write is cut back off the file and its records stay
+//pending for the next sync to retry. A failed fdatasync may have lost pages that a retry would then report
+//as durable, so it leaves the log failed: every later append, commit and sync throws.
+class WriteAheadLog{
+	public:
+		enum class SyncPolicy{
+			everyOp,
+			batched,
+			interval
+		};
+		struct Options{
+			SyncPolicy sync = SyncPolicy::everyOp;
+			unsigned batchRecords = 128;
+			std::chrono::milliseconds interval = std::chrono::milliseconds(10);
+		};
+
+		WriteAheadLog() : WriteAheadLog(Options()){
+		}
+		explicit WriteAheadLog(Options);
+		WriteAheadLog(const WriteAheadLog&) = delete;
+		WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+		~WriteAheadLog();
+
+		bool open(const char* path); //Opens or creates path for appending; false if it cannot be opened
+		void close();
+		//Call fn(type, payload, length) for every intact record from the start of the log, then cut off
+		//a torn or corrupt tail so later appends follow the last good record. Call before appending.
+		//Returns the number of records replayed.
+		template<typename Fn>
+		size_t replay(Fn&& fn);
+		uint64_t append(uint8_t type, const void* payload, uint32_t length);
+		void commit(uint64_t lsn);
+		void sync(); //Make every appended record durable, whatever the policy
+		void truncate(); //Drop every record, once they are covered by a checkpoint
+	private:
+		static constexpr size_t recordHeaderBytes = 9;
+		void syncUpTo(std::unique_lock<std::mutex>&, uint64_t);
+		void intervalLoop();
+
+		Options options;
+		int fd;
+		std::mutex mutex;
+		std::condition_variable synced;
+		std::vector<char> pending; //Encoded records not yet written
+		std::vector<char> writing; //Records being written by the current sync
+		uint64_t lastLsn; //Last LSN handed out
+		uint64_t syncedLsn; //Every record up to this LSN is durable
+		off_t fileBytes; //End of the last record written whole
+		int failedError; //errno of the failure that left the log unusable, else 0
+		bool syncing;
+		bool stopping;
+		std::thread flusher;
+};
+
+namespace wal{
+
+//CRC32C (Castagnoli), with the SSE4.2 instruction when the CPU has it
+inline uint32_t crc32cScalar(uint32_t crc, const unsigned char* p, size_t n) noexcept{
+	static const auto table = []{
+		std::array<uint32_t, 256> t{};
+		for(uint32_t i = 0; i < 256; ++i){
+			uint32_t c = i;
+			for(int b = 0; b < 8; ++b)
+				c = c & 1 ? (c >> 1) ^ 0x82F63B78u : c >> 1;
+			t[i] = c;
+		}
+		return t;
+	}();
+	for(size_t i = 0; i < n; ++i)
+		crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+	return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) inline uint32_t crc32cSse42(uint32_t crc, const unsigned char* p, size_t n) noexcept{
+	uint64_t c = crc;
+	for(; n >= 8; n -= 8, p += 8){
+		uint64_t word;
+		std::memcpy(&word, p, 8);
+		c = _mm_crc32_u64(c, word);
+	}
+	for(; n > 0; --n, ++p)
+		c = _mm_crc32_u8((uint32_t)c, *p);
+	return (uint32_t)c;
+}
+#endif
+
+inline uint32_t crc32c(const void* data, size_t n, uint32_t crc = 0) noexcept{
+	typedef uint32_t (*CrcFn)(uint32_t, const unsigned char*, size_t);
+	static const CrcFn fn = []() -> CrcFn{
+#if defined(__x86_64__)
+		__builtin_cpu_init();
+		if(__builtin_cpu_supports("sse4.2"))
+			return &crc32cSse42;
+#endif
+		return &crc32cScalar;
+	}();
+	return ~fn(~crc, static_cast<const unsigned char*>(data), n);
+}
+
+}
+
+/*==================== WriteAheadLog implementation ==========================*/
+inline WriteAheadLog::WriteAheadLog(Options opts)
+	: options(opts), fd(-1), lastLsn(0), syncedLsn(0), fileBytes(0), failedError(0), syncing(false), stopping(false){
+}
+
+inline WriteAheadLog::~WriteAheadLog(){
+	try{
+		close();
+	}catch(...){
+		//A failed final sync cannot be reported here; call close() first to see it
+	}
+}
+
+inline bool WriteAheadLog::open(const char* path){
+	close();
+	fd = ::open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+	if(fd < 0)
+		return false;
+	struct stat st;
+	if(fstat(fd, &st) != 0){
+		::close(fd);
+		fd = -1;
+		return false;
+	}
+	fileBytes = st.st_size;
+	failedError = 0;
+	stopping = false;
+	if(options.sync == SyncPolicy::interval)
+		flusher = std::thread(&WriteAheadLog::intervalLoop, this);
+	return true;
+}
+
+inline void WriteAheadLog::close(){
+	if(fd < 0)
+		return;
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+		stopping = true;
+	}
+	synced.notify_all();
+	if(flusher.joinable())
+		flusher.join();
+	sync();
+	::close(fd);
+	fd = -1;
+}
+
+template<typename Fn>
+size_t WriteAheadLog::replay(Fn&& fn){
+	std::vector<char> payload;
+	size_t count = 0;
+	off_t offset = 0;
+	struct stat st;
+	if(fstat(fd, &st) != 0)
+		throw std::system_error(errno, std::generic_category(), "WriteAheadLog: fstat");
+	for(;;){
+		unsigned char header[recordHeaderBytes];
+		if(pread(fd, header, sizeof(header), offset) != (ssize_t)sizeof(header))
+			break;
+		uint32_t length, crc;
+		std::memcpy(&length, header, 4);
+		std::memcpy(&crc, header + 4, 4);
+		uint8_t type = header[8];
+		if(length > st.st_size - offset - (off_t)sizeof(header)) //A corrupt length, or a record cut short
+			break;
+		payload.resize(length);
+		if(length > 0 && pread(fd, payload.data(), length, offset + sizeof(header)) != (ssize_t)length)
+			break;
+		if(wal::crc32c(payload.data(), length, wal::crc32c(&type, 1)) != crc)
+			break;
+		fn(type, static_cast<const void*>(payload.data()), length);
+		offset += sizeof(header) + length;
+		++count;
+	}
+	if(ftruncate(fd, offset) != 0)
+		throw std::system_error(errno, std::generic_category(), "WriteAheadLog: ftruncate");
+	std::lock_guard<std::mutex> guard(mutex);
+	fileBytes = offset;
+	return count;
+}
+
+inline uint64_t WriteAheadLog::append(uint8_t type, const void* payload, uint32_t length){
+	uint32_t crc = wal::crc32c(payload, length, wal::crc32c(&type, 1));
+	std::lock_guard<std::mutex> guard(mutex);
+	if(failedError)
+		throw std::system_error(failedError, std::generic_category(), "WriteAheadLog: failed earlier");
+	size_t at = pending.size();
+	pending.resize(at + recordHeaderBytes + length);
+	char* record = pending.data() + at;
+	std::memcpy(record, &length, 4);
+	std::memcpy(record + 4, &crc, 4);
+	record[8] = type;
+	std::memcpy(record + recordHeaderBytes, payload, length);
+	return ++lastLsn;
+}
+
+//Wait until lsn is durable. If no other thread is syncing, become the leader: take every pending
+//record, write and sync them without holding the lock, then wake everyone they cover.
+//If the write fails, the file is cut back to where it started, so no torn record is left for later
+//records to follow, and the records go back in front of pending. If that cut or the fdatasync fails,
+//the records may be lost while their LSNs are handed out, so the log is marked failed instead.
+inline void WriteAheadLog::syncUpTo(std::unique_lock<std::mutex>& lock, uint64_t lsn){
+	while(syncedLsn < lsn){
+		if(failedError)
+			throw std::system_error(failedError, std::generic_category(), "WriteAheadLog: failed earlier");
+		if(syncing){
+			synced.wait(lock);
+			continue;
+		}
+		syncing = true;
+		uint64_t target = lastLsn;
+		off_t start = fileBytes;
+		writing.swap(pending);
+		lock.unlock();
+		int error = 0;
+		size_t done = 0;
+		while(done < writing.size() && !error){
+			ssize_t n = ::write(fd, writing.data() + done, writing.size() - done);
+			if(n < 0 && errno != EINTR)
+				error = errno;
+			else if(n > 0)
+				done += n;
+		}
+		bool written = !error;
+		if(written && fdatasync(fd) != 0)
+			error = errno;
+		bool retryable = !written && ftruncate(fd, start) == 0;
+		lock.lock();
+		syncing = false;
+		if(!error){
+			syncedLsn = target;
+			fileBytes = start + writing.size();
+		}else if(retryable){
+			writing.insert(writing.end(), pending.begin(), pending.end());
+			pending.swap(writing);
+		}else{
+			failedError = error;
+		}
+		writing.clear();
+		synced.notify_all();
+		if(error)
+			throw std::system_error(error, std::generic_category(), written ? "WriteAheadLog: fdatasync" : "WriteAheadLog: write");
+	}
+}
+
+inline void WriteAheadLog::commit(uint64_t lsn){
+	std::unique_lock<std::mutex> lock(mutex);
+	if(options.sync == SyncPolicy::everyOp)
+		syncUpTo(lock, lsn);
+	else if(options.sync == SyncPolicy::batched && lastLsn - syncedLsn >= options.batchRecords)
+		syncUpTo(lock, lastLsn);
+}
+
+inline void WriteAheadLog::sync(){
+	std::unique_lock<std::mutex> lock(mutex);
+	syncUpTo(lock, lastLsn);
+}
+
+inline void WriteAheadLog::truncate(){
+	std::unique_lock<std::mutex> lock(mutex);
+	syncUpTo(lock, lastLsn);
+	if(ftruncate(fd, 0) != 0)
+		throw std::system_error(errno, std::generic_category(), "WriteAheadLog: truncate");
+	fileBytes = 0;
+	if(fdatasync(fd) != 0)
+		throw std::system_error(errno, std::generic_category(), "WriteAheadLog: truncate");
+}
+
+inline void WriteAheadLog::intervalLoop(){
+	std::unique_lock<std::mutex> lock(mutex);
+	while(!stopping){
+		synced.wait_for(lock, options.interval);
+		if(!stopping && syncedLsn < lastLsn && !failedError){
+			try{
+				syncUpTo(lock, lastLsn);
+			}catch(const std::system_error&){
+				//Retried next interval; once the log has failed, commit and sync report it
+			}
+		}
+	}
+}
+/*===================== End of WriteAheadLog =========================================*/
+
+#endif
@@ -0,0 +1,180 @@
+#ifndef BASELINE_TREE_H
+#define BASELINE_TREE_H
+
+#include<algorithm>
+#include<cstdint>
+#include<memory>
+#include<vector>
+
+//The node layout BpTree had before the packed nodes of Node.h, kept only so bench/layout_bench.cpp can
+//measure old and new side by side: polymorphic nodes with a parent pointer, keys and values in separately
+//allocated std::vectors, children behind unique_ptrs and a capacity chosen at run time. Lookups descend
+//through the virtual getNextNode and then search the leaf linearly twice, as the original did. Only insert
+//and find are kept, and keys and values are uint64_t where the original stored int keys and strings.
+namespace baseline{
+
+typedef uint64_t Key;
+typedef uint64_t Value;
+
+class Node{
+	public:
+		explicit Node(int limit) : parent(nullptr), keysLimit(limit){
+		}
+		virtual ~Node(){
+		}
+		bool hasKey(Key k) const noexcept{
+			return std::find(keys.begin(), keys.end(), k) != keys.end();
+		}
+		int getIndexOfKey(Key k) const noexcept{
+			auto it = std::find(keys.begin(), keys.end(), k);
+			return it != keys.end() ? (int)(it - keys.begin()) : -1;
+		}
+		bool isLimitExceeded() const noexcept{
+			return (int)keys.size() > keysLimit;
+		}
+		virtual bool isLeafNode() const noexcept = 0;
+		virtual Node* getNextNode(Key) const noexcept = 0;
+
+		Node* parent;
+		std::vector<Key> keys;
+		int keysLimit;
+};
+
+class InteriorNode : public Node{
+	public:
+		explicit InteriorNode(int limit) : Node(limit){
+			next.reserve(limit + 1);
+		}
+		InteriorNode(int limit, std::unique_ptr<Node> n) : Node(limit){
+			next.push_back(std::move(n));
+		}
+		bool isLeafNode() const noexcept override{
+			return false;
+		}
+		Node* getNextNode(Key k) const noexcept override{
+			return next[std::upper_bound(keys.begin(), keys.end(), k) - keys.begin()].get();
+		}
+		void insertKey(Key k, std::unique_ptr<Node> newNode){
+			auto keyPos = std::upper_bound(keys.begin(), keys.end(), k);
+			auto nextPos = next.begin() + (keyPos - keys.begin()) + 1;
+			keys.insert(keyPos, k);
+			newNode->parent = this;
+			next.insert(nextPos, std::move(newNode));
+		}
+		//Moves the upper half into newSplitNode and returns the key that goes up to the parent
+		Key split(InteriorNode* newSplitNode){
+			int numOfRemainingKeys = (keysLimit + 1) / 2;
+			newSplitNode->keys.assign(keys.begin() + numOfRemainingKeys + 1, keys.end());
+			keys.erase(keys.begin() + numOfRemainingKeys + 1, keys.end());
+			Key removedKey = keys.back();
+			keys.pop_back();
+			auto splitBegin = next.begin() + (keysLimit + 3) / 2;
+			for(auto it = splitBegin; it != next.end(); ++it){
+				(*it)->parent = newSplitNode;
+				newSplitNode->next.push_back(std::move(*it));
+			}
+			next.erase(splitBegin, next.end());
+			return removedKey;
+		}
+
+		std::vector<std::unique_ptr<Node>> next;
+};
+
+class LeafNode : public Node{
+	public:
+		explicit LeafNode(int limit) : Node(limit), nextLeaf(nullptr), prevLeaf(nullptr){
+			vals.reserve(limit);
+		}
+		bool isLeafNode() const noexcept override{
+			return true;
+		}
+		Node* getNextNode(Key) const noexcept override{
+			return nextLeaf;
+		}
+		Value getVal(Key k) const noexcept{
+			int keyIndex = getIndexOfKey(k);
+			return keyIndex == -1 ? Value() : vals[keyIndex];
+		}
+		void insertKey(Key k, const Value& v){
+			auto keyPos = std::upper_bound(keys.begin(), keys.end(), k);
+			vals.insert(vals.begin() + (keyPos - keys.begin()), v);
+			keys.insert(keyPos, k);
+		}
+		//Moves the upper half into newSplitNode and returns its first key
+		Key split(LeafNode* newSplitNode){
+			int numOfRemainingKeys = (keysLimit + 2) / 2;
+			newSplitNode->keys.assign(keys.begin() + numOfRemainingKeys, keys.end());
+			keys.erase(keys.begin() + numOfRemainingKeys, keys.end());
+			newSplitNode->vals.assign(vals.begin() + numOfRemainingKeys, vals.end());
+			vals.erase(vals.begin() + numOfRemainingKeys, vals.end());
+			newSplitNode->nextLeaf = nextLeaf;
+			newSplitNode->prevLeaf = this;
+			if(nextLeaf)
+				nextLeaf->prevLeaf = newSplitNode;
+			nextLeaf = newSplitNode;
+			return newSplitNode->keys.front();
+		}
+
+		LeafNode* nextLeaf;
+		LeafNode* prevLeaf;
+		std::vector<Value> vals;
+};
+
+class BpTree{
+	public:
+		explicit BpTree(int limit) : keysLimit(limit), root(new LeafNode(limit)){
+		}
+		bool insert(Key k, const Value& v){
+			LeafNode* node = findNodeOfKey(k);
+			if(node->hasKey(k))
+				return false;
+			node->insertKey(k, v);
+			if(!node->isLimitExceeded())
+				return true;
+			if(!node->parent){
+				root.reset(new InteriorNode(keysLimit, std::move(root)));
+				node->parent = root.get();
+			}
+			std::unique_ptr<Node> rightNode(new LeafNode(keysLimit));
+			Key up = node->split(static_cast<LeafNode*>(rightNode.get()));
+			insertInteriorNode(static_cast<InteriorNode*>(node->parent), up, std::move(rightNode));
+			return true;
+		}
+		Value find(Key k) const noexcept{
+			LeafNode* node = findNodeOfKey(k);
+			return node->hasKey(k) ? node->getVal(k) : Value();
+		}
+		size_t leafBytes() const noexcept{ //The node itself plus its key and value arrays at capacity
+			return sizeof(LeafNode) + (keysLimit + 1) * sizeof(Key) + keysLimit * sizeof(Value);
+		}
+		size_t interiorBytes() const noexcept{
+			return sizeof(InteriorNode) + (keysLimit + 1) * (sizeof(Key) + sizeof(std::unique_ptr<Node>));
+		}
+	private:
+		LeafNode* findNodeOfKey(Key k) const noexcept{
+			Node* cur = root.get();
+			while(!cur->isLeafNode())
+				cur = cur->getNextNode(k);
+			return static_cast<LeafNode*>(cur);
+		}
+		void insertInteriorNode(InteriorNode* node, Key k, std::unique_ptr<Node> newNode){
+			node->insertKey(k, std::move(newNode));
+			if(!node->isLimitExceeded())
+				return;
+			if(!node->parent){
+				InteriorNode* oldRoot = static_cast<InteriorNode*>(root.release());
+				root.reset(new InteriorNode(keysLimit, std::unique_ptr<Node>(oldRoot)));
+				oldRoot->parent = root.get();
+			}
+			std::unique_ptr<Node> splitNode(new InteriorNode(keysLimit));
+			Key removedKey = node->split(static_cast<InteriorNode*>(splitNode.get()));
+			insertInteriorNode(static_cast<InteriorNode*>(node->parent), removedKey, std::move(splitNode));
+		}
+
+		int keysLimit;
+		std::unique_ptr<Node> root;
+};
+
+}
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstdint>
+#include <cstring>
+
+//Thin wrapper over perf_event_open for one hardware counter of the calling thread.
+//When the kernel or container does not allow perf events, available() is false and read() returns 0.
+class PerfCounter{
+	public:
+		PerfCounter(uint32_t type, uint64_t config) : fd(-1){
+			perf_event_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = type;
+			attr.config = config;
+			attr.disabled = 1;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+		}
+		PerfCounter(const PerfCounter&) = delete;
+		PerfCounter& operator=(const PerfCounter&) = delete;
+		~PerfCounter(){
+			if(fd >= 0)
+				close(fd);
+		}
+		bool available() const noexcept{
+			return fd >= 0;
+		}
+		void start() noexcept{
+			if(fd < 0)
+				return;
+			ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+			ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+		}
+		uint64_t stop() noexcept{
+			if(fd < 0)
+				return 0;
+			ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+			uint64_t count = 0;
+			if(::read(fd, &count, sizeof(count)) != sizeof(count))
+				return 0;
+			return count;
+		}
+	private:
+		int fd;
+};
+
+//Last-level cache misses and data TLB misses
+inline PerfCounter cacheMissCounter(){
+	return PerfCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+}
+
+inline PerfCounter dtlbMissCounter(){
+	return PerfCounter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+}
+
+#endif
@@ -0,0 +1,135 @@
+#include "../BpTree.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+//Heap allocations per operation on a tree of std::string keys and values too long for the small-string
+//buffer, counted by replacing the global operator new. Copying inserts pay for a key and a value string
+//each; moving inserts, emplace and upsert of moved values only pay for the nodes and separators that
+//splits create, and a string_view probe under std::less<> finds without building a string.
+//Moving the whole tree allocates nothing.
+//Usage: alloc_bench [numKeys=200000]
+
+static size_t numAllocs = 0;
+
+void* operator new(size_t bytes){
+	++numAllocs;
+	if(void* p = std::malloc(bytes ? bytes : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void* operator new(size_t bytes, std::align_val_t align){
+	++numAllocs;
+	size_t alignment = (size_t)align;
+	if(void* p = std::aligned_alloc(alignment, (bytes + alignment - 1) / alignment * alignment))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept{
+	std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept{
+	std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept{
+	std::free(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept{
+	std::free(p);
+}
+
+typedef BpTree<std::string, std::string, std::less<>, fanoutForBytes<std::string, std::string>(1024)> Tree;
+typedef BpTree<std::string, std::string, std::less<std::string>, fanoutForBytes<std::string, std::string>(1024)> StrictTree;
+
+//Run op(i) for i in [0, n) and print allocations and time per call
+template<typename Op>
+void measure(const char* name, size_t n, Op&& op){
+	size_t before = numAllocs;
+	auto begin = std::chrono::steady_clock::now();
+	for(size_t i = 0; i < n; ++i)
+		op(i);
+	double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+	printf("%-24s allocs/op=%.3f ns/op=%.1f\n", name, double(numAllocs - before) / n, ns / n);
+}
+
+std::string keyOf(size_t i){
+	char buf[64];
+	snprintf(buf, sizeof(buf), "user:%020zu:session-key", (i * 2654435761u) % 1000000007u);
+	return buf;
+}
+
+int main(int argc, char** argv){
+	size_t numKeys = argc > 1 ? strtoull(argv[1], nullptr, 10) : 200000;
+	std::vector<std::string> keys(numKeys), vals(numKeys);
+	for(size_t i = 0; i < numKeys; ++i){
+		keys[i] = keyOf(i);
+		vals[i] = std::string(40, 'a' + i % 26);
+	}
+	printf("keys=%zu keysLimit=%d\n", numKeys, Tree::keysLimit);
+
+	{
+		Tree tree;
+		measure("insert copy", numKeys, [&](size_t i){
+			tree.insert(keys[i], vals[i]);
+		});
+	}
+	Tree tree;
+	{
+		std::vector<std::string> movedKeys = keys, movedVals = vals;
+		measure("insert move", numKeys, [&](size_t i){
+			tree.insert(std::move(movedKeys[i]), std::move(movedVals[i]));
+		});
+		TreeStats stats = tree.stats();
+		printf("%-24s nodes/key=%.3f\n", "  (node allocations)", double(stats.leafNodes + stats.interiorNodes) / numKeys);
+	}
+	{
+		Tree other;
+		std::vector<std::string> movedKeys = keys;
+		measure("emplace move key", numKeys, [&](size_t i){
+			other.emplace(std::move(movedKeys[i]), 40, 'e');
+		});
+	}
+	measure("emplace present", numKeys, [&](size_t i){
+		tree.emplace(keys[i], 40, 'e');
+	});
+	{
+		std::vector<std::string> newVals = vals;
+		measure("upsert present move", numKeys, [&](size_t i){
+			tree.upsert(keys[i], std::move(newVals[i]));
+		});
+	}
+	size_t found = 0;
+	measure("find string_view", numKeys, [&](size_t i){
+		found += tree.findPtr(std::string_view(keys[i])) != nullptr;
+	});
+	{
+		StrictTree strict;
+		for(size_t i = 0; i < numKeys; ++i)
+			strict.insert(keys[i], vals[i]);
+		measure("find via std::string", numKeys, [&](size_t i){
+			found += strict.findPtr(std::string(std::string_view(keys[i]))) != nullptr;
+		});
+	}
+	measure("move construct tree", 1, [&](size_t){
+		Tree moved(std::move(tree));
+		tree = std::move(moved);
+	});
+	measure("remove", numKeys, [&](size_t i){
+		tree.remove(keys[i]);
+	});
+	std::string error;
+	if(!tree.validate(&error))
+		printf("invalid tree: %s\n", error.c_str());
+	printf("found=%zu\n", found);
+	return 0;
+}
@@ -0,0 +1,52 @@
+#include "../BpTree.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+//Insert throughput and resulting node memory for keys arriving in order (sequence numbers), nearly in
+//order (timestamps where 1% arrive late, out of order) and in random order. In-order keys take the append
+//path and fill every node; random keys show the midpoint splits that leave nodes about 70% full.
+//Usage: append_bench [numKeys=5000000]
+
+typedef BpTree<uint64_t, uint64_t, std::less<uint64_t>, fanoutForBytes<uint64_t, uint64_t>(256)> Tree;
+
+void run(const char* name, const std::vector<uint64_t>& keys){
+	Tree tree;
+	auto begin = std::chrono::steady_clock::now();
+	for(auto k : keys)
+		tree.insert(k, k);
+	double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / keys.size();
+	TreeStats stats = tree.stats();
+	double mib = (stats.leafNodes * sizeof(Tree::LeafNode) + stats.interiorNodes * sizeof(Tree::InteriorNode)) / double(1 << 20);
+	printf("%-10s insert ns=%.1f leaves=%zu leafFill=%.0f%% height=%d nodeMiB=%.1f bytes/key=%.1f\n", name, ns, stats.leafNodes,
+			100.0 * stats.entries / (stats.leafNodes * Tree::keysLimit), stats.height, mib, mib * (1 << 20) / keys.size());
+}
+
+int main(int argc, char** argv){
+	size_t numKeys = argc > 1 ? strtoull(argv[1], nullptr, 10) : 5000000;
+	std::mt19937_64 rng(42);
+	std::vector<uint64_t> keys(numKeys);
+	for(size_t i = 0; i < numKeys; ++i)
+		keys[i] = i * 16;
+	run("sequential", keys);
+
+	//Late arrivals are inserted up to 500 positions after their turn
+	std::vector<std::pair<size_t, uint64_t>> arrivals(numKeys);
+	for(size_t i = 0; i < numKeys; ++i)
+		arrivals[i] = {rng() % 100 == 0 ? i + 1 + rng() % 500 : i, keys[i]};
+	std::stable_sort(arrivals.begin(), arrivals.end(), [](const std::pair<size_t, uint64_t>& a, const std::pair<size_t, uint64_t>& b){
+		return a.first < b.first;
+	});
+	std::vector<uint64_t> nearly(numKeys);
+	for(size_t i = 0; i < numKeys; ++i)
+		nearly[i] = arrivals[i].second;
+	run("nearly", nearly);
+
+	std::shuffle(keys.begin(), keys.end(), rng);
+	run("random", keys);
+	return 0;
+}
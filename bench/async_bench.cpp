@@ -0,0 +1,150 @@
+#include "../PagedBpTree.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <unistd.h>
+
+//Random lookups and range scans on a page-based index many times larger than its buffer pool, read
+//with blocking pread against findAsync and scanAsync over the pread thread pool and over io_uring, at
+//several numbers of lookups kept in flight. Each run reopens the file so it starts with a cold pool; with
+//direct=1 the file is opened with O_DIRECT so reads reach the device rather than the kernel's page cache
+//(use direct=0 for a path on tmpfs). Last, random inserts that dirty more pages than the pool holds,
+//then flush(), written back a page at a time and in batches.
+//Usage: async_bench [path=/tmp/async_bench.db] [numKeys=4000000] [poolFrames=1024] [numLookups=20000] [direct=1]
+
+typedef PagedBpTree<uint64_t, uint64_t> Tree;
+
+double secondsSince(std::chrono::steady_clock::time_point begin){
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+//Keys are the even numbers below 2 * numKeys
+uint64_t randomKey(std::mt19937_64& rng, size_t numKeys){
+	return rng() % numKeys * 2;
+}
+
+std::unique_ptr<Tree> reopen(const char* path, size_t poolFrames, bool direct, AsyncIo* io){
+	std::unique_ptr<Tree> tree(new Tree(poolFrames));
+	if(!tree->open(path, direct)){
+		perror(path);
+		exit(1);
+	}
+	tree->setAsyncIo(io);
+	return tree;
+}
+
+int main(int argc, char** argv){
+	const char* path = argc > 1 ? argv[1] : "/tmp/async_bench.db";
+	size_t numKeys = argc > 2 ? strtoull(argv[2], nullptr, 10) : 4000000;
+	size_t poolFrames = argc > 3 ? strtoull(argv[3], nullptr, 10) : 1024;
+	size_t numLookups = argc > 4 ? strtoull(argv[4], nullptr, 10) : 20000;
+	bool direct = argc > 5 ? atoi(argv[5]) != 0 : true;
+	unlink(path);
+
+	{
+		Tree tree(poolFrames);
+		if(!tree.open(path, direct)){
+			perror(path);
+			return 1;
+		}
+		for(size_t i = 0; i < numKeys; ++i)
+			tree.insert(2 * i, i);
+		printf("file: keys=%zu fileMiB=%.1f poolMiB=%.1f direct=%d\n", numKeys,
+				(double)tree.bufferPool().pageCount() * BufferPool::pageSize / (1 << 20),
+				(double)poolFrames * BufferPool::pageSize / (1 << 20), direct);
+	}
+
+	AsyncIo threads(AsyncIo::defaultDepth, AsyncIo::defaultThreads, false);
+	AsyncIo ring(AsyncIo::defaultDepth);
+	struct Backend{
+		const char* name;
+		AsyncIo* io;
+	};
+	const Backend backends[] = {{"pread threads", &threads}, {"io_uring", ring.usingIoUring() ? &ring : nullptr}};
+
+	std::mt19937_64 rng(42);
+	uint64_t sum = 0;
+	{
+		auto tree = reopen(path, poolFrames, direct, nullptr);
+		auto begin = std::chrono::steady_clock::now();
+		for(size_t i = 0; i < numLookups; ++i){
+			uint64_t v = 0;
+			tree->find(randomKey(rng, numKeys), v);
+			sum += v;
+		}
+		printf("lookups %-14s          lookups/s=%9.0f\n", "blocking", numLookups / secondsSince(begin));
+	}
+	for(const Backend& backend : backends){
+		if(!backend.io){
+			printf("lookups %-14s unavailable\n", backend.name);
+			continue;
+		}
+		for(size_t inFlight : {1, 8, 32, 128}){
+			auto tree = reopen(path, poolFrames, direct, backend.io);
+			size_t issued = 0, found = 0, failed = 0;
+			auto begin = std::chrono::steady_clock::now();
+			while(issued < numLookups || tree->outstanding() > 0){
+				for(; issued < numLookups && tree->outstanding() < inFlight; ++issued){
+					tree->findAsync(randomKey(rng, numKeys), [&](bool ok, bool hit, const uint64_t& v){
+						failed += !ok;
+						found += hit;
+						sum += v;
+					});
+				}
+				tree->wait();
+			}
+			printf("lookups %-14s inFlight=%-3zu lookups/s=%9.0f found=%zu failed=%zu\n", backend.name, inFlight,
+					numLookups / secondsSince(begin), found, failed);
+		}
+	}
+
+	//One scan over a tenth of the keys, starting at a random key
+	const uint64_t scanLo = randomKey(rng, numKeys * 9 / 10), scanHi = scanLo + numKeys / 5;
+	{
+		auto tree = reopen(path, poolFrames, direct, nullptr);
+		size_t visited = 0;
+		auto begin = std::chrono::steady_clock::now();
+		tree->scan(scanLo, scanHi, [&](uint64_t, uint64_t v){
+			++visited;
+			sum += v;
+		});
+		printf("scan    %-14s          keys/s=%12.0f keys=%zu\n", "blocking", visited / secondsSince(begin), visited);
+	}
+	for(const Backend& backend : backends){
+		if(!backend.io)
+			continue;
+		auto tree = reopen(path, poolFrames, direct, backend.io);
+		size_t visited = 0;
+		bool complete = false;
+		auto begin = std::chrono::steady_clock::now();
+		tree->scanAsync(scanLo, scanHi, [&](uint64_t, uint64_t v){
+			++visited;
+			sum += v;
+		}, [&](bool ok){
+			complete = ok;
+		});
+		tree->drain();
+		printf("scan    %-14s          keys/s=%12.0f keys=%zu prefetchLeaves=%zu%s\n", backend.name,
+				visited / secondsSince(begin), visited, Tree::prefetchLeaves, complete ? "" : " (failed)");
+	}
+
+	//Odd keys are new, so every insert dirties a leaf
+	for(const Backend& backend : {Backend{"one at a time", nullptr}, backends[1].io ? backends[1] : backends[0]}){
+		auto tree = reopen(path, poolFrames, direct, backend.io);
+		size_t numInserts = poolFrames * 8;
+		auto begin = std::chrono::steady_clock::now();
+		for(size_t i = 0; i < numInserts; ++i)
+			tree->insert(randomKey(rng, numKeys) + 1, i);
+		double insertSeconds = secondsSince(begin);
+		begin = std::chrono::steady_clock::now();
+		tree->flush();
+		printf("writes  %-14s          inserts/s=%9.0f flush ms=%.1f\n", backend.io ? backend.name : "one at a time",
+				numInserts / insertSeconds, secondsSince(begin) * 1e3);
+	}
+	printf("checksum=%llu\n", (unsigned long long)sum);
+	unlink(path);
+	return 0;
+}
@@ -0,0 +1,63 @@
+#include "../BpTree.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+//Random point lookups issued in batches, as a loop of find() calls and through findBatch().
+//Reports nanoseconds per lookup for several batch sizes.
+//Usage: batch_bench [numKeys=10000000] [numLookups=2000000]
+
+typedef BpTree<uint64_t, uint64_t, std::less<uint64_t>, fanoutForBytes<uint64_t, uint64_t>(256), ArenaNodeAllocator> Tree;
+
+double nsPerLookup(std::chrono::steady_clock::time_point begin, size_t lookups){
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / lookups;
+}
+
+void runBatch(Tree& tree, const std::vector<uint64_t>& probes, size_t batchSize){
+	size_t numBatches = probes.size() / batchSize;
+	uint64_t loopSum = 0, batchSum = 0;
+
+	auto begin = std::chrono::steady_clock::now();
+	for(size_t b = 0; b < numBatches; ++b){
+		for(size_t i = b * batchSize; i < (b + 1) * batchSize; ++i)
+			loopSum += tree.find(probes[i]);
+	}
+	double loopNs = nsPerLookup(begin, numBatches * batchSize);
+
+	std::vector<uint64_t*> results(batchSize);
+	begin = std::chrono::steady_clock::now();
+	for(size_t b = 0; b < numBatches; ++b){
+		tree.findBatch(Span<const uint64_t>{probes.data() + b * batchSize, batchSize}, Span<uint64_t*>{results.data(), batchSize});
+		for(auto r : results)
+			batchSum += r ? *r : 0;
+	}
+	double batchNs = nsPerLookup(begin, numBatches * batchSize);
+
+	printf("batch=%-5zu find ns/lookup=%-8.1f findBatch ns/lookup=%-8.1f speedup=%-5.2f %s\n", batchSize,
+			loopNs, batchNs, loopNs / batchNs, loopSum == batchSum ? "ok" : "MISMATCH");
+}
+
+int main(int argc, char** argv){
+	size_t numKeys = argc > 1 ? strtoull(argv[1], nullptr, 10) : 10000000;
+	size_t numLookups = argc > 2 ? strtoull(argv[2], nullptr, 10) : 2000000;
+
+	std::mt19937_64 rng(42);
+	std::vector<std::pair<uint64_t, uint64_t>> entries(numKeys);
+	for(auto& e : entries){
+		e.first = rng();
+		e.second = e.first;
+	}
+	std::vector<uint64_t> probes(numLookups);
+	for(auto& p : probes)
+		p = rng() % 4 ? entries[rng() % numKeys].first : rng(); //A quarter of the probes miss
+	std::sort(entries.begin(), entries.end());
+
+	Tree tree;
+	tree.bulkLoad(entries.begin(), entries.end());
+	printf("keys=%zu lookups=%zu keysLimit=%d\n", numKeys, numLookups, Tree::keysLimit);
+	for(size_t batchSize : {16, 64, 256, 1024})
+		runBatch(tree, probes, batchSize);
+	return 0;
+}
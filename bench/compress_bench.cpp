@@ -0,0 +1,118 @@
+#include "../BpTree.h"
+#include "../MappedBpTree.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <malloc.h>
+
+//Memory per key and lookup cost before and after key compression.
+//Integer keys: a snapshot with raw keys against one with frame-of-reference keys, for dense monotonic IDs
+//and for random keys. String keys: a tree with suffix-truncated separators against the same tree with
+//full separators (a comparator that is not std::less opts out), measured as live heap bytes per key.
+//Usage: compress_bench [path=/tmp/compress_bench.snap] [numKeys=2000000] [numLookups=2000000]
+
+//Bytes currently allocated from the heap
+size_t liveBytes(){
+	struct mallinfo2 info = mallinfo2();
+	return info.uordblks + info.hblkhd;
+}
+
+typedef BpTree<uint64_t, uint64_t, std::less<uint64_t>, fanoutForBytes<uint64_t, uint64_t>(256)> IntTree;
+
+struct PlainLess{
+	bool operator()(const std::string& a, const std::string& b) const noexcept{
+		return a < b;
+	}
+};
+
+double nsPer(std::chrono::steady_clock::time_point begin, size_t n){
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / n;
+}
+
+void integerKeys(const char* name, const std::vector<uint64_t>& keys, const char* path, size_t numLookups){
+	IntTree tree;
+	for(auto k : keys)
+		tree.insert(k, k);
+	std::mt19937_64 rng(7);
+	std::vector<uint64_t> probes(numLookups);
+	for(auto& p : probes)
+		p = keys[rng() % keys.size()];
+
+	for(int compress = 0; compress < 2; ++compress){
+		if(!tree.saveSnapshot(path, compress)){
+			perror(path);
+			exit(1);
+		}
+		MappedBpTree<uint64_t, uint64_t> mapped;
+		if(!mapped.open(path)){
+			fprintf(stderr, "%s: not a snapshot\n", path);
+			exit(1);
+		}
+		FILE* f = fopen(path, "rb");
+		snapshot::Header header;
+		if(!f || fread(&header, sizeof(header), 1, f) != 1)
+			exit(1);
+		fclose(f);
+
+		uint64_t sum = 0;
+		auto begin = std::chrono::steady_clock::now();
+		for(auto p : probes){
+			uint64_t v = 0;
+			mapped.find(p, v);
+			sum += v;
+		}
+		double ns = nsPer(begin, numLookups);
+		printf("%-7s %-10s keyBytes/key=%.2f fileBytes/key=%.2f lookup ns=%.1f checksum=%llu\n", name,
+				compress ? "compressed" : "raw", (double)(header.valsOffset - header.keysOffset) / header.numEntries,
+				(double)header.fileBytes / header.numEntries, ns, (unsigned long long)sum);
+	}
+}
+
+template<typename Compare>
+void stringKeys(const char* name, const std::vector<std::string>& keys, size_t numLookups){
+	size_t before = liveBytes();
+	auto* tree = new BpTree<std::string, uint64_t, Compare, 16>();
+	for(size_t i = 0; i < keys.size(); ++i)
+		tree->insert(keys[i], i);
+	size_t bytes = liveBytes() - before;
+
+	std::mt19937_64 rng(7);
+	uint64_t sum = 0;
+	auto begin = std::chrono::steady_clock::now();
+	for(size_t i = 0; i < numLookups; ++i)
+		sum += tree->find(keys[rng() % keys.size()]);
+	printf("strings %-10s heapBytes/key=%.1f lookup ns=%.1f checksum=%llu\n", name, (double)bytes / keys.size(),
+			nsPer(begin, numLookups), (unsigned long long)sum);
+	delete tree;
+}
+
+int main(int argc, char** argv){
+	const char* path = argc > 1 ? argv[1] : "/tmp/compress_bench.snap";
+	size_t numKeys = argc > 2 ? strtoull(argv[2], nullptr, 10) : 2000000;
+	size_t numLookups = argc > 3 ? strtoull(argv[3], nullptr, 10) : 2000000;
+
+	std::mt19937_64 rng(42);
+	std::vector<uint64_t> keys(numKeys);
+	uint64_t id = 1ull << 40;
+	for(auto& k : keys)
+		k = id += 1 + rng() % 4; //Dense IDs with small gaps
+	integerKeys("dense", keys, path, numLookups);
+	for(auto& k : keys)
+		k = rng();
+	integerKeys("random", keys, path, numLookups);
+	std::remove(path);
+
+	//Long keys that share a prefix and differ early enough after it for truncation to pay off
+	std::vector<std::string> strings(numKeys / 4);
+	char buffer[96];
+	for(auto& s : strings){
+		snprintf(buffer, sizeof(buffer), "tenant-%03u/orders/%016llx/line-items", (unsigned)(rng() % 512), (unsigned long long)rng());
+		s = buffer;
+	}
+	stringKeys<PlainLess>("full", strings, numLookups);
+	stringKeys<std::less<std::string>>("truncated", strings, numLookups);
+	return 0;
+}
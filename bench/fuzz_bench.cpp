@@ -0,0 +1,325 @@
+#include "../BpTree.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+//Randomized differential test of BpTree against std::map. Each configuration runs a long mix of insert,
+//upsert, emplace, remove, find, insertBatch, removeBatch, bulkLoad and bulkLoadParallel (sorted, with
+//duplicates, or unsorted), clear, copy and move assignment, and snapshot() versions taken and dropped
+//along the way, over a small key space, in phases that grow the tree and drain it, so splits,
+//redistributions, merges, root collapse and copying shared nodes all run many times. Every operation's
+//result is checked against the map, and every checkEvery steps the full contents are compared in both
+//directions, every open version is compared with a copy of the map frozen when it was taken, and
+//validate() must pass.
+//Configurations cover several keysLimits and NodePolicy fill settings, with integer and string keys.
+//Built with ASan and UBSan as bench/fuzz_bench_asan by make asan. With BPTREE_LIBFUZZER defined it
+//builds a libFuzzer entry point instead (make bench/fuzz_bench_libfuzzer, which needs clang), where the
+//input bytes choose the operations.
+//Usage: fuzz_bench [steps=50000] [seed=1] [checkEvery=64]
+
+//Where operations draw their numbers: a seeded generator, or the bytes of a libFuzzer input
+class OpSource{
+	public:
+		explicit OpSource(uint64_t seed) noexcept : rng(seed), data(nullptr), size(0), pos(0){
+		}
+		OpSource(const uint8_t* bytes, size_t n) noexcept : rng(0), data(bytes), size(n), pos(0){
+		}
+		uint32_t next(uint32_t bound) noexcept{ //In [0, bound)
+			if(!data)
+				return rng() % bound;
+			uint32_t v = 0;
+			for(int i = 0; i < 4 && pos < size; ++i)
+				v = v << 8 | data[pos++];
+			return v % bound;
+		}
+		bool exhausted() const noexcept{
+			return data && pos >= size;
+		}
+	private:
+		std::mt19937_64 rng;
+		const uint8_t* data;
+		size_t size;
+		size_t pos;
+};
+
+inline int makeKey(uint32_t n, int){
+	return (int)n - 500; //Negative keys too
+}
+inline std::string makeKey(uint32_t n, const std::string&){
+	return "key" + std::to_string(n * 7919 % 100003); //Varied lengths and shared prefixes
+}
+inline uint64_t makeValue(uint32_t n, uint64_t){
+	return n;
+}
+inline std::string makeValue(uint32_t n, const std::string&){
+	return std::string(n % 40, 'v') + std::to_string(n); //Long enough to leave the small string buffer
+}
+
+template<typename Tree>
+class Fuzzer{
+	public:
+		typedef typename Tree::Traits::KeyType Key;
+		typedef typename Tree::Traits::ValueType Value;
+		typedef std::map<Key, Value> Reference;
+
+		Fuzzer(const char* configName, OpSource& ops, int checkEvery) : name(configName), source(ops), checkEvery(checkEvery){
+		}
+		//Returns false on the first mismatch, after printing it
+		bool run(size_t steps){
+			for(step = 0; step < steps && !source.exhausted(); ++step){
+				if(step % 2048 == 0){
+					growing = !growing;
+					keyRange = 16 + source.next(4000);
+				}
+				if(!apply() || (step % checkEvery == 0 && !check()))
+					return false;
+			}
+			return check();
+		}
+	private:
+		Key key(){
+			return makeKey(source.next(keyRange), Key());
+		}
+		Value value(){
+			return makeValue(source.next(1000000), Value());
+		}
+		bool fail(const char* what){
+			fprintf(stderr, "%s: step %zu: %s\n", name, step, what);
+			return false;
+		}
+		bool apply(){
+			uint32_t op = source.next(1000);
+			if(op < 340){ //Growing phases mostly add keys, draining ones mostly remove them
+				Key k = key();
+				if(op < (growing ? 70 : 250)){
+					bool removed = tree.remove(k), expected = reference.erase(k) > 0;
+					return removed == expected || fail("remove");
+				}
+				Value v = value();
+				if(op % 3 == 0){
+					bool added = tree.upsert(k, v), expected = reference.find(k) == reference.end();
+					reference[k] = v;
+					return added == expected || fail("upsert");
+				}
+				if(op % 3 == 1){ //Moved arguments must be left alone when the key is present
+					Key movedKey = k;
+					Value movedValue = v;
+					bool added = tree.emplace(std::move(movedKey), std::move(movedValue)), expected = reference.emplace(k, v).second;
+					return (added == expected && (added || movedValue == v)) || fail("emplace");
+				}
+				bool added = tree.insert(k, v), expected = reference.emplace(k, v).second;
+				return added == expected || fail("insert");
+			}
+			if(op < 680){
+				Key k = key();
+				const Value* v = tree.findPtr(k);
+				auto it = reference.find(k);
+				if((v != nullptr) != (it != reference.end()) || (v && *v != it->second))
+					return fail("findPtr");
+				return tree.find(k) == (it != reference.end() ? it->second : Value()) || fail("find");
+			}
+			if(op < 800){ //Batch of up to 64 pairs in any order, with repeated keys
+				std::vector<std::pair<Key, Value>> batch(source.next(65));
+				for(auto& entry : batch)
+					entry = std::make_pair(key(), value());
+				bool overwrite = source.next(2);
+				std::map<Key, Value> firsts; //Within the batch the first value of a key wins
+				for(auto& entry : batch)
+					firsts.emplace(entry.first, entry.second);
+				size_t expected = 0;
+				for(auto& entry : firsts){
+					auto inserted = reference.emplace(entry.first, entry.second);
+					expected += inserted.second;
+					if(!inserted.second && overwrite)
+						inserted.first->second = entry.second;
+				}
+				return tree.insertBatch(batch.begin(), batch.end(), overwrite) == expected || fail("insertBatch");
+			}
+			if(op < 930){
+				std::vector<Key> batch(source.next(growing ? 33 : 257));
+				for(auto& k : batch)
+					k = key();
+				size_t expected = 0;
+				for(auto& k : batch)
+					expected += reference.erase(k);
+				return tree.removeBatch(batch.begin(), batch.end()) == expected || fail("removeBatch");
+			}
+			if(op < 955)
+				return version();
+			if(op < 980)
+				return bulkLoad();
+			if(op < 990)
+				return assign();
+			tree.clear();
+			reference.clear();
+			return true;
+		}
+		//Sorted input with duplicates, whose first value is kept, or now and then unsorted input, loaded by
+		//bulkLoad or by bulkLoadParallel on 1 to 4 threads. bulkLoadParallel takes strictly increasing keys
+		//only, so its input is mostly deduplicated first.
+		bool bulkLoad(){
+			std::vector<std::pair<Key, Value>> input(source.next(3000));
+			for(auto& entry : input)
+				entry = std::make_pair(key(), value());
+			auto keyLess = [](const std::pair<Key, Value>& a, const std::pair<Key, Value>& b){
+				return a.first < b.first;
+			};
+			std::stable_sort(input.begin(), input.end(), keyLess);
+			unsigned numThreads = source.next(5); //0 for bulkLoad
+			if(numThreads && source.next(4) != 0){
+				input.erase(std::unique(input.begin(), input.end(), [](const std::pair<Key, Value>& a, const std::pair<Key, Value>& b){
+					return a.first == b.first;
+				}), input.end());
+			}
+			if(input.size() > 1 && source.next(8) == 0)
+				std::swap(input.front(), input.back());
+			bool accepted = true;
+			for(size_t i = 1; i < input.size() && accepted; ++i)
+				accepted = numThreads ? keyLess(input[i - 1], input[i]) : !keyLess(input[i], input[i - 1]);
+			double fillFactor = 0.3 + source.next(8) * 0.1;
+			reference.clear(); //Rejected input leaves the tree empty
+			for(auto& entry : input){
+				if(accepted)
+					reference.emplace(entry.first, entry.second);
+			}
+			if(!numThreads)
+				return tree.bulkLoad(input.begin(), input.end(), fillFactor) == accepted || fail("bulkLoad");
+			return tree.bulkLoadParallel(input.begin(), input.end(), fillFactor, numThreads) == accepted || fail("bulkLoadParallel");
+		}
+		//Take a version with a frozen copy of the reference, or drop one, keeping at most four open
+		bool version(){
+			if(versions.size() < 4 && (versions.empty() || source.next(2)))
+				versions.emplace_back(tree.snapshot(), reference);
+			else
+				versions.erase(versions.begin() + source.next(versions.size()));
+			return true;
+		}
+		//Copy assignment from the tree, which may share nodes with versions, and back into it. Move
+		//assignment, which needs the tree's versions dropped first, either out of a copy or as a round trip
+		//through a moved-to tree that carries the open versions along.
+		bool assign(){
+			Tree other;
+			switch(source.next(3)){
+				case 0:
+					other = tree;
+					if(!sameAs(other, reference))
+						return fail("copy assignment");
+					tree.clear();
+					tree = other;
+					return true;
+				case 1:
+					versions.clear();
+					other = tree;
+					tree = std::move(other);
+					return true;
+				default:{
+					Tree moved(std::move(tree));
+					tree = std::move(moved);
+					return true;
+				}
+			}
+		}
+		static bool sameAs(const Tree& t, const Reference& expected){
+			auto it = expected.begin();
+			for(auto entry = t.begin(); entry != t.end(); ++entry, ++it){
+				if(it == expected.end() || entry.key() != it->first || entry.value() != it->second)
+					return false;
+			}
+			return it == expected.end();
+		}
+		//Full contents in both directions, every open version, then the tree's own invariants
+		bool check(){
+			auto expected = reference.begin();
+			for(auto it = tree.begin(); it != tree.end(); ++it, ++expected){
+				if(expected == reference.end() || it.key() != expected->first || it.value() != expected->second)
+					return fail("forward iteration differs from std::map");
+			}
+			if(expected != reference.end())
+				return fail("forward iteration ended early");
+			auto backward = reference.rbegin();
+			for(auto it = tree.rbegin(); it != tree.rend(); ++it, ++backward){
+				if(backward == reference.rend() || (*it).first != backward->first)
+					return fail("reverse iteration differs from std::map");
+			}
+			for(auto& open : versions){
+				auto frozen = open.second.begin();
+				bool same = true;
+				open.first.forEach([&](const Key& k, const Value& v){
+					same = same && frozen != open.second.end() && k == frozen->first && v == frozen->second;
+					if(frozen != open.second.end())
+						++frozen;
+				});
+				if(!same || frozen != open.second.end() || open.first.empty() != open.second.empty())
+					return fail("version differs from the map frozen when it was taken");
+			}
+			std::string error;
+			if(!tree.validate(&error))
+				return fail(error.c_str());
+			return true;
+		}
+
+		const char* name;
+		OpSource& source;
+		int checkEvery;
+		Tree tree;
+		Reference reference;
+		std::vector<std::pair<typename Tree::Version, Reference>> versions; //Declared after tree, so dropped before it
+		size_t step = 0;
+		uint32_t keyRange = 16;
+		bool growing = false;
+};
+
+//Each configuration draws from its own copy of the source, so all of them see the same input
+template<typename Tree>
+bool fuzz(const char* name, const OpSource& input, size_t steps, int checkEvery){
+	OpSource source(input);
+	return Fuzzer<Tree>(name, source, checkEvery).run(steps);
+}
+
+typedef std::less<int> IntLess;
+typedef std::less<std::string> StringLess;
+
+//Runs every configuration; false if any of them found a mismatch
+bool fuzzAll(const OpSource& source, size_t steps, int checkEvery){
+	bool ok = fuzz<BpTree<int, uint64_t, IntLess, 3>>("int keysLimit=3", source, steps, checkEvery);
+	ok &= fuzz<BpTree<int, uint64_t, IntLess, 4>>("int keysLimit=4", source, steps, checkEvery);
+	ok &= fuzz<BpTree<int, uint64_t, IntLess, 7>>("int keysLimit=7", source, steps, checkEvery);
+	ok &= fuzz<BpTree<int, uint64_t, IntLess, 16>>("int keysLimit=16", source, steps, checkEvery);
+	ok &= fuzz<BpTree<int, uint64_t, IntLess, 64>>("int keysLimit=64", source, steps, checkEvery);
+	ok &= fuzz<BpTree<int, uint64_t, IntLess, 5, NewDeleteNodeAllocator, NodePolicy<0, 50, 50, 10>>>(
+			"int keysLimit=5 lazy merge", source, steps, checkEvery);
+	ok &= fuzz<BpTree<int, uint64_t, IntLess, 4, NewDeleteNodeAllocator, NodePolicy<13, 35, 70, 5>>>(
+			"int keysLimit=4 leafKeys=13 minFill=35 splitAt=70", source, steps, checkEvery);
+	ok &= fuzz<BpTree<int, uint64_t, IntLess, 9, ArenaNodeAllocator, NodePolicy<3, 50, 30>>>(
+			"int keysLimit=9 leafKeys=3 splitAt=30 arena", source, steps, checkEvery);
+	ok &= fuzz<BpTree<std::string, std::string, StringLess, 3>>("string keysLimit=3", source, steps, checkEvery);
+	ok &= fuzz<BpTree<std::string, std::string, StringLess, 5>>("string keysLimit=5", source, steps, checkEvery);
+	ok &= fuzz<BpTree<std::string, std::string, std::less<>, 8, NewDeleteNodeAllocator, NodePolicy<0, 30, 50, 10>>>(
+			"string keysLimit=8 transparent lazy merge", source, steps, checkEvery);
+	return ok;
+}
+
+#ifdef BPTREE_LIBFUZZER
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size){
+	OpSource source(data, size);
+	if(!fuzzAll(source, size, 16))
+		abort();
+	return 0;
+}
+#else
+int main(int argc, char** argv){
+	size_t steps = argc > 1 ? strtoull(argv[1], nullptr, 10) : 50000;
+	uint64_t seed = argc > 2 ? strtoull(argv[2], nullptr, 10) : 1;
+	int checkEvery = argc > 3 ? atoi(argv[3]) : 64;
+	OpSource source(seed);
+	bool ok = fuzzAll(source, steps, checkEvery > 0 ? checkEvery : 1);
+	printf("steps=%zu seed=%llu %s\n", steps, (unsigned long long)seed, ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
+#endif
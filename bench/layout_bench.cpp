@@ -0,0 +1,80 @@
+#include "../BpTree.h"
+#include "BaselineTree.h"
+#include "PerfCounters.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+//Random point lookups over a tree of uint64_t keys and values at several node sizes.
+//Reports node sizes, nanoseconds and cache/TLB misses per lookup. Each size runs once with the packed
+//nodes of Node.h ("new") and, for keysLimit 3 and 16, once with the pre-packing layout of BaselineTree.h
+//("old"), whose byte counts include the separately allocated key, value and child arrays.
+//Usage: layout_bench [numKeys=10000000] [numLookups=2000000]
+
+//Times tree.find over the probes and prints one result line
+template<typename Tree>
+void timeLookups(const char* layout, int keysLimit, size_t leafBytes, size_t interiorBytes, const Tree& tree,
+		const std::vector<uint64_t>& probes){
+	PerfCounter misses = cacheMissCounter();
+	PerfCounter tlbMisses = dtlbMissCounter();
+	uint64_t sum = 0;
+	auto begin = std::chrono::steady_clock::now();
+	misses.start();
+	tlbMisses.start();
+	for(auto k : probes)
+		sum += tree.find(k);
+	uint64_t missCount = misses.stop();
+	uint64_t tlbMissCount = tlbMisses.stop();
+	auto end = std::chrono::steady_clock::now();
+
+	double ns = std::chrono::duration<double, std::nano>(end - begin).count() / probes.size();
+	printf("%-3s keysLimit=%-4d leafBytes=%-5zu interiorBytes=%-5zu ns/lookup=%-8.1f", layout, keysLimit, leafBytes, interiorBytes, ns);
+	if(misses.available())
+		printf(" cacheMisses/lookup=%-6.2f dtlbMisses/lookup=%-6.2f", (double)missCount / probes.size(), (double)tlbMissCount / probes.size());
+	else
+		printf(" cacheMisses/lookup=n/a dtlbMisses/lookup=n/a");
+	printf(" checksum=%llu\n", (unsigned long long)sum);
+}
+
+template<int KeysLimit>
+void runLayout(const std::vector<uint64_t>& keys, const std::vector<uint64_t>& probes){
+	typedef BpTree<uint64_t, uint64_t, std::less<uint64_t>, KeysLimit> Tree;
+	Tree* tree = new Tree();
+	for(auto k : keys)
+		tree->insert(k, k);
+	timeLookups("new", KeysLimit, sizeof(typename Tree::LeafNode), sizeof(typename Tree::InteriorNode), *tree, probes);
+	delete tree;
+}
+
+void runBaseline(int keysLimit, const std::vector<uint64_t>& keys, const std::vector<uint64_t>& probes){
+	baseline::BpTree* tree = new baseline::BpTree(keysLimit);
+	for(auto k : keys)
+		tree->insert(k, k);
+	timeLookups("old", keysLimit, tree->leafBytes(), tree->interiorBytes(), *tree, probes);
+	delete tree;
+}
+
+int main(int argc, char** argv){
+	size_t numKeys = argc > 1 ? strtoull(argv[1], nullptr, 10) : 10000000;
+	size_t numLookups = argc > 2 ? strtoull(argv[2], nullptr, 10) : 2000000;
+
+	std::mt19937_64 rng(42);
+	std::vector<uint64_t> keys(numKeys);
+	for(auto& k : keys)
+		k = rng();
+	std::vector<uint64_t> probes(numLookups);
+	for(auto& p : probes)
+		p = keys[rng() % numKeys];
+
+	printf("keys=%zu lookups=%zu\n", numKeys, numLookups);
+	runBaseline(3, keys, probes);
+	runLayout<3>(keys, probes);
+	runBaseline(16, keys, probes);
+	runLayout<16>(keys, probes);
+	runLayout<fanoutForBytes<uint64_t, uint64_t>(256)>(keys, probes);
+	runLayout<fanoutForBytes<uint64_t, uint64_t>(1024)>(keys, probes);
+	runLayout<fanoutForBytes<uint64_t, uint64_t>(4096)>(keys, probes);
+	return 0;
+}
@@ -0,0 +1,121 @@
+#include "../BpTree.h"
+#include "../OlcBpTree.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+//YCSB-style throughput of OlcBpTree against a BpTree behind one global mutex.
+//Each workload mixes point reads with writes; a write removes a random key and inserts it back,
+//so the tree size stays constant. Threads sweep 1, 2, 4, ... up to the core count.
+//Usage: olc_bench [numKeys=1000000] [secondsPerRun=1] [maxThreads=hardware_concurrency]
+
+typedef uint64_t Key;
+constexpr int keysLimit = fanoutForBytes<Key, Key>(1024);
+
+struct Workload{
+	const char* name;
+	int readPercent;
+};
+
+struct LockedTree{
+	std::mutex mutex;
+	BpTree<Key, Key, std::less<Key>, keysLimit, ArenaNodeAllocator> tree;
+
+	bool find(Key k, Key& v){
+		std::lock_guard<std::mutex> guard(mutex);
+		v = tree.find(k);
+		return true;
+	}
+	void write(Key k){
+		std::lock_guard<std::mutex> guard(mutex);
+		tree.remove(k);
+		tree.insert(k, k);
+	}
+};
+
+struct OlcTree{
+	OlcBpTree<Key, Key, std::less<Key>, keysLimit> tree;
+
+	bool find(Key k, Key& v){
+		return tree.find(k, v);
+	}
+	void write(Key k){
+		tree.remove(k);
+		tree.insert(k, k);
+	}
+};
+
+template<typename Tree>
+double run(Tree& tree, const Workload& workload, unsigned numThreads, size_t numKeys, double seconds){
+	std::atomic<bool> stop(false);
+	std::atomic<Key> sinkValue(0); //Keeps the lookups from being optimized away
+	std::vector<uint64_t> opCounts(numThreads * 8, 0); //Padded to keep counters on separate cache lines
+	std::vector<std::thread> threads;
+	for(unsigned t = 0; t < numThreads; ++t){
+		threads.emplace_back([&, t]{
+			std::mt19937_64 rng(t + 1);
+			uint64_t ops = 0;
+			Key sink = 0;
+			while(!stop.load(std::memory_order_relaxed)){
+				for(int i = 0; i < 64; ++i){
+					Key k = (rng() % numKeys) * 2;
+					if((int)(rng() % 100) < workload.readPercent){
+						Key v = 0;
+						tree.find(k, v);
+						sink += v;
+					}else{
+						tree.write(k);
+					}
+				}
+				ops += 64;
+			}
+			opCounts[t * 8] = ops;
+			sinkValue += sink;
+		});
+	}
+	std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+	stop = true;
+	for(auto& thread : threads)
+		thread.join();
+	uint64_t total = 0;
+	for(unsigned t = 0; t < numThreads; ++t)
+		total += opCounts[t * 8];
+	return total / seconds / 1e6;
+}
+
+int main(int argc, char** argv){
+	size_t numKeys = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1000000;
+	double seconds = argc > 2 ? atof(argv[2]) : 1.0;
+	unsigned maxThreads = argc > 3 ? atoi(argv[3]) : std::thread::hardware_concurrency();
+	if(maxThreads == 0)
+		maxThreads = 1;
+
+	LockedTree* locked = new LockedTree();
+	OlcTree* olc = new OlcTree();
+	for(size_t i = 0; i < numKeys; ++i){
+		locked->tree.insert(i * 2, i * 2);
+		olc->tree.insert(i * 2, i * 2);
+	}
+
+	const Workload workloads[] = {{"read-only", 100}, {"read-mostly", 95}, {"update-heavy", 50}};
+	printf("keys=%zu keysLimit=%d seconds=%.1f\n", numKeys, keysLimit, seconds);
+	printf("%-14s %-8s %-16s %-16s\n", "workload", "threads", "mutex Mops/s", "olc Mops/s");
+	for(auto& workload : workloads){
+		for(unsigned threads = 1; threads <= maxThreads; threads = threads < maxThreads && threads * 2 > maxThreads ? maxThreads : threads * 2){
+			double lockedOps = run(*locked, workload, threads, numKeys, seconds);
+			double olcOps = run(*olc, workload, threads, numKeys, seconds);
+			printf("%-14s %-8u %-16.2f %-16.2f\n", workload.name, threads, lockedOps, olcOps);
+			if(threads == maxThreads)
+				break;
+		}
+	}
+	delete locked;
+	delete olc;
+	return 0;
+}
@@ -0,0 +1,137 @@
+#include "../OlcBpTree.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <thread>
+#include <vector>
+
+//Stress test for OlcBpTree under shrinking: reader threads run scans and finds for the whole run while
+//writer threads remove all but one key in anchorEvery, which merges leaves and collapses the root down to
+//a few levels, then insert everything back. Readers check that scans return keys in ascending order within
+//their range, that every anchor in the range shows up, that values match their keys and that anchors are
+//always found. After each phase the main thread counts the tree with a full scan. Built with ASan as
+//bench/olc_stress_asan, which catches nodes freed by the EpochManager while a reader could still reach them.
+//Usage: olc_stress [numKeys=200000] [rounds=5] [readers=4] [writers=4]
+
+typedef uint64_t Key;
+typedef OlcBpTree<Key, Key, std::less<Key>, 16> Tree;
+
+constexpr Key anchorEvery = 4096; //Keys that are never removed
+
+inline Key valueOf(Key k){
+	return k * 3 + 1;
+}
+
+std::atomic<uint64_t> failures(0);
+
+void fail(const char* what, Key k){
+	if(failures++ < 10)
+		fprintf(stderr, "%s: key %llu\n", what, (unsigned long long)k);
+}
+
+void runReader(const Tree& tree, Key numKeys, int seed, const std::atomic<bool>& stop, std::atomic<uint64_t>& reads){
+	std::mt19937_64 rng(seed);
+	uint64_t ops = 0;
+	while(!stop.load(std::memory_order_relaxed)){
+		Key lo = rng() % numKeys;
+		if(rng() % 4 == 0){
+			Key k = rng() % 8 == 0 ? lo / anchorEvery * anchorEvery : lo;
+			Key v = 0;
+			bool found = tree.find(k, v);
+			if(found && v != valueOf(k))
+				fail("find returned a wrong value", k);
+			if(!found && k % anchorEvery == 0)
+				fail("anchor not found", k);
+		}else{
+			Key hi = lo + 1 + rng() % (rng() % 16 == 0 ? numKeys : 2 * anchorEvery);
+			bool first = true;
+			Key last = 0, anchors = 0;
+			tree.scan(lo, hi, [&](const Key& k, const Key& v){
+				if(k < lo || k >= hi)
+					fail("scan left its range", k);
+				if(!first && k <= last)
+					fail("scan out of order", k);
+				if(v != valueOf(k))
+					fail("scan returned a wrong value", k);
+				anchors += k % anchorEvery == 0;
+				first = false;
+				last = k;
+			});
+			Key limit = hi < numKeys ? hi : numKeys;
+			Key expected = (limit + anchorEvery - 1) / anchorEvery - (lo + anchorEvery - 1) / anchorEvery;
+			if(anchors != expected)
+				fail("scan missed anchors starting at", lo);
+		}
+		++ops;
+	}
+	reads += ops;
+}
+
+//Writer w removes or inserts the non-anchor keys k with k % numWriters == w, in random order
+void runWriter(Tree& tree, Key numKeys, int w, int numWriters, bool removing, int seed){
+	std::vector<Key> keys;
+	for(Key k = w; k < numKeys; k += numWriters){
+		if(k % anchorEvery != 0)
+			keys.push_back(k);
+	}
+	std::shuffle(keys.begin(), keys.end(), std::mt19937_64(seed));
+	for(Key k : keys){
+		bool changed = removing ? tree.remove(k) : tree.insert(k, valueOf(k));
+		if(!changed)
+			fail(removing ? "remove found no key" : "insert found a key", k);
+	}
+}
+
+size_t countKeys(const Tree& tree, Key numKeys){
+	size_t count = 0;
+	tree.scan(0, numKeys, [&count](const Key&, const Key&){
+		++count;
+	});
+	return count;
+}
+
+int main(int argc, char** argv){
+	Key numKeys = argc > 1 ? strtoull(argv[1], nullptr, 10) : 200000;
+	int rounds = argc > 2 ? atoi(argv[2]) : 5;
+	int numReaders = argc > 3 ? atoi(argv[3]) : 4;
+	int numWriters = argc > 4 ? atoi(argv[4]) : 4;
+	const size_t numAnchors = (numKeys + anchorEvery - 1) / anchorEvery;
+
+	Tree tree;
+	for(Key k = 0; k < numKeys; ++k)
+		tree.insert(k, valueOf(k));
+
+	std::atomic<bool> stop(false);
+	std::atomic<uint64_t> reads(0);
+	std::vector<std::thread> readers;
+	for(int r = 0; r < numReaders; ++r)
+		readers.emplace_back(runReader, std::cref(tree), numKeys, r + 1, std::cref(stop), std::ref(reads));
+
+	auto begin = std::chrono::steady_clock::now();
+	for(int round = 0; round < rounds; ++round){
+		for(bool removing : {true, false}){
+			std::vector<std::thread> writers;
+			for(int w = 0; w < numWriters; ++w)
+				writers.emplace_back(runWriter, std::ref(tree), numKeys, w, numWriters, removing, round * numWriters + w + 100);
+			for(auto& writer : writers)
+				writer.join();
+			size_t count = countKeys(tree, numKeys), expected = removing ? numAnchors : numKeys;
+			if(count != expected){
+				fprintf(stderr, "round %d: %zu keys after %s, expected %zu\n", round, count, removing ? "removing" : "refilling", expected);
+				++failures;
+			}
+		}
+	}
+	stop = true;
+	for(auto& reader : readers)
+		reader.join();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	printf("keys=%llu rounds=%d readers=%d writers=%d reads=%llu seconds=%.2f failures=%llu\n", (unsigned long long)numKeys,
+			rounds, numReaders, numWriters, (unsigned long long)reads.load(), seconds, (unsigned long long)failures.load());
+	return failures ? 1 : 0;
+}
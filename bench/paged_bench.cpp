@@ -0,0 +1,70 @@
+#include "../PagedBpTree.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <unistd.h>
+
+//Builds a page-based index larger than its buffer pool, closes it, reopens it and runs random lookups.
+//Reports build time, file size against pool size, reopen latency and lookup cost with the pool hit rate.
+//Usage: paged_bench [path=/tmp/paged_bench.db] [numKeys=5000000] [poolFrames=4096] [numLookups=500000]
+
+typedef PagedBpTree<uint64_t, uint64_t> Tree;
+
+double secondsSince(std::chrono::steady_clock::time_point begin){
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+int main(int argc, char** argv){
+	const char* path = argc > 1 ? argv[1] : "/tmp/paged_bench.db";
+	size_t numKeys = argc > 2 ? strtoull(argv[2], nullptr, 10) : 5000000;
+	size_t poolFrames = argc > 3 ? strtoull(argv[3], nullptr, 10) : 4096;
+	size_t numLookups = argc > 4 ? strtoull(argv[4], nullptr, 10) : 500000;
+	unlink(path);
+
+	std::mt19937_64 rng(42);
+	std::vector<uint64_t> keys(numKeys);
+	for(auto& k : keys)
+		k = rng();
+
+	auto begin = std::chrono::steady_clock::now();
+	{
+		Tree tree(poolFrames);
+		if(!tree.open(path)){
+			perror(path);
+			return 1;
+		}
+		for(auto k : keys)
+			tree.insert(k, k);
+		double fileMiB = (double)tree.bufferPool().pageCount() * BufferPool::pageSize / (1 << 20);
+		tree.close();
+		printf("build: keys=%zu seconds=%.2f fileMiB=%.1f poolMiB=%.1f\n", numKeys, secondsSince(begin),
+				fileMiB, (double)poolFrames * BufferPool::pageSize / (1 << 20));
+	}
+
+	Tree tree(poolFrames);
+	begin = std::chrono::steady_clock::now();
+	if(!tree.open(path)){
+		perror(path);
+		return 1;
+	}
+	printf("reopen: ms=%.3f entries=%llu\n", secondsSince(begin) * 1e3, (unsigned long long)tree.size());
+
+	for(int pass = 0; pass < 2; ++pass){
+		size_t hits = tree.bufferPool().hits(), misses = tree.bufferPool().misses();
+		uint64_t sum = 0;
+		begin = std::chrono::steady_clock::now();
+		for(size_t i = 0; i < numLookups; ++i){
+			uint64_t v = 0;
+			tree.find(keys[rng() % numKeys], v);
+			sum += v;
+		}
+		double seconds = secondsSince(begin);
+		hits = tree.bufferPool().hits() - hits;
+		misses = tree.bufferPool().misses() - misses;
+		printf("lookups %s: us/lookup=%.2f poolHitRate=%.3f checksum=%llu\n", pass ? "warm" : "cold",
+				seconds * 1e6 / numLookups, (double)hits / (hits + misses), (unsigned long long)sum);
+	}
+	return 0;
+}
@@ -0,0 +1,148 @@
+#include "../ShardedBpTree.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+//Write-heavy throughput from 1 to 64 threads: one BpTree behind a single reader-writer latch against
+//ShardedBpTree with range and hash partitioning. Each operation is an upsert (80%) or a find (20%) of a
+//uniformly random key. Then a skewed run sends 90% of operations to one sixteenth of the key space, with
+//range partitioning left as configured and with a thread calling rebalance() every 10 ms.
+//Usage: shard_bench [threads=1,2,4,8,16,32,64] [numKeys=1000000] [seconds=1] [numShards=64]
+
+typedef uint64_t Key;
+typedef ShardedBpTree<Key, uint64_t, std::less<Key>, fanoutForBytes<Key, uint64_t>(256)> Sharded;
+typedef Sharded::Tree Tree;
+
+//The single-latch baseline, with the operations the workers call
+struct LatchedTree{
+	std::shared_mutex latch;
+	Tree tree;
+
+	bool upsert(Key k, uint64_t v){
+		std::unique_lock<std::shared_mutex> lock(latch);
+		return tree.upsert(k, v);
+	}
+	uint64_t find(Key k){
+		std::shared_lock<std::shared_mutex> lock(latch);
+		return tree.find(k);
+	}
+};
+
+//Spread over the key space, so sequential ids do not all land in one range shard
+inline Key keyOf(uint64_t id){
+	return id * 0x9E3779B97F4A7C15ull;
+}
+
+//Run numThreads workers for the given time; hotShare of the keys come from the first sixteenth of the
+//key space. Returns operations per second.
+template<typename Store>
+double run(Store& store, int numThreads, size_t numKeys, double seconds, double hotShare = 0){
+	std::atomic<bool> stop(false);
+	std::atomic<uint64_t> totalOps(0), checksum(0);
+	std::vector<std::thread> workers;
+	const Key hotLimit = ~Key(0) / 16;
+	for(int t = 0; t < numThreads; ++t){
+		workers.emplace_back([&, t]{
+			std::mt19937_64 rng(t + 1);
+			std::uniform_real_distribution<double> coin(0, 1);
+			uint64_t ops = 0, sum = 0;
+			while(!stop.load(std::memory_order_relaxed)){
+				for(int i = 0; i < 256; ++i, ++ops){
+					Key k = keyOf(rng() % (2 * numKeys));
+					if(hotShare > 0 && coin(rng) < hotShare)
+						k %= hotLimit;
+					if(rng() % 100 < 80)
+						store.upsert(k, ops);
+					else
+						sum += store.find(k);
+				}
+			}
+			totalOps += ops;
+			checksum += sum;
+		});
+	}
+	auto begin = std::chrono::steady_clock::now();
+	std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+	stop = true;
+	for(auto& worker : workers)
+		worker.join();
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	return totalOps / elapsed;
+}
+
+//Bounds splitting the key space into numShards equal ranges
+std::vector<Key> evenBounds(int numShards){
+	std::vector<Key> bounds;
+	for(int i = 1; i < numShards; ++i)
+		bounds.push_back(~Key(0) / numShards * i);
+	return bounds;
+}
+
+template<typename Store>
+void load(Store& store, size_t numKeys){
+	for(size_t i = 0; i < numKeys; ++i)
+		store.upsert(keyOf(2 * i), i);
+}
+
+std::vector<int> parseList(const char* text){
+	std::vector<int> values;
+	for(const char* p = text; *p; ){
+		char* end;
+		values.push_back(strtol(p, &end, 10));
+		p = *end == ',' ? end + 1 : end;
+		if(end == p && *p)
+			break;
+	}
+	return values;
+}
+
+int main(int argc, char** argv){
+	std::vector<int> threadCounts = parseList(argc > 1 ? argv[1] : "1,2,4,8,16,32,64");
+	size_t numKeys = argc > 2 ? strtoull(argv[2], nullptr, 10) : 1000000;
+	double seconds = argc > 3 ? atof(argv[3]) : 1;
+	int numShards = argc > 4 ? atoi(argv[4]) : 64;
+	printf("keys=%zu shards=%d hardware threads=%u\n", numKeys, numShards, std::thread::hardware_concurrency());
+
+	for(int threads : threadCounts){
+		LatchedTree single;
+		load(single, numKeys);
+		Sharded ranged(evenBounds(numShards)), hashed(numShards);
+		load(ranged, numKeys);
+		load(hashed, numKeys);
+		double singleOps = run(single, threads, numKeys, seconds);
+		double rangedOps = run(ranged, threads, numKeys, seconds);
+		double hashedOps = run(hashed, threads, numKeys, seconds);
+		printf("threads=%-3d single Mops/s=%.2f range Mops/s=%.2f hash Mops/s=%.2f\n", threads, singleOps / 1e6,
+				rangedOps / 1e6, hashedOps / 1e6);
+	}
+
+	//Skew: the hot sixteenth of the key space starts out in numShards / 16 range shards
+	const int threads = threadCounts.back();
+	for(bool rebalancing : {false, true}){
+		Sharded ranged(evenBounds(numShards));
+		load(ranged, numKeys);
+		std::atomic<bool> stop(false);
+		std::atomic<int> moves(0);
+		std::thread rebalancer([&]{
+			while(rebalancing && !stop.load()){
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+				moves += ranged.rebalance();
+			}
+		});
+		double ops = run(ranged, threads, numKeys, seconds, 0.9);
+		stop = true;
+		rebalancer.join();
+		std::string error;
+		if(!ranged.validate(&error))
+			printf("invalid tree: %s\n", error.c_str());
+		printf("skewed threads=%-3d rebalance=%s Mops/s=%.2f boundary moves=%d\n", threads, rebalancing ? "on " : "off",
+				ops / 1e6, moves.load());
+	}
+	return 0;
+}
@@ -0,0 +1,74 @@
+#include "../BpTree.h"
+#include "../MappedBpTree.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+//Startup cost of a read replica: rebuilding a tree with insert(), copying it, or mapping a snapshot.
+//Then random lookups against the in-memory tree and the mapped snapshot.
+//Usage: snapshot_bench [path=/tmp/snapshot_bench.snap] [numKeys=5000000] [numLookups=2000000]
+
+typedef BpTree<uint64_t, uint64_t, std::less<uint64_t>, fanoutForBytes<uint64_t, uint64_t>(256)> Tree;
+
+double msSince(std::chrono::steady_clock::time_point begin){
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+}
+
+int main(int argc, char** argv){
+	const char* path = argc > 1 ? argv[1] : "/tmp/snapshot_bench.snap";
+	size_t numKeys = argc > 2 ? strtoull(argv[2], nullptr, 10) : 5000000;
+	size_t numLookups = argc > 3 ? strtoull(argv[3], nullptr, 10) : 2000000;
+
+	std::mt19937_64 rng(42);
+	std::vector<uint64_t> keys(numKeys);
+	for(auto& k : keys)
+		k = rng();
+
+	auto begin = std::chrono::steady_clock::now();
+	Tree* tree = new Tree();
+	for(auto k : keys)
+		tree->insert(k, k);
+	printf("rebuild with insert: ms=%.1f\n", msSince(begin));
+
+	begin = std::chrono::steady_clock::now();
+	Tree* copy = new Tree(*tree);
+	printf("copy constructor:    ms=%.1f\n", msSince(begin));
+	delete copy;
+
+	begin = std::chrono::steady_clock::now();
+	if(!tree->saveSnapshot(path)){
+		perror(path);
+		return 1;
+	}
+	printf("saveSnapshot:        ms=%.1f\n", msSince(begin));
+
+	MappedBpTree<uint64_t, uint64_t> mapped;
+	begin = std::chrono::steady_clock::now();
+	if(!mapped.open(path)){
+		fprintf(stderr, "%s: not a snapshot\n", path);
+		return 1;
+	}
+	printf("map snapshot:        ms=%.3f entries=%zu\n", msSince(begin), mapped.size());
+
+	std::vector<uint64_t> probes(numLookups);
+	for(auto& p : probes)
+		p = keys[rng() % numKeys];
+	uint64_t treeSum = 0, mappedSum = 0;
+	begin = std::chrono::steady_clock::now();
+	for(auto p : probes)
+		treeSum += tree->find(p);
+	double treeMs = msSince(begin);
+	begin = std::chrono::steady_clock::now();
+	for(auto p : probes){
+		uint64_t v = 0;
+		mapped.find(p, v);
+		mappedSum += v;
+	}
+	double mappedMs = msSince(begin);
+	printf("lookups: BpTree ns=%.1f MappedBpTree ns=%.1f %s\n", treeMs * 1e6 / numLookups, mappedMs * 1e6 / numLookups,
+			treeSum == mappedSum ? "ok" : "MISMATCH");
+	delete tree;
+	return 0;
+}
@@ -0,0 +1,48 @@
+#include "../BpTree.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+//Mixed find/insert/remove workload, then the tree's stats() dump. The Makefile builds this twice, as
+//stats_bench with BPTREE_STATS and stats_bench_off without, so the throughput lines show what the
+//hot-path counters cost.
+//Usage: stats_bench [numOps=5000000] [json|prometheus]
+
+typedef BpTree<uint64_t, uint64_t, std::less<uint64_t>, fanoutForBytes<uint64_t, uint64_t>(256)> Tree;
+
+int main(int argc, char** argv){
+	size_t numOps = argc > 1 ? strtoull(argv[1], nullptr, 10) : 5000000;
+	bool prometheus = argc > 2 && strcmp(argv[2], "prometheus") == 0;
+
+	Tree tree;
+	std::mt19937_64 rng(42);
+	const uint64_t keySpace = numOps / 2;
+	uint64_t sum = 0;
+	auto begin = std::chrono::steady_clock::now();
+	for(size_t i = 0; i < numOps; ++i){
+		uint64_t k = rng() % keySpace;
+		unsigned op = rng() % 10;
+		if(op < 6)
+			sum += tree.find(k);
+		else if(op < 9)
+			tree.insert(k, k);
+		else
+			tree.remove(k);
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+#ifdef BPTREE_STATS
+	const char* counters = "on";
+#else
+	const char* counters = "off";
+#endif
+	fprintf(stderr, "counters %s: ops/s=%.0f checksum=%llu\n", counters, numOps / seconds, (unsigned long long)sum);
+
+	begin = std::chrono::steady_clock::now();
+	TreeStats stats = tree.stats();
+	fprintf(stderr, "stats() ms=%.1f\n", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count());
+	puts(prometheus ? stats.toPrometheus().c_str() : stats.toJson().c_str());
+	return 0;
+}
@@ -0,0 +1,284 @@
+#include "../BpTree.h"
+#include "PerfCounters.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <unistd.h>
+
+//Benchmark suite over the insert/find/remove API, sweeping node size (keysLimit) and key count.
+//Workloads per configuration, in order on one tree:
+//	seq-insert   n inserts in ascending key order (on a separate tree)
+//	rand-insert  n inserts in random key order
+//	rand-find    uniform lookups of present keys
+//	zipf-find    lookups with scrambled Zipfian (theta 0.99) popularity
+//	ycsb-a..f    YCSB core workloads A (50% read/50% update), B (95/5), C (read only),
+//	             F (50% read/50% read-modify-write), D (95% read latest/5% insert), E (95% short scan/5% insert)
+//	rand-remove  removal of every loaded key in random order
+//Updates go through findPtr, so they overwrite in place. Every line of stdout is one JSON object with
+//throughput, sampled p50/p99 latency, resident set size and perf-counter cache and data TLB misses
+//(null where perf events are unavailable), so runs on two commits can be diffed. Builds without NDEBUG
+//also check the tree's invariants after every workload that modifies it.
+//Usage: suite_bench [keyCounts=1000000,10000000] [opsPerWorkload=1000000] [keysLimits=all]
+//keysLimits picks from the compiled sweep below (13,29,61,253 for 8-byte keys and values).
+
+typedef uint64_t Key;
+
+//Bijective mix, so record ids map to distinct keys scattered over the key space
+inline Key keyOf(uint64_t id){
+	id += 0x9E3779B97F4A7C15ull;
+	id = (id ^ (id >> 30)) * 0xBF58476D1CE4E5B9ull;
+	id = (id ^ (id >> 27)) * 0x94D049BB133111EBull;
+	return id ^ (id >> 31);
+}
+
+//YCSB's Zipfian generator (Gray et al.): ranks 0..n-1, rank 0 the most popular
+class Zipfian{
+	public:
+		Zipfian(uint64_t items, double theta = 0.99) : n(items), theta(theta){
+			zetan = zeta(n);
+			alpha = 1 / (1 - theta);
+			eta = (1 - std::pow(2.0 / n, 1 - theta)) / (1 - zeta(2) / zetan);
+		}
+		template<typename Rng>
+		uint64_t next(Rng& rng){
+			double u = std::uniform_real_distribution<double>(0, 1)(rng);
+			double uz = u * zetan;
+			if(uz < 1)
+				return 0;
+			if(uz < 1 + std::pow(0.5, theta))
+				return 1;
+			return std::min<uint64_t>(n - 1, (uint64_t)(n * std::pow(eta * u - eta + 1, alpha)));
+		}
+	private:
+		double zeta(uint64_t count) const{
+			double sum = 0;
+			for(uint64_t i = 1; i <= count; ++i)
+				sum += 1 / std::pow((double)i, theta);
+			return sum;
+		}
+		uint64_t n;
+		double theta, zetan, alpha, eta;
+};
+
+struct Result{
+	const char* workload;
+	size_t ops;
+	double seconds;
+	std::vector<uint32_t> samples; //Sampled single-operation latencies in ns
+	uint64_t cacheMisses, dtlbMisses;
+	bool perfAvailable;
+};
+
+constexpr size_t sampleInterval = 8; //One operation in this many is timed on its own
+
+size_t residentBytes(){
+	long pages = 0, resident = 0;
+	FILE* statm = fopen("/proc/self/statm", "r");
+	if(statm){
+		if(fscanf(statm, "%ld %ld", &pages, &resident) != 2)
+			resident = 0;
+		fclose(statm);
+	}
+	return (size_t)resident * sysconf(_SC_PAGESIZE);
+}
+
+size_t peakResidentBytes(){
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return (size_t)usage.ru_maxrss * 1024;
+}
+
+//Run op(i) for i in [0, ops), timing every sampleInterval-th call on its own
+template<typename Op>
+Result measure(const char* workload, size_t ops, Op&& op){
+	Result result{workload, ops, 0, {}, 0, 0, false};
+	result.samples.reserve(ops / sampleInterval + 1);
+	PerfCounter cacheMisses = cacheMissCounter(), dtlbMisses = dtlbMissCounter();
+	result.perfAvailable = cacheMisses.available() && dtlbMisses.available();
+	cacheMisses.start();
+	dtlbMisses.start();
+	auto begin = std::chrono::steady_clock::now();
+	for(size_t i = 0; i < ops; ++i){
+		if(i % sampleInterval == 0){
+			auto opBegin = std::chrono::steady_clock::now();
+			op(i);
+			result.samples.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - opBegin).count());
+		}else{
+			op(i);
+		}
+	}
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	result.dtlbMisses = dtlbMisses.stop();
+	result.cacheMisses = cacheMisses.stop();
+	return result;
+}
+
+uint32_t percentile(std::vector<uint32_t>& samples, double q){
+	if(samples.empty())
+		return 0;
+	size_t rank = std::min(samples.size() - 1, (size_t)(q * samples.size()));
+	std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+	return samples[rank];
+}
+
+void report(Result& r, int keysLimit, size_t numKeys, uint64_t checksum){
+	char perf[96] = "\"cacheMisses\":null,\"dtlbMisses\":null";
+	if(r.perfAvailable)
+		snprintf(perf, sizeof(perf), "\"cacheMisses\":%llu,\"dtlbMisses\":%llu", (unsigned long long)r.cacheMisses,
+				(unsigned long long)r.dtlbMisses);
+	uint32_t p50 = percentile(r.samples, 0.5), p99 = percentile(r.samples, 0.99);
+	printf("{\"workload\":\"%s\",\"keysLimit\":%d,\"keys\":%zu,\"ops\":%zu,\"opsPerSec\":%.0f,\"p50Ns\":%u,\"p99Ns\":%u,"
+			"\"rssBytes\":%zu,\"peakRssBytes\":%zu,%s,\"checksum\":%llu}\n", r.workload, keysLimit, numKeys, r.ops,
+			r.ops / r.seconds, p50, p99, residentBytes(), peakResidentBytes(), perf, (unsigned long long)checksum);
+	fflush(stdout);
+}
+
+template<int KeysLimit>
+void runConfiguration(size_t numKeys, size_t numOps){
+	typedef BpTree<Key, Key, std::less<Key>, KeysLimit> Tree;
+	std::mt19937_64 rng(42);
+	uint64_t checksum = 0;
+	fprintf(stderr, "keysLimit=%d keys=%zu\n", KeysLimit, numKeys);
+
+	{
+		Tree* tree = new Tree();
+		Result r = measure("seq-insert", numKeys, [&](size_t i){
+			checksum += tree->insert(i, i);
+		});
+		assert(tree->validate());
+		report(r, KeysLimit, numKeys, checksum);
+		delete tree;
+	}
+
+	Tree* tree = new Tree();
+	Result r = measure("rand-insert", numKeys, [&](size_t i){
+		checksum += tree->insert(keyOf(i), i);
+	});
+	assert(tree->validate());
+	report(r, KeysLimit, numKeys, checksum);
+
+	r = measure("rand-find", numOps, [&](size_t){
+		checksum += tree->find(keyOf(rng() % numKeys));
+	});
+	report(r, KeysLimit, numKeys, checksum);
+
+	Zipfian zipf(numKeys);
+	auto zipfKey = [&]{ //Scrambled, so the popular records are spread over the tree
+		return keyOf(keyOf(zipf.next(rng)) % numKeys);
+	};
+	r = measure("zipf-find", numOps, [&](size_t){
+		checksum += tree->find(zipfKey());
+	});
+	report(r, KeysLimit, numKeys, checksum);
+
+	auto read = [&](Key k){
+		checksum += tree->find(k);
+	};
+	auto update = [&](Key k){
+		if(Key* v = tree->findPtr(k))
+			*v = rng();
+	};
+	auto readModifyWrite = [&](Key k){
+		if(Key* v = tree->findPtr(k)){
+			checksum += *v;
+			*v += 1;
+		}
+	};
+	auto percent = [&]{
+		return rng() % 100;
+	};
+	r = measure("ycsb-a", numOps, [&](size_t){
+		percent() < 50 ? read(zipfKey()) : update(zipfKey());
+	});
+	report(r, KeysLimit, numKeys, checksum);
+	r = measure("ycsb-b", numOps, [&](size_t){
+		percent() < 95 ? read(zipfKey()) : update(zipfKey());
+	});
+	report(r, KeysLimit, numKeys, checksum);
+	r = measure("ycsb-c", numOps, [&](size_t){
+		read(zipfKey());
+	});
+	report(r, KeysLimit, numKeys, checksum);
+	r = measure("ycsb-f", numOps, [&](size_t){
+		percent() < 50 ? read(zipfKey()) : readModifyWrite(zipfKey());
+	});
+	report(r, KeysLimit, numKeys, checksum);
+
+	//D and E insert new records; D reads skew towards the newest ones
+	uint64_t nextId = numKeys;
+	r = measure("ycsb-d", numOps, [&](size_t){
+		if(percent() < 95)
+			read(keyOf(nextId - 1 - std::min<uint64_t>(zipf.next(rng), nextId - 1)));
+		else
+			tree->insert(keyOf(nextId), nextId), ++nextId;
+	});
+	assert(tree->validate());
+	report(r, KeysLimit, numKeys, checksum);
+	r = measure("ycsb-e", numOps, [&](size_t){
+		if(percent() < 95){
+			int length = 1 + rng() % 100;
+			for(auto it = tree->lowerBound(zipfKey()); it != tree->end() && length-- > 0; ++it)
+				checksum += it.value();
+		}else{
+			tree->insert(keyOf(nextId), nextId);
+			++nextId;
+		}
+	});
+	assert(tree->validate());
+	report(r, KeysLimit, numKeys, checksum);
+
+	r = measure("rand-remove", nextId, [&](size_t i){
+		checksum += tree->remove(keyOf(i));
+	});
+	assert(tree->validate());
+	report(r, KeysLimit, numKeys, checksum);
+	delete tree;
+}
+
+//Node sizes swept: 256 bytes (four cache lines), 512, 1 KiB and a 4 KiB page
+template<int... Limits>
+struct Sweep{
+	static void run(const std::vector<int>& selected, size_t numKeys, size_t numOps){
+		auto runOne = [&](int limit, void (*fn)(size_t, size_t)){
+			if(selected.empty() || std::find(selected.begin(), selected.end(), limit) != selected.end())
+				fn(numKeys, numOps);
+		};
+		(runOne(Limits, &runConfiguration<Limits>), ...);
+	}
+};
+typedef Sweep<fanoutForBytes<Key, Key>(256), fanoutForBytes<Key, Key>(512), fanoutForBytes<Key, Key>(1024),
+		fanoutForBytes<Key, Key>(4096)> NodeSizes;
+
+std::vector<size_t> parseList(const char* text){
+	std::vector<size_t> values;
+	for(const char* p = text; *p; ){
+		char* end;
+		values.push_back(strtoull(p, &end, 10));
+		p = *end == ',' ? end + 1 : end;
+		if(end == p && *p)
+			break;
+	}
+	return values;
+}
+
+int main(int argc, char** argv){
+	std::vector<size_t> keyCounts = parseList(argc > 1 ? argv[1] : "1000000,10000000");
+	size_t numOps = argc > 2 ? strtoull(argv[2], nullptr, 10) : 1000000;
+	std::vector<int> limits;
+	if(argc > 3 && strcmp(argv[3], "all") != 0){
+		for(size_t limit : parseList(argv[3]))
+			limits.push_back(limit);
+	}
+	for(size_t numKeys : keyCounts)
+		NodeSizes::run(limits, numKeys, numOps);
+	return 0;
+}
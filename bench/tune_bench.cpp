@@ -0,0 +1,179 @@
+#include "../BpTree.h"
+#include "../OpTrace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+//Replays an operation trace against trees of several leaf and interior capacities and fill policies and
+//recommends the configuration that served it fastest, preferring less memory among those within 5% of the
+//fastest time. Without a trace file, two synthetic traces are generated and tuned for: a read-mostly one
+//(point lookups and short scans over a preloaded tree) and a churn one, which inserts and removes keys in
+//the same place so nodes hover at their split and merge boundaries. A trace is recorded with OpTrace and
+//saved with OpTrace::save; its keys must be 8 bytes. save=path writes the synthetic traces to path.read
+//and path.churn instead of tuning.
+//Usage: tune_bench [trace path | save=path] [numKeys=200000] [numOps=2000000] [runs=3]
+
+typedef uint64_t Key;
+typedef OpTrace<Key> Trace;
+
+//A tree with leaves of LeafBytes and interior nodes of InteriorBytes, under the given fill policy
+template<size_t LeafBytes, size_t InteriorBytes, int MinFill = 50, int SplitAt = 50, int MergeBelow = MinFill>
+struct Candidate{
+	typedef BpTree<Key, uint64_t, std::less<Key>, interiorFanoutForBytes<Key>(InteriorBytes), NewDeleteNodeAllocator,
+			NodePolicy<leafFanoutForBytes<Key, uint64_t>(LeafBytes), MinFill, SplitAt, MergeBelow>> Tree;
+};
+
+struct Result{
+	int leafKeys;
+	int interiorKeys;
+	int minFill;
+	int splitAt;
+	int mergeBelow;
+	double nsPerOp;
+	double bytesPerEntry;
+	double leafFill; //Average share of leaf capacity in use after the trace
+};
+
+double secondsSince(std::chrono::steady_clock::time_point begin){
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+template<typename Tree>
+Result measure(const Trace& trace, int runs, size_t& checksum){
+	typedef typename Tree::Traits Traits;
+	typedef typename Traits::FillPolicy Policy;
+	Result result{Traits::leafKeysLimit, Traits::interiorKeysLimit, Policy::minFill, Policy::splitAt, Policy::mergeBelow,
+			1e300, 0, 0};
+	for(int run = 0; run < runs; ++run){
+		Tree tree;
+		auto begin = std::chrono::steady_clock::now();
+		checksum += trace.replay(tree);
+		result.nsPerOp = std::min(result.nsPerOp, secondsSince(begin) * 1e9 / trace.size());
+		if(run == 0){
+			TreeStats stats = tree.stats();
+			size_t bytes = stats.leafNodes * sizeof(typename Tree::LeafNode) + stats.interiorNodes * sizeof(typename Tree::InteriorNode);
+			result.bytesPerEntry = stats.entries ? (double)bytes / stats.entries : 0;
+			result.leafFill = stats.leafNodes ? (double)stats.entries / (stats.leafNodes * Traits::leafKeysLimit) : 0;
+		}
+	}
+	return result;
+}
+
+//Every candidate: four leaf sizes by three interior sizes under the default policy, then lazy merging,
+//a lower fill and a right-heavy split for the two middle sizes
+template<typename... Candidates>
+struct CandidateList{
+	static std::vector<Result> measureAll(const Trace& trace, int runs, size_t& checksum){
+		return {measure<typename Candidates::Tree>(trace, runs, checksum)...};
+	}
+};
+
+typedef CandidateList<
+		Candidate<256, 256>, Candidate<256, 512>, Candidate<256, 1024>,
+		Candidate<512, 256>, Candidate<512, 512>, Candidate<512, 1024>,
+		Candidate<1024, 256>, Candidate<1024, 512>, Candidate<1024, 1024>,
+		Candidate<2048, 256>, Candidate<2048, 512>, Candidate<2048, 1024>,
+		Candidate<512, 512, 50, 50, 10>, Candidate<1024, 512, 50, 50, 10>,
+		Candidate<512, 512, 35, 50, 5>, Candidate<1024, 512, 35, 50, 5>,
+		Candidate<512, 512, 50, 70>, Candidate<1024, 512, 50, 70>> Candidates;
+
+//Fastest, unless another within 5% of its time takes less memory
+const Result& recommend(const std::vector<Result>& results){
+	const Result* fastest = &results[0];
+	for(const Result& r : results){
+		if(r.nsPerOp < fastest->nsPerOp)
+			fastest = &r;
+	}
+	const Result* best = fastest;
+	for(const Result& r : results){
+		if(r.nsPerOp <= fastest->nsPerOp * 1.05 && r.bytesPerEntry < best->bytesPerEntry)
+			best = &r;
+	}
+	return *best;
+}
+
+void tune(const char* name, const Trace& trace, int runs, size_t& checksum){
+	printf("trace %s: ops=%zu\n", name, trace.size());
+	std::vector<Result> results = Candidates::measureAll(trace, runs, checksum);
+	for(const Result& r : results){
+		printf("  leafKeys=%-4d interiorKeys=%-3d minFill=%-2d splitAt=%-2d mergeBelow=%-2d ns/op=%7.1f bytes/entry=%6.1f leafFill=%.2f\n",
+				r.leafKeys, r.interiorKeys, r.minFill, r.splitAt, r.mergeBelow, r.nsPerOp, r.bytesPerEntry, r.leafFill);
+	}
+	const Result& best = recommend(results);
+	printf("  recommended: BpTree<Key, Value, Compare, %d, Allocator, NodePolicy<%d, %d, %d, %d>> (%.1f ns/op, %.1f bytes/entry)\n",
+			best.interiorKeys, best.leafKeys, best.minFill, best.splitAt, best.mergeBelow, best.nsPerOp, best.bytesPerEntry);
+}
+
+//Preload numKeys random keys, then 90% lookups (a quarter of them hits), 5% scans of about 50 keys and 5% inserts
+Trace readMostly(size_t numKeys, size_t numOps){
+	std::mt19937_64 rng(1);
+	Trace trace;
+	for(size_t i = 0; i < numKeys; ++i)
+		trace.insert(rng() % (numKeys * 4));
+	for(size_t i = 0; i < numOps; ++i){
+		Key k = rng() % (numKeys * 4);
+		unsigned dice = rng() % 100;
+		if(dice < 90)
+			trace.find(k);
+		else if(dice < 95)
+			trace.scan(k, k + 200);
+		else
+			trace.insert(k);
+	}
+	return trace;
+}
+
+//Preload numKeys keys, then repeatedly fill a random stretch of the key space with as many new keys as it
+//holds, look them up and remove them again, so the same nodes split and merge over and over
+Trace churn(size_t numKeys, size_t numOps){
+	std::mt19937_64 rng(2);
+	Trace trace;
+	for(size_t i = 0; i < numKeys; ++i)
+		trace.insert(i * 4);
+	const Key stretch = 256;
+	while(trace.size() < numKeys + numOps){
+		Key lo = rng() % (numKeys * 4 - stretch) & ~Key(3);
+		for(Key k = lo + 1; k < lo + stretch; k += 4)
+			trace.insert(k);
+		for(Key k = lo + 1; k < lo + stretch; k += 4)
+			trace.find(k + rng() % 2);
+		for(Key k = lo + 1; k < lo + stretch; k += 4)
+			trace.remove(k);
+	}
+	return trace;
+}
+
+int main(int argc, char** argv){
+	const char* arg = argc > 1 ? argv[1] : "";
+	size_t numKeys = argc > 2 ? strtoull(argv[2], nullptr, 10) : 200000;
+	size_t numOps = argc > 3 ? strtoull(argv[3], nullptr, 10) : 2000000;
+	int runs = argc > 4 ? atoi(argv[4]) : 3;
+	size_t checksum = 0;
+
+	if(std::string(arg).compare(0, 5, "save=") == 0){
+		std::string path = arg + 5;
+		if(!readMostly(numKeys, numOps).save((path + ".read").c_str()) || !churn(numKeys, numOps).save((path + ".churn").c_str())){
+			perror(path.c_str());
+			return 1;
+		}
+		return 0;
+	}
+	if(*arg){
+		Trace trace;
+		if(!trace.load(arg)){
+			fprintf(stderr, "%s: not a trace of 8-byte keys\n", arg);
+			return 1;
+		}
+		tune(arg, trace, runs, checksum);
+	}else{
+		tune("read-mostly", readMostly(numKeys, numOps), runs, checksum);
+		tune("churn", churn(numKeys, numOps), runs, checksum);
+	}
+	printf("checksum=%zu\n", checksum);
+	return 0;
+}
@@ -0,0 +1,67 @@
+#include "../BlobBpTree.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+
+//KB-sized values stored as std::string in the leaves against ValueHandles into a slab (BlobBpTree).
+//Reports insert cost, which includes every split moving values, and lookup cost with find() copying the
+//value out against a zero-copy view. Each lookup reads the value's last byte, so the payload is touched.
+//Usage: value_bench [numKeys=200000] [valueBytes=1024] [numLookups=1000000]
+
+constexpr int fanout = 16;
+
+double nsPer(std::chrono::steady_clock::time_point begin, size_t n){
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / n;
+}
+
+int main(int argc, char** argv){
+	size_t numKeys = argc > 1 ? strtoull(argv[1], nullptr, 10) : 200000;
+	size_t valueBytes = argc > 2 ? strtoull(argv[2], nullptr, 10) : 1024;
+	size_t numLookups = argc > 3 ? strtoull(argv[3], nullptr, 10) : 1000000;
+
+	std::mt19937_64 rng(42);
+	std::vector<uint64_t> keys(numKeys);
+	for(auto& k : keys)
+		k = rng();
+	std::string payload(valueBytes, 'v');
+	std::vector<uint64_t> probes(numLookups);
+	for(auto& p : probes)
+		p = keys[rng() % numKeys];
+
+	{
+		BpTree<uint64_t, std::string, std::less<uint64_t>, fanout> tree;
+		auto begin = std::chrono::steady_clock::now();
+		for(auto k : keys)
+			tree.insert(k, payload);
+		printf("std::string leaves: insert ns=%.1f\n", nsPer(begin, numKeys));
+		uint64_t sum = 0;
+		begin = std::chrono::steady_clock::now();
+		for(auto p : probes)
+			sum += tree.find(p).back();
+		printf("std::string leaves: find (copy) ns=%.1f checksum=%llu\n", nsPer(begin, numLookups), (unsigned long long)sum);
+		sum = 0;
+		begin = std::chrono::steady_clock::now();
+		for(auto p : probes)
+			sum += tree.findPtr(p)->back();
+		printf("std::string leaves: findPtr ns=%.1f checksum=%llu\n", nsPer(begin, numLookups), (unsigned long long)sum);
+	}
+	{
+		BlobBpTree<uint64_t, std::less<uint64_t>, fanout> tree;
+		auto begin = std::chrono::steady_clock::now();
+		for(auto k : keys)
+			tree.insert(k, payload);
+		printf("BlobBpTree:         insert ns=%.1f slabMiB=%.1f\n", nsPer(begin, numKeys), (double)tree.valueBytesReserved() / (1 << 20));
+		uint64_t sum = 0;
+		begin = std::chrono::steady_clock::now();
+		for(auto p : probes){
+			std::string_view value;
+			tree.find(p, value);
+			sum += value.back();
+		}
+		printf("BlobBpTree:         find (view) ns=%.1f checksum=%llu\n", nsPer(begin, numLookups), (unsigned long long)sum);
+	}
+	return 0;
+}
@@ -0,0 +1,121 @@
+#include "../BpTree.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+//Cost of a point-in-time view: a deep copy through the copy constructor against snapshot(), then the
+//writer's throughput while a version is open (every first change below a shared node copies its path).
+//Last, reader threads scan and look up the newest version the writer publishes while it keeps inserting.
+//Usage: version_bench [numKeys=2000000] [readers=4] [seconds=2]
+
+typedef BpTree<uint64_t, uint64_t, std::less<uint64_t>, fanoutForBytes<uint64_t, uint64_t>(256)> Tree;
+
+double msSince(std::chrono::steady_clock::time_point begin){
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+}
+
+double nodeMiB(const Tree& tree){
+	TreeStats stats = tree.stats();
+	return (stats.leafNodes * sizeof(Tree::LeafNode) + stats.interiorNodes * sizeof(Tree::InteriorNode)) / double(1 << 20);
+}
+
+//Random updates and inserts, returning ns per operation
+double writeLoad(Tree& tree, size_t numKeys, size_t numOps, std::mt19937_64& rng){
+	auto begin = std::chrono::steady_clock::now();
+	for(size_t i = 0; i < numOps; ++i){
+		uint64_t k = rng() % (2 * numKeys);
+		if(uint64_t* v = tree.findPtr(k))
+			*v += 1;
+		else
+			tree.insert(k, i);
+	}
+	return msSince(begin) * 1e6 / numOps;
+}
+
+int main(int argc, char** argv){
+	size_t numKeys = argc > 1 ? strtoull(argv[1], nullptr, 10) : 2000000;
+	int numReaders = argc > 2 ? atoi(argv[2]) : 4;
+	double seconds = argc > 3 ? atof(argv[3]) : 2;
+
+	std::mt19937_64 rng(42);
+	std::vector<std::pair<uint64_t, uint64_t>> entries(numKeys);
+	for(size_t i = 0; i < numKeys; ++i)
+		entries[i] = {2 * i, i};
+	Tree tree;
+	tree.bulkLoad(entries.begin(), entries.end(), 0.7);
+	printf("tree: keys=%zu nodeMiB=%.1f\n", numKeys, nodeMiB(tree));
+
+	auto begin = std::chrono::steady_clock::now();
+	Tree* copy = new Tree(tree);
+	printf("copy constructor: ms=%.3f\n", msSince(begin));
+	delete copy;
+
+	const size_t numOps = numKeys / 4;
+	double shared, sharedMiB;
+	{
+		begin = std::chrono::steady_clock::now();
+		Tree::Version version = tree.snapshot();
+		printf("snapshot():       ms=%.3f\n", msSince(begin));
+		shared = writeLoad(tree, numKeys, numOps, rng);
+		sharedMiB = nodeMiB(tree);
+	}
+	double unshared = writeLoad(tree, numKeys, numOps, rng); //Its first write releases the version
+	printf("writes: ns/op version open=%.1f none open=%.1f; tree nodeMiB after %zu writes with a version open=%.1f\n",
+			shared, unshared, numOps, sharedMiB);
+
+	//The writer publishes a version every publishEvery inserts; readers pick up the newest one
+	const size_t publishEvery = 1000;
+	std::mutex published;
+	Tree::Version newest = tree.snapshot();
+	std::atomic<bool> stop(false);
+	std::atomic<uint64_t> readerOps(0), checksum(0);
+	std::vector<std::thread> readers;
+	for(int r = 0; r < numReaders; ++r){
+		readers.emplace_back([&, r]{
+			std::mt19937_64 readerRng(r + 1);
+			uint64_t ops = 0, sum = 0;
+			while(!stop.load(std::memory_order_relaxed)){
+				std::unique_lock<std::mutex> lock(published);
+				Tree::Version view = newest;
+				lock.unlock();
+				for(int i = 0; i < 1000; ++i, ++ops){
+					uint64_t k = readerRng() % (2 * numKeys);
+					if(i % 100 == 0){
+						view.scan(k, k + 200, [&sum](uint64_t, uint64_t v){
+							sum += v;
+						});
+					}else{
+						sum += view.find(k);
+					}
+				}
+			}
+			readerOps += ops;
+			checksum += sum;
+		});
+	}
+	size_t writes = 0;
+	begin = std::chrono::steady_clock::now();
+	while(msSince(begin) < seconds * 1000){
+		for(size_t i = 0; i < publishEvery; ++i, ++writes)
+			tree.insert(rng() % (4 * numKeys), writes);
+		Tree::Version next = tree.snapshot();
+		std::lock_guard<std::mutex> lock(published);
+		std::swap(newest, next);
+	}
+	stop = true;
+	for(auto& reader : readers)
+		reader.join();
+	double elapsed = msSince(begin) / 1000;
+	printf("concurrent: readers=%d reader ops/s=%.0f writer inserts/s=%.0f versions=%zu checksum=%llu\n", numReaders,
+			readerOps / elapsed, writes / elapsed, writes / publishEvery, (unsigned long long)checksum.load());
+	std::string error;
+	if(!tree.validate(&error))
+		printf("invalid tree: %s\n", error.c_str());
+	return 0;
+}
@@ -0,0 +1,117 @@
+#include "../DurableBpTree.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+//Sustained insert throughput of DurableBpTree under each sync policy, against the same tree without a
+//log. Each mode inserts random keys for a fixed time; everyOp also runs with several writer threads to
+//show how group commit shares fsyncs between them. Ends with a checkpoint and a recovery of the last mode.
+//Usage: wal_bench [dir=/tmp] [seconds=2] [threads=4]
+
+typedef DurableBpTree<uint64_t, uint64_t> Tree;
+
+struct Result{
+	size_t inserts;
+	double seconds;
+};
+
+Result run(Tree& tree, double seconds, unsigned numThreads){
+	std::atomic<size_t> total(0);
+	auto begin = std::chrono::steady_clock::now();
+	auto deadline = begin + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds));
+	std::vector<std::thread> threads;
+	for(unsigned t = 0; t < numThreads; ++t){
+		threads.emplace_back([&, t]{
+			std::mt19937_64 rng(42 + t);
+			size_t n = 0;
+			while(std::chrono::steady_clock::now() < deadline){
+				for(int i = 0; i < 16; ++i){
+					uint64_t k = rng();
+					n += tree.insert(k, k);
+				}
+			}
+			total += n;
+		});
+	}
+	for(auto& thread : threads)
+		thread.join();
+	tree.sync();
+	return Result{total.load(), std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count()};
+}
+
+int main(int argc, char** argv){
+	std::string dir = argc > 1 ? argv[1] : "/tmp";
+	double seconds = argc > 2 ? strtod(argv[2], nullptr) : 2;
+	unsigned numThreads = argc > 3 ? strtoul(argv[3], nullptr, 10) : 4;
+	std::string logPath = dir + "/wal_bench.log", checkpointPath = dir + "/wal_bench.snap";
+
+	//Baseline: the same inserts with no log at all
+	{
+		BpTree<uint64_t, uint64_t> tree;
+		std::mt19937_64 rng(42);
+		size_t n = 0;
+		auto begin = std::chrono::steady_clock::now();
+		double elapsed = 0;
+		while(elapsed < seconds){
+			for(int i = 0; i < 1024; ++i){
+				uint64_t k = rng();
+				n += tree.insert(k, k);
+			}
+			elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		}
+		printf("%-22s threads=1 inserts/s=%.0f\n", "no log", n / elapsed);
+	}
+
+	struct Mode{
+		const char* name;
+		WriteAheadLog::SyncPolicy sync;
+		unsigned threads;
+	};
+	const Mode modes[] = {
+		{"everyOp", WriteAheadLog::SyncPolicy::everyOp, 1},
+		{"everyOp group commit", WriteAheadLog::SyncPolicy::everyOp, numThreads},
+		{"batched 128", WriteAheadLog::SyncPolicy::batched, 1},
+		{"interval 10ms", WriteAheadLog::SyncPolicy::interval, 1},
+	};
+	for(const Mode& mode : modes){
+		unlink(logPath.c_str());
+		unlink(checkpointPath.c_str());
+		WriteAheadLog::Options options;
+		options.sync = mode.sync;
+		Tree tree(options);
+		if(!tree.open(logPath.c_str(), checkpointPath.c_str())){
+			perror(logPath.c_str());
+			return 1;
+		}
+		Result result = run(tree, seconds, mode.threads);
+		printf("%-22s threads=%u inserts/s=%.0f\n", mode.name, mode.threads, result.inserts / result.seconds);
+
+		if(&mode == &modes[sizeof(modes) / sizeof(modes[0]) - 1]){
+			tree.close();
+			Tree recovered;
+			auto begin = std::chrono::steady_clock::now();
+			recovered.open(logPath.c_str(), checkpointPath.c_str());
+			printf("recover from log: records=%zu ms=%.1f\n", recovered.recoveredRecords(),
+					std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count());
+			begin = std::chrono::steady_clock::now();
+			recovered.checkpoint();
+			printf("checkpoint: ms=%.1f\n", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count());
+			recovered.close();
+			Tree reopened;
+			begin = std::chrono::steady_clock::now();
+			reopened.open(logPath.c_str(), checkpointPath.c_str());
+			printf("recover from checkpoint: records=%zu ms=%.1f\n", reopened.recoveredRecords(),
+					std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count());
+		}
+	}
+	unlink(logPath.c_str());
+	unlink(checkpointPath.c_str());
+	return 0;
+}
@@ -2,7 +2,7 @@
 #include "BpTree.h"
 
 int main(){
-  BpTree bptree(4);
+  BpTree<int, std::string, std::less<int>, 4> bptree;
   bptree.insert(30, "A");
   bptree.insert(130, "B");
   bptree.insert(9, "C");